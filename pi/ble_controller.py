@@ -1,5 +1,5 @@
 """
-BLE Proxy Controller — scan, connect, and write to BLE peripherals.
+BLE Proxy Controller — scan, connect, write, and benchmark BLE peripherals.
 
 Uses bleak (async BLE library) with its own asyncio event loop running
 in a background daemon thread.  All public functions are synchronous
@@ -7,6 +7,7 @@ and thread-safe.
 """
 
 import asyncio
+import json
 import threading
 import time
 
@@ -28,6 +29,12 @@ _state: str = "idle"  # idle, scanning, connected
 
 BLE_SCAN_TIMEOUT = float(__import__("os").environ.get("BLE_SCAN_TIMEOUT", "5.0"))
 
+# Nordic UART Service characteristics used by the test firmware benchmark
+NUS_RX_UUID = "6e400002-b5a3-f393-e0a9-e50e24dcca9e"   # central writes
+NUS_TX_UUID = "6e400003-b5a3-f393-e0a9-e50e24dcca9e"   # peripheral notifies
+BENCH_TESTS = ("tx", "rx", "lat", "sweep")
+BENCH_SWEEP_STEPS = 4
+
 
 def _ensure_loop():
     """Start the asyncio event loop thread if not already running."""
@@ -44,11 +51,11 @@ def _ensure_loop():
     _loop_thread.start()
 
 
-def _run_async(coro):
+def _run_async(coro, timeout: float = 30):
     """Run an async coroutine on the BLE event loop and return the result."""
     _ensure_loop()
     future = asyncio.run_coroutine_threadsafe(coro, _loop)
-    return future.result(timeout=30)
+    return future.result(timeout=timeout)
 
 
 def _on_disconnect(client):
@@ -204,6 +211,114 @@ def write(characteristic: str, data: bytes, response: bool = True) -> dict:
         return {"ok": False, "error": f"write failed: {e}"}
 
 
+def bench(test: str = "tx", duration_ms: int = 5000, count: int = 100,
+          length: int = 8) -> dict:
+    """Run a link benchmark on a connected test-firmware board.
+
+    The firmware runs the test (see test-firmware/main/ble_bench.h) and
+    answers with one JSON report per test, or per step for "sweep".  The
+    host side adds its own view: notification bytes seen for tx,
+    bytes written for rx.  Pings of the "lat" test are written back as
+    soon as they arrive.
+    """
+    if not available():
+        return {"ok": False, "error": "bleak not installed — run: pip3 install bleak"}
+    if test not in BENCH_TESTS:
+        return {"ok": False, "error": f"unknown test {test!r}, expected one of {BENCH_TESTS}"}
+
+    with _lock:
+        client = _client
+        if client is None or _state != "connected":
+            return {"ok": False, "error": "not connected"}
+
+    if test == "lat":
+        command = f"!lat {count} {length}"
+        budget = count * 1.0
+    elif test == "sweep":
+        command = f"!sweep {duration_ms}"
+        budget = BENCH_SWEEP_STEPS * (duration_ms / 1000 + 5)
+    else:
+        command = f"!{test} {duration_ms}"
+        budget = duration_ms / 1000 + 2
+
+    async def _bench():
+        loop = asyncio.get_running_loop()
+        done = asyncio.Event()
+        reports = []
+        text = bytearray()
+        in_report = False
+        seen = {"bytes": 0, "first": None, "last": None}
+
+        def on_notify(_char, data: bytearray):
+            nonlocal in_report
+            data = bytes(data)
+            if test == "lat" and not in_report and data[:1] == b"P":
+                loop.create_task(client.write_gatt_char(NUS_RX_UUID, data, response=False))
+                return
+            # Reports are '#' <json> '\n'; filler bytes in between are 0xA5
+            while data:
+                if not in_report:
+                    i = data.find(b"#")
+                    filler = len(data) if i < 0 else i
+                    if filler:
+                        now = time.monotonic()
+                        seen["bytes"] += filler
+                        seen["first"] = seen["first"] or now
+                        seen["last"] = now
+                    if i < 0:
+                        return
+                    in_report = True
+                    data = data[i + 1:]
+                j = data.find(b"\n")
+                if j < 0:
+                    text.extend(data)
+                    return
+                text.extend(data[:j])
+                data = data[j + 1:]
+                in_report = False
+                try:
+                    report = json.loads(text)
+                except ValueError:
+                    report = {"error": "malformed report", "raw": text.decode(errors="replace")}
+                text.clear()
+                reports.append(report)
+                if report.get("done") or "error" in report:
+                    done.set()
+
+        await client.start_notify(NUS_TX_UUID, on_notify)
+        try:
+            await client.write_gatt_char(NUS_RX_UUID, command.encode(), response=True)
+            host = {}
+            if test == "rx":
+                chunk = b"\xa5" * max(client.mtu_size - 3, 20)
+                written = 0
+                start = time.monotonic()
+                deadline = start + duration_ms / 1000
+                while time.monotonic() < deadline:
+                    await client.write_gatt_char(NUS_RX_UUID, chunk, response=False)
+                    written += len(chunk)
+                elapsed = time.monotonic() - start
+                host = {"bytes_written": written, "bps": int(written / elapsed) if elapsed else 0}
+            try:
+                await asyncio.wait_for(done.wait(), timeout=budget + 10)
+            except asyncio.TimeoutError:
+                await client.write_gatt_char(NUS_RX_UUID, b"!stop", response=True)
+                return {"ok": False, "error": "benchmark timed out", "reports": reports}
+            if test == "tx" and seen["first"]:
+                span = seen["last"] - seen["first"]
+                host = {"bytes_received": seen["bytes"],
+                        "bps": int(seen["bytes"] / span) if span > 0 else 0}
+            return {"ok": True, "test": test, "command": command,
+                    "reports": reports, "host": host}
+        finally:
+            await client.stop_notify(NUS_TX_UUID)
+
+    try:
+        return _run_async(_bench(), timeout=budget + 20)
+    except Exception as e:
+        return {"ok": False, "error": f"bench failed: {e}"}
+
+
 def shutdown():
     """Stop the event loop and clean up."""
     global _loop
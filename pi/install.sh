@@ -25,6 +25,7 @@ sudo cp "$SCRIPT_DIR/portal.py" /usr/local/bin/rfc2217-portal
 sudo cp "$SCRIPT_DIR/plain_rfc2217_server.py" /usr/local/bin/plain_rfc2217_server.py
 sudo cp "$SCRIPT_DIR/wifi_controller.py" /usr/local/bin/wifi_controller.py
 sudo cp "$SCRIPT_DIR/ble_controller.py" /usr/local/bin/ble_controller.py
+sudo cp "$SCRIPT_DIR/log_decoder.py" /usr/local/bin/log_decoder.py
 sudo cp "$SCRIPT_DIR/rfc2217-learn-slots" /usr/local/bin/rfc2217-learn-slots
 
 sudo chmod +x /usr/local/bin/rfc2217-portal
@@ -0,0 +1,214 @@
+#!/usr/bin/env python3
+"""
+Deferred Log Decoder
+
+Decodes the binary log records sent by the test firmware when built with
+CONFIG_WB_UDP_LOG_DEFERRED_HOST.  Each record carries the address of its
+format string plus the raw argument words; the format string is looked up
+in the firmware ELF and rendered here.
+
+Batches built with CONFIG_WB_TIME_SYNC carry each line's device time,
+printed as UTC once the board is synced and as seconds since boot before.
+
+Record layout (see test-firmware/main/log_defer.h):
+    0x00 <text bytes>                     already formatted text
+    0x01 <fmt addr u32 LE> <args ...>     int 4B, int64/double 8B, %s NUL-terminated
+
+Usage:
+    log_decoder.py --elf build/wb-test-firmware.elf            # listen on UDP :5555
+    log_decoder.py --elf build/wb-test-firmware.elf -p 5556
+"""
+
+import argparse
+import re
+import socket
+import struct
+import sys
+import time
+
+REC_TEXT = 0x00
+REC_DEFERRED = 0x01
+
+BATCH_MAGIC = b"WB"
+BATCH_HDR_LEN = 8
+BATCH_FLAG_BINARY = 0x01
+BATCH_FLAG_TIMESTAMPS = 0x02     # entries: [u64 BE µs][u16 BE len][line or record]
+BATCH_FLAG_UNIX_TIME = 0x04      # µs are Unix time rather than since boot
+
+SHT_PROGBITS = 1
+
+# %[flags][width][.precision][length]conversion
+_SPEC_RE = re.compile(r"%([-+ #0]*)(\*|\d+)?(?:\.(\*|\d*))?([hlLjzt]*)([diuxXocpsfFeEgGaAn%])?")
+
+
+class ElfStrings:
+    """Resolve target addresses to NUL-terminated strings from an ELF32 file."""
+
+    def __init__(self, path):
+        with open(path, "rb") as f:
+            self.data = f.read()
+        if self.data[:4] != b"\x7fELF" or self.data[4] != 1:
+            raise ValueError(f"{path}: not an ELF32 file")
+        shoff, = struct.unpack_from("<I", self.data, 0x20)
+        shentsize, shnum = struct.unpack_from("<HH", self.data, 0x2E)
+        self.sections = []
+        for i in range(shnum):
+            (_name, sh_type, _flags, addr, offset, size,
+             *_rest) = struct.unpack_from("<10I", self.data, shoff + i * shentsize)
+            if sh_type == SHT_PROGBITS and addr and size:
+                self.sections.append((addr, addr + size, offset))
+        self._cache = {}
+
+    def string_at(self, addr):
+        if addr in self._cache:
+            return self._cache[addr]
+        for start, end, offset in self.sections:
+            if start <= addr < end:
+                pos = offset + (addr - start)
+                stop = self.data.find(b"\0", pos, offset + (end - start))
+                if stop < 0:
+                    break
+                s = self.data[pos:stop].decode("utf-8", errors="replace")
+                self._cache[addr] = s
+                return s
+        return None
+
+
+def _render(fmt, args):
+    """Render a C format string against the packed argument bytes."""
+    out = []
+    pos = 0
+    i = 0
+
+    def take(n):
+        nonlocal i
+        chunk = args[i:i + n]
+        if len(chunk) < n:
+            raise IndexError
+        i += n
+        return chunk
+
+    try:
+        for m in _SPEC_RE.finditer(fmt):
+            out.append(fmt[pos:m.start()])
+            pos = m.end()
+            flags, width, prec, length, conv = m.groups()
+            if conv is None:
+                out.append(m.group(0))
+                continue
+            if conv == "%":
+                out.append("%")
+                continue
+            if width == "*":
+                width = str(struct.unpack("<i", take(4))[0])
+            if prec == "*":
+                prec = str(struct.unpack("<i", take(4))[0])
+            spec = "%" + flags + (width or "") + ("." + prec if prec is not None else "")
+            wide = "ll" in length or "j" in length
+            if conv in "diuxXo":
+                raw = take(8 if wide else 4)
+                signed = conv in "di"
+                val = int.from_bytes(raw, "little", signed=signed)
+                out.append((spec + ("d" if conv in "diu" else conv)) % val)
+            elif conv == "c":
+                out.append((spec + "c") % (struct.unpack("<I", take(4))[0] & 0xFF))
+            elif conv == "p":
+                out.append("0x%x" % struct.unpack("<I", take(4))[0])
+            elif conv in "fFeEgG":
+                out.append((spec + conv) % struct.unpack("<d", take(8))[0])
+            elif conv in "aA":
+                out.append(struct.unpack("<d", take(8))[0].hex())
+            elif conv == "s":
+                end = args.index(b"\0", i)
+                s = args[i:end].decode("utf-8", errors="replace")
+                i = end + 1
+                out.append((spec + "s") % s)
+            elif conv == "n":
+                pass
+    except (IndexError, ValueError, struct.error):
+        out.append("<truncated>")
+        return "".join(out)
+    out.append(fmt[pos:])
+    return "".join(out)
+
+
+def decode_record(rec, elf=None):
+    """Decode one record to text (including its trailing newline, if any)."""
+    if not rec:
+        return ""
+    if rec[0] != REC_DEFERRED or len(rec) < 5:
+        return rec[1:].decode("utf-8", errors="replace")
+    addr, = struct.unpack_from("<I", rec, 1)
+    fmt = elf.string_at(addr) if elf else None
+    if fmt is None:
+        return f"<deferred fmt@0x{addr:08x} args={rec[5:].hex()}>\n"
+    return _render(fmt, rec[5:])
+
+
+def decode_binary_batch(payload, elf=None):
+    """Split a binary batch payload ([u16 BE len][record]...) into text lines."""
+    lines = []
+    pos = 0
+    while pos + 2 <= len(payload):
+        n = int.from_bytes(payload[pos:pos + 2], "big")
+        rec = payload[pos + 2:pos + 2 + n]
+        pos += 2 + n
+        text = decode_record(rec, elf)
+        lines.extend(ln.rstrip("\r") for ln in text.split("\n") if ln.strip())
+    return lines
+
+
+def decode_timestamped_batch(payload, binary, elf=None):
+    """Split a timestamped batch payload into (µs, line) pairs."""
+    out = []
+    pos = 0
+    while pos + 10 <= len(payload):
+        us = int.from_bytes(payload[pos:pos + 8], "big", signed=True)
+        n = int.from_bytes(payload[pos + 8:pos + 10], "big")
+        entry = payload[pos + 10:pos + 10 + n]
+        pos += 10 + n
+        text = decode_record(entry, elf) if binary else entry.decode("utf-8", errors="replace")
+        out.extend((us, ln.rstrip("\r")) for ln in text.split("\n") if ln.strip())
+    return out
+
+
+def _stamp(us, unix_time):
+    if unix_time:
+        return time.strftime("%H:%M:%S", time.gmtime(us // 1000000)) + f".{us % 1000000:06d}Z"
+    return f"+{us / 1e6:.6f}s"
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Decode deferred UDP log records")
+    parser.add_argument("--elf", required=True, help="Firmware ELF with the format strings")
+    parser.add_argument("-p", "--port", type=int, default=5555, help="UDP port (default: 5555)")
+    args = parser.parse_args()
+
+    elf = ElfStrings(args.elf)
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    sock.bind(("0.0.0.0", args.port))
+    print(f"Decoding UDP logs on :{args.port} with {args.elf}", file=sys.stderr)
+
+    while True:
+        data, addr = sock.recvfrom(4096)
+        flags = 0
+        if data[:2] == BATCH_MAGIC and len(data) >= BATCH_HDR_LEN:
+            flags = data[3]
+            data = data[BATCH_HDR_LEN:]
+        binary = bool(flags & BATCH_FLAG_BINARY)
+        if flags & BATCH_FLAG_TIMESTAMPS:
+            unix_time = bool(flags & BATCH_FLAG_UNIX_TIME)
+            for us, line in decode_timestamped_batch(data, binary, elf):
+                print(f"[{addr[0]} {_stamp(us, unix_time)}] {line.rstrip()}", flush=True)
+            continue
+        if binary:
+            lines = decode_binary_batch(data, elf)
+        else:
+            lines = [ln for ln in data.decode("utf-8", errors="replace").split("\n") if ln.strip()]
+        for line in lines:
+            print(f"[{addr[0]}] {line.rstrip()}", flush=True)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,161 @@
+#!/usr/bin/env python3
+"""
+OTA Patch Builder
+
+Packs an ESP32 app image into the compressed / delta OTA container understood
+by the test firmware (see test-firmware/main/ota_patch.h).  Upload the output
+to the firmware repo like any .bin and point POST /ota at it — the firmware
+detects the format from the first bytes.
+
+Container layout (little-endian):
+    "WBOT" u8 version u8 flags u16 reserved
+    u32 target_size u32 base_size
+    base_sha256[32] target_sha256[32]
+    body — zlib stream if flags & 0x01, else raw
+
+With flags & 0x02 (delta) the body rebuilds the image from the board's
+running image:
+    0x00                      END
+    0x01 <u32 src> <u32 len>  COPY from running image
+    0x02 <u32 len> <bytes>    INSERT literal bytes
+
+Usage:
+    ota_patch.py new.bin -o new.wbot                    # compressed full image
+    ota_patch.py new.bin --base running.bin -o new.wbot # compressed delta
+"""
+
+import argparse
+import hashlib
+import struct
+import sys
+import zlib
+
+MAGIC = b"WBOT"
+VERSION = 1
+FLAG_DEFLATE = 0x01
+FLAG_DELTA = 0x02
+
+HDR_FMT = "<4sBBHII32s32s"
+HDR_LEN = struct.calcsize(HDR_FMT)
+
+OP_END = 0x00
+OP_COPY = 0x01
+OP_INSERT = 0x02
+
+BLOCK = 32      # minimum match length worth a COPY op
+STRIDE = 16     # base image is indexed every STRIDE bytes
+
+
+def delta_ops(base: bytes, target: bytes) -> bytes:
+    """Greedy block-match delta of target against base, as an op stream."""
+    index = {}
+    for off in range(0, len(base) - BLOCK + 1, STRIDE):
+        index.setdefault(base[off:off + BLOCK], off)
+
+    out = bytearray()
+
+    def insert(data):
+        if data:
+            out.extend(struct.pack("<BI", OP_INSERT, len(data)))
+            out.extend(data)
+
+    lit = 0
+    i = 0
+    n = len(target)
+    while i + BLOCK <= n:
+        src = index.get(target[i:i + BLOCK])
+        if src is None:
+            i += 1
+            continue
+        # Grow the match backwards into pending literals, then forwards
+        while i > lit and src > 0 and target[i - 1] == base[src - 1]:
+            i -= 1
+            src -= 1
+        length = BLOCK
+        while i + length < n and src + length < len(base) and target[i + length] == base[src + length]:
+            length += 1
+        insert(target[lit:i])
+        out.extend(struct.pack("<BII", OP_COPY, src, length))
+        i += length
+        lit = i
+    insert(target[lit:])
+    out.append(OP_END)
+    return bytes(out)
+
+
+def build(target: bytes, base: bytes | None = None, compress: bool = True) -> bytes:
+    flags = 0
+    body = target
+    if base is not None:
+        flags |= FLAG_DELTA
+        body = delta_ops(base, target)
+    if compress:
+        flags |= FLAG_DEFLATE
+        body = zlib.compress(body, 9)
+    base = base or b""
+    hdr = struct.pack(HDR_FMT, MAGIC, VERSION, flags, 0, len(target), len(base),
+                      hashlib.sha256(base).digest() if flags & FLAG_DELTA else bytes(32),
+                      hashlib.sha256(target).digest())
+    return hdr + body
+
+
+def apply(patch: bytes, base: bytes = b"") -> bytes:
+    """Rebuild the target image from a container (same checks as the firmware)."""
+    magic, version, flags, _, target_size, base_size, base_sha, target_sha = \
+        struct.unpack_from(HDR_FMT, patch)
+    if magic != MAGIC or version != VERSION:
+        raise ValueError("not a WBOT v1 container")
+    body = patch[HDR_LEN:]
+    if flags & FLAG_DEFLATE:
+        body = zlib.decompress(body)
+    if flags & FLAG_DELTA:
+        if hashlib.sha256(base[:base_size]).digest() != base_sha:
+            raise ValueError("patch was built against a different base image")
+        out = bytearray()
+        pos = 0
+        while True:
+            op = body[pos]
+            if op == OP_END:
+                break
+            if op == OP_COPY:
+                src, length = struct.unpack_from("<II", body, pos + 1)
+                out.extend(base[src:src + length])
+                pos += 9
+            elif op == OP_INSERT:
+                (length,) = struct.unpack_from("<I", body, pos + 1)
+                out.extend(body[pos + 5:pos + 5 + length])
+                pos += 5 + length
+            else:
+                raise ValueError(f"unknown op 0x{op:02x}")
+        body = bytes(out)
+    if len(body) != target_size or hashlib.sha256(body).digest() != target_sha:
+        raise ValueError("rebuilt image does not match the target hash")
+    return body
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Build a compressed / delta OTA container")
+    parser.add_argument("image", help="new app image (.bin)")
+    parser.add_argument("-o", "--output", required=True, help="output container")
+    parser.add_argument("--base", help="image currently running on the boards (enables delta)")
+    parser.add_argument("--no-compress", action="store_true", help="skip zlib compression")
+    args = parser.parse_args()
+
+    with open(args.image, "rb") as f:
+        target = f.read()
+    base = None
+    if args.base:
+        with open(args.base, "rb") as f:
+            base = f.read()
+
+    patch = build(target, base, compress=not args.no_compress)
+    apply(patch, base or b"")   # self-check before anything reaches a board
+
+    with open(args.output, "wb") as f:
+        f.write(patch)
+    print(f"{args.output}: {len(patch)} bytes for a {len(target)}-byte image "
+          f"({len(target) / max(len(patch), 1):.1f}x smaller)")
+
+
+if __name__ == "__main__":
+    sys.exit(main())
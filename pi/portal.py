@@ -8,14 +8,19 @@ Slot configuration is loaded from slots.json.
 """
 
 import http.server
+import base64
 import json
+import mmap
 import os
 import signal
 import socket
+import struct
 import subprocess
 import sys
 import threading
 import time
+import urllib.error
+import urllib.request
 from datetime import datetime, timezone
 from urllib.parse import parse_qs, urlparse
 
@@ -24,6 +29,10 @@ try:
     import ble_controller
 except ImportError:
     ble_controller = None
+try:
+    import log_decoder
+except ImportError:
+    log_decoder = None
 
 PORT = 8080
 CONFIG_FILE = os.environ.get("RFC2217_CONFIG", "/etc/rfc2217/slots.json")
@@ -81,15 +90,50 @@ _gpio_requests = {}     # pin -> gpiod.LineRequest
 _gpio_directions = {}   # pin -> "output" | "input"
 GPIO_ALLOWED = {5, 6, 12, 13, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27}  # BCM GPIOs safe for DUT control
 
-# UDP log receiver — ESP32 devices send debug logs over UDP to port 5555
+# Log receiver — ESP32 devices send debug logs to port 5555, over UDP or
+# (test firmware with a TCP log target) as a length-prefixed TCP stream
 UDP_LOG_PORT = int(os.environ.get("UDP_LOG_PORT", "5555"))
 UDP_LOG_MAX_LINES = 2000
 _udp_log: collections.deque = collections.deque(maxlen=UDP_LOG_MAX_LINES)
+_udp_stats: dict[str, dict] = {}   # source_ip -> {"datagrams", "lost", "seq"}
+UDP_LOG_BATCH_MAGIC = b"WB"       # batched datagram header (see test-firmware udp_log.c)
+UDP_LOG_BATCH_HDR_LEN = 8
+UDP_LOG_FLAG_BINARY = 0x01        # payload is deferred binary records
+UDP_LOG_FLAG_TIMESTAMPS = 0x02    # entries are [u64 BE µs][u16 BE len][line or record]
+UDP_LOG_FLAG_UNIX_TIME = 0x04     # those µs are Unix time, not time since boot
+UDP_LOG_ELF = os.environ.get("UDP_LOG_ELF")  # firmware ELF for decoding binary records
 _udp_thread: threading.Thread | None = None
 _udp_shutdown = threading.Event()
 
 # OTA firmware repository — serve .bin files for ESP32 OTA updates
 FIRMWARE_DIR = os.environ.get("FIRMWARE_DIR", "/var/lib/rfc2217/firmware")
+_fw_cache: dict[str, tuple] = {}  # path -> (mtime_ns, size, mmap); shared by all downloads
+_fw_cache_lock = threading.Lock()
+
+# Fleet OTA — trigger /ota on many boards with a bounded number of downloads
+DUT_HTTP_PORT = 8080              # test firmware http_server.c
+FLEET_OTA_PARALLEL = int(os.environ.get("FLEET_OTA_PARALLEL", "4"))
+FLEET_OTA_PARALLEL_MAX = 16       # concurrent downloads the Pi will serve
+FLEET_OTA_POLL_S = 1.0
+_fleet_lock = threading.Lock()
+_fleet = None  # dict or None; see _handle_fleet_ota_start for schema
+
+# Network benchmark peer — test firmware net_bench.c dials this for its
+# udp_blast / udp_echo / tcp_send / tcp_recv modes (same port, TCP and UDP)
+BENCH_PORT = int(os.environ.get("BENCH_PORT", "5201"))
+BENCH_TCP_MAGIC = b"WBB1"        # then b"S" (board sends) or b"R" (peer sends)
+BENCH_TCP_CHUNK = 16384
+_bench_peer: dict[str, dict] = {}  # "ip/proto" -> latest counters as seen by the Pi
+_bench_peer_lock = threading.Lock()
+
+# SNTP responder — test firmware time_sync.c syncs its log timestamps here
+# (skipped when the port is taken, e.g. by chrony serving NTP already)
+SNTP_PORT = int(os.environ.get("SNTP_PORT", "123"))
+NTP_EPOCH_DELTA = 2208988800     # 1900-01-01 to 1970-01-01, seconds
+
+# BLE benchmark results, latest per (device address, test) for side-by-side comparison
+_ble_bench_results: dict[str, dict] = {}
+_ble_bench_lock = threading.Lock()
 
 
 def _gpio_set(pin, value):
@@ -204,6 +248,62 @@ def log_activity(msg: str, cat: str = "info"):
 # UDP Log Receiver
 # ---------------------------------------------------------------------------
 
+def _udp_log_elf():
+    if UDP_LOG_ELF and log_decoder:
+        try:
+            return log_decoder.ElfStrings(UDP_LOG_ELF)
+        except (OSError, ValueError) as e:
+            print(f"[udplog] cannot load {UDP_LOG_ELF}: {e}", flush=True)
+    return None
+
+
+def _udp_log_stamped(payload: bytes):
+    """Split a timestamped batch payload into (device µs, entry bytes) pairs."""
+    pos = 0
+    while pos + 10 <= len(payload):
+        us = int.from_bytes(payload[pos:pos + 8], "big", signed=True)
+        n = int.from_bytes(payload[pos + 8:pos + 10], "big")
+        yield us, payload[pos + 10:pos + 10 + n]
+        pos += 10 + n
+
+
+def _udp_log_ingest(data: bytes, source_ip: str, elf):
+    """Store the lines of one datagram (or one TCP frame) from a board.
+
+    Lines from timestamped batches also get the board's own time: "dev_ts"
+    (Unix seconds) once the board is synced, "boot_us" before that.
+    """
+    flags = 0
+    if data[:2] == UDP_LOG_BATCH_MAGIC and len(data) >= UDP_LOG_BATCH_HDR_LEN:
+        _udp_track_seq(source_ip, int.from_bytes(data[4:8], "big"))
+        flags = data[3]
+        data = data[UDP_LOG_BATCH_HDR_LEN:]
+    binary = bool(flags & UDP_LOG_FLAG_BINARY)
+    if binary and not log_decoder:
+        return
+    if flags & UDP_LOG_FLAG_TIMESTAMPS:
+        entries = list(_udp_log_stamped(data))
+    else:
+        entries = [(None, data)]
+
+    ts = time.time()
+    for us, payload in entries:
+        if binary:
+            text = (log_decoder.decode_record(payload, elf) if us is not None
+                    else "\n".join(log_decoder.decode_binary_batch(payload, elf)))
+        else:
+            text = payload.decode("utf-8", errors="replace")
+        extra = {}
+        if us is not None:
+            extra = ({"dev_ts": us / 1e6} if flags & UDP_LOG_FLAG_UNIX_TIME
+                     else {"boot_us": us})
+        for line in text.rstrip("\r\n").split("\n"):
+            line = line.rstrip("\r")
+            if line:
+                _udp_log.append({"ts": ts, "source": source_ip, "line": line, **extra})
+                log_activity(f"[{source_ip}] {line}", "info")
+
+
 def _udp_log_thread():
     """Background thread: listen for UDP log packets on port 5555."""
     sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
@@ -211,6 +311,7 @@ def _udp_log_thread():
     sock.bind(("0.0.0.0", UDP_LOG_PORT))
     sock.settimeout(1.0)
     print(f"[udplog] listening on UDP :{UDP_LOG_PORT}", flush=True)
+    elf = _udp_log_elf()
     while not _udp_shutdown.is_set():
         try:
             data, addr = sock.recvfrom(4096)
@@ -218,27 +319,425 @@ def _udp_log_thread():
             continue
         except OSError:
             break
-        source_ip = addr[0]
-        try:
-            text = data.decode("utf-8", errors="replace").rstrip("\r\n")
-        except Exception:
-            continue
-        ts = time.time()
-        for line in text.split("\n"):
-            line = line.rstrip("\r")
-            if line:
-                _udp_log.append({"ts": ts, "source": source_ip, "line": line})
-                log_activity(f"[{source_ip}] {line}", "info")
+        _udp_log_ingest(data, addr[0], elf)
     sock.close()
     print("[udplog] stopped", flush=True)
 
 
+def _tcp_log_conn(conn: socket.socket, source_ip: str, elf):
+    """One board's TCP log stream: [u16 big-endian length][datagram] frames."""
+    conn.settimeout(1.0)
+    buf = b""
+    with conn:
+        while not _udp_shutdown.is_set():
+            try:
+                chunk = conn.recv(4096)
+            except socket.timeout:
+                continue
+            except OSError:
+                break
+            if not chunk:
+                break
+            buf += chunk
+            while len(buf) >= 2:
+                n = int.from_bytes(buf[:2], "big")
+                if len(buf) < 2 + n:
+                    break
+                _udp_log_ingest(buf[2:2 + n], source_ip, elf)
+                buf = buf[2 + n:]
+    print(f"[udplog] TCP stream from {source_ip} closed", flush=True)
+
+
+def _tcp_log_thread():
+    """Background thread: accept TCP log streams on port 5555."""
+    srv = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+    srv.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    srv.bind(("0.0.0.0", UDP_LOG_PORT))
+    srv.listen()
+    srv.settimeout(1.0)
+    print(f"[udplog] listening on TCP :{UDP_LOG_PORT}", flush=True)
+    elf = _udp_log_elf()
+    while not _udp_shutdown.is_set():
+        try:
+            conn, addr = srv.accept()
+        except socket.timeout:
+            continue
+        except OSError:
+            break
+        threading.Thread(target=_tcp_log_conn, args=(conn, addr[0], elf),
+                         daemon=True, name=f"tcp-log-{addr[0]}").start()
+    srv.close()
+
+
+def _udp_track_seq(source_ip: str, seq: int):
+    """Count datagrams lost between consecutive batch sequence numbers."""
+    st = _udp_stats.setdefault(source_ip, {"datagrams": 0, "lost": 0, "seq": None})
+    prev = st["seq"]
+    if prev is not None:
+        gap = (seq - prev - 1) & 0xFFFFFFFF
+        if gap < 0x10000:
+            st["lost"] += gap
+        # else: sequence restarted (device rebooted) — not a loss
+    st["seq"] = seq
+    st["datagrams"] += 1
+
+
 def start_udp_log():
-    """Start the UDP log receiver thread."""
+    """Start the UDP and TCP log receiver threads."""
     global _udp_thread
     _udp_shutdown.clear()
     _udp_thread = threading.Thread(target=_udp_log_thread, daemon=True, name="udp-log")
     _udp_thread.start()
+    threading.Thread(target=_tcp_log_thread, daemon=True, name="tcp-log").start()
+
+
+def _ntp_stamp(t: float) -> bytes:
+    """64-bit NTP timestamp: seconds since 1900 and a 32-bit fraction."""
+    sec = int(t)
+    return struct.pack("!II", (sec + NTP_EPOCH_DELTA) & 0xFFFFFFFF,
+                       int((t - sec) * (1 << 32)) & 0xFFFFFFFF)
+
+
+def _sntp_thread(sock: socket.socket):
+    """Background thread: answer SNTP client requests from this host's clock."""
+    while not _udp_shutdown.is_set():
+        try:
+            data, addr = sock.recvfrom(512)
+        except socket.timeout:
+            continue
+        except OSError:
+            break
+        received = time.time()
+        if len(data) < 48 or data[0] & 0x07 != 3:     # mode 3 = client
+            continue
+        version = (data[0] >> 3) & 0x07
+        reply = (bytes([(version << 3) | 4, 2, data[2], 0xEC])   # server, stratum 2, 2^-20 s
+                 + bytes(8) + b"LOCL" + _ntp_stamp(received)
+                 + data[40:48]                                    # originate = client transmit
+                 + _ntp_stamp(received) + _ntp_stamp(time.time()))
+        try:
+            sock.sendto(reply, addr)
+        except OSError:
+            pass
+    sock.close()
+
+
+def start_time_server():
+    """Start the SNTP responder on SNTP_PORT, unless something else serves it."""
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    try:
+        sock.bind(("0.0.0.0", SNTP_PORT))
+    except OSError as e:
+        sock.close()
+        print(f"[sntp] UDP :{SNTP_PORT} unavailable ({e}), boards sync elsewhere", flush=True)
+        return
+    sock.settimeout(1.0)
+    print(f"[sntp] listening on UDP :{SNTP_PORT}", flush=True)
+    threading.Thread(target=_sntp_thread, args=(sock,), daemon=True, name="sntp").start()
+
+
+def _bench_record(source_ip: str, proto: str, nbytes: int, **extra):
+    """Add to the peer's counters for one board and transport."""
+    now = time.time()
+    with _bench_peer_lock:
+        st = _bench_peer.get(f"{source_ip}/{proto}")
+        if st is None or extra.get("restart"):
+            st = {"source": source_ip, "proto": proto, "bytes": 0,
+                  "datagrams": 0, "lost": 0, "seq": None, "first": now}
+            _bench_peer[f"{source_ip}/{proto}"] = st
+        st["bytes"] += nbytes
+        st["last"] = now
+        seq = extra.get("seq")
+        if seq is not None:
+            prev = st["seq"]
+            if prev is not None and seq > prev:
+                st["lost"] += seq - prev - 1
+            st["seq"] = seq
+            st["datagrams"] += 1
+
+
+def _bench_udp_thread():
+    """Background thread: count 'B' datagrams, send 'E' datagrams back."""
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, 1 << 20)
+    sock.bind(("0.0.0.0", BENCH_PORT))
+    sock.settimeout(1.0)
+    print(f"[bench] listening on UDP :{BENCH_PORT}", flush=True)
+    while not _udp_shutdown.is_set():
+        try:
+            data, addr = sock.recvfrom(2048)
+        except socket.timeout:
+            continue
+        except OSError:
+            break
+        if len(data) < 5 or data[:1] not in (b"B", b"E"):
+            continue
+        seq = int.from_bytes(data[1:5], "big")
+        if data[:1] == b"E":
+            try:
+                sock.sendto(data, addr)
+            except OSError:
+                pass
+        proto = "udp_blast" if data[:1] == b"B" else "udp_echo"
+        _bench_record(addr[0], proto, len(data), seq=seq, restart=(seq == 0))
+    sock.close()
+
+
+def _bench_tcp_conn(conn: socket.socket, source_ip: str):
+    """One tcp_send / tcp_recv run: sink or source bytes until the board closes."""
+    conn.settimeout(5.0)
+    with conn:
+        try:
+            hello = b""
+            while len(hello) < 5:
+                chunk = conn.recv(5 - len(hello))
+                if not chunk:
+                    return
+                hello += chunk
+            if hello[:4] != BENCH_TCP_MAGIC or hello[4:5] not in (b"S", b"R"):
+                return
+            board_sends = hello[4:5] == b"S"
+            proto = "tcp_send" if board_sends else "tcp_recv"
+            _bench_record(source_ip, proto, 0, restart=True)
+            payload = bytes(BENCH_TCP_CHUNK)
+            while not _udp_shutdown.is_set():
+                if board_sends:
+                    chunk = conn.recv(BENCH_TCP_CHUNK)
+                    if not chunk:
+                        break
+                    _bench_record(source_ip, proto, len(chunk))
+                else:
+                    conn.sendall(payload)
+                    _bench_record(source_ip, proto, len(payload))
+        except OSError:
+            pass    # the board ends tcp_recv by closing; a reset is normal
+
+
+def _bench_tcp_thread():
+    """Background thread: accept benchmark TCP connections."""
+    srv = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+    srv.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    srv.bind(("0.0.0.0", BENCH_PORT))
+    srv.listen()
+    srv.settimeout(1.0)
+    print(f"[bench] listening on TCP :{BENCH_PORT}", flush=True)
+    while not _udp_shutdown.is_set():
+        try:
+            conn, addr = srv.accept()
+        except socket.timeout:
+            continue
+        except OSError:
+            break
+        threading.Thread(target=_bench_tcp_conn, args=(conn, addr[0]),
+                         daemon=True, name=f"bench-{addr[0]}").start()
+    srv.close()
+
+
+def start_bench_peer():
+    """Start the network benchmark peer (UDP and TCP on BENCH_PORT)."""
+    threading.Thread(target=_bench_udp_thread, daemon=True, name="bench-udp").start()
+    threading.Thread(target=_bench_tcp_thread, daemon=True, name="bench-tcp").start()
+
+
+# ---------------------------------------------------------------------------
+# Firmware Cache + Fleet OTA
+# ---------------------------------------------------------------------------
+
+def _firmware_map(fpath: str):
+    """Return a read-only mmap of a firmware file, reused until the file changes."""
+    st = os.stat(fpath)
+    with _fw_cache_lock:
+        entry = _fw_cache.get(fpath)
+        if entry and entry[0] == st.st_mtime_ns and entry[1] == st.st_size:
+            return entry[2]
+        if st.st_size == 0:
+            return b""
+        # A replaced file gets a new inode (uploads use os.replace), so a
+        # stale map stays valid for downloads still streaming from it.
+        with open(fpath, "rb") as f:
+            m = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+        _fw_cache[fpath] = (st.st_mtime_ns, st.st_size, m)
+        return m
+
+
+def _firmware_forget(fpath: str):
+    with _fw_cache_lock:
+        _fw_cache.pop(fpath, None)
+
+
+def _dut_status(ip: str, timeout: float = 3) -> dict | None:
+    """GET /status from a board running the test firmware, None if unreachable."""
+    try:
+        with urllib.request.urlopen(f"http://{ip}:{DUT_HTTP_PORT}/status", timeout=timeout) as r:
+            return json.loads(r.read())
+    except (OSError, ValueError):
+        return None
+
+
+def _dut_events(ip: str, deadline: float):
+    """Yield JSON events from the board's /ws stream until the deadline.
+
+    Returns without yielding if the firmware has no /ws endpoint, and stops
+    when the board closes the connection (e.g. it reboots).
+    """
+    buf = bytearray()
+
+    def recv(n):
+        while len(buf) < n:
+            chunk = sock.recv(4096)
+            if not chunk:
+                raise EOFError
+            buf.extend(chunk)
+        out = bytes(buf[:n])
+        del buf[:n]
+        return out
+
+    key = base64.b64encode(os.urandom(16)).decode()
+    try:
+        sock = socket.create_connection((ip, DUT_HTTP_PORT), timeout=3)
+    except OSError:
+        return
+    with sock:
+        try:
+            sock.sendall((f"GET /ws HTTP/1.1\r\nHost: {ip}:{DUT_HTTP_PORT}\r\n"
+                          "Upgrade: websocket\r\nConnection: Upgrade\r\n"
+                          f"Sec-WebSocket-Key: {key}\r\nSec-WebSocket-Version: 13\r\n\r\n").encode())
+            while b"\r\n\r\n" not in buf:
+                chunk = sock.recv(4096)
+                if not chunk:
+                    return
+                buf.extend(chunk)
+            head, _, rest = bytes(buf).partition(b"\r\n\r\n")
+            if b" 101 " not in head.split(b"\r\n", 1)[0]:
+                return
+            buf[:] = rest
+            while time.time() < deadline:
+                sock.settimeout(max(0.1, min(5.0, deadline - time.time())))
+                if not buf:
+                    try:
+                        chunk = sock.recv(4096)
+                    except TimeoutError:
+                        continue    # idle stream
+                    if not chunk:
+                        return
+                    buf.extend(chunk)
+                hdr = recv(2)
+                n = hdr[1] & 0x7F
+                if n >= 126:
+                    n = int.from_bytes(recv(2 if n == 126 else 8), "big")
+                payload = recv(n)
+                opcode = hdr[0] & 0x0F
+                if opcode == 0x8:
+                    return
+                if opcode == 0x1:
+                    try:
+                        yield json.loads(payload)
+                    except ValueError:
+                        pass
+        except (OSError, EOFError):
+            return
+
+
+def _dut_start_ota(ip: str, url: str) -> int:
+    req = urllib.request.Request(
+        f"http://{ip}:{DUT_HTTP_PORT}/ota",
+        data=json.dumps({"url": url}).encode(),
+        headers={"Content-Type": "application/json"},
+        method="POST",
+    )
+    try:
+        with urllib.request.urlopen(req, timeout=5) as r:
+            return r.status
+    except urllib.error.HTTPError as e:
+        return e.code
+    except OSError:
+        return 0
+
+
+def _dut_poll_ota(ip: str, deadline: float):
+    """Yield the board's /status "ota" object until it stops answering."""
+    while time.time() < deadline:
+        time.sleep(FLEET_OTA_POLL_S)
+        st = _dut_status(ip, timeout=2)
+        if st is None:
+            return          # rebooting into the new image
+        yield st.get("ota", {})
+
+
+def _fleet_board(fleet: dict, ip: str, downloads: threading.Semaphore):
+    """Update one board. Only the download phase holds a parallelism slot."""
+    b = fleet["boards"][ip]
+
+    def fail(error):
+        b.update(state="failed", error=error, elapsed=round(time.time() - b["started"], 1))
+        log_activity(f"fleet OTA {ip}: {error}", "error")
+
+    with downloads:
+        # The timeout covers this board's own update, not its wait for a slot
+        b["started"] = time.time()
+        deadline = b["started"] + fleet["timeout"]
+        b["state"] = "triggering"
+        before = _dut_status(ip)
+        if before is None:
+            fail("unreachable")
+            return
+        b["version_before"] = before.get("version")
+        # Subscribe before triggering so no progress event is missed
+        events = _dut_events(ip, deadline)
+        pushed = next(events, None) is not None
+        code = _dut_start_ota(ip, fleet["url"])
+        if code != 200:
+            events.close()
+            fail(f"POST /ota returned {code or 'no response'}")
+            return
+
+        b["state"] = "downloading"
+        if pushed:
+            updates = (ev for ev in events if ev.get("ev") == "ota")
+        else:
+            updates = _dut_poll_ota(ip, deadline)
+        for ota in updates:
+            if ota.get("state") == "idle":
+                break           # already back up after a fast reboot
+            b.update(written=ota.get("written", 0), total=ota.get("total", 0),
+                     resumes=ota.get("resumes", 0))
+            if ota.get("state") == "failed":
+                fail(ota.get("error", "OTA failed"))
+                return
+            if ota.get("state") == "verifying":
+                break
+        events.close()
+        b["download_s"] = round(time.time() - b["started"], 1)
+
+    b["state"] = "rebooting"
+    while time.time() < deadline:
+        st = _dut_status(ip, timeout=2)
+        if st and st.get("ota", {}).get("state") == "idle":
+            b.update(state="done", version=st.get("version"),
+                     elapsed=round(time.time() - b["started"], 1))
+            log_activity(f"fleet OTA {ip}: done in {b['elapsed']}s ({b['version']})", "ok")
+            return
+        time.sleep(FLEET_OTA_POLL_S)
+    fail("timeout")
+
+
+def _fleet_run(fleet: dict):
+    downloads = threading.Semaphore(fleet["parallel"])
+    threads = [
+        threading.Thread(target=_fleet_board, args=(fleet, ip, downloads),
+                         daemon=True, name=f"fleet-{ip}")
+        for ip in fleet["boards"]
+    ]
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+    fleet["elapsed"] = round(time.time() - fleet["started"], 1)
+    fleet["running"] = False
+    ok = sum(1 for b in fleet["boards"].values() if b["state"] == "done")
+    log_activity(f"fleet OTA finished: {ok}/{len(threads)} boards in {fleet['elapsed']}s",
+                 "ok" if ok == len(threads) else "error")
 
 
 # ---------------------------------------------------------------------------
@@ -961,6 +1460,29 @@ def _do_enter_portal(portal_ssid: str, wifi_ssid: str, wifi_password: str,
         log_activity(f"Failed to start AP '{wifi_ssid}': {e}", "error")
 
 
+def _parse_byte_range(header: str | None, size: int):
+    """Parse a single-range ``Range: bytes=a-b`` header.
+
+    Returns ``(start, end)`` inclusive, ``None`` to send the whole file, or
+    ``"invalid"`` when the range can't be satisfied (HTTP 416).
+    """
+    if not header or not header.startswith("bytes=") or "," in header:
+        return None
+    first, _, last = header[6:].strip().partition("-")
+    try:
+        if first:
+            start = int(first)
+            end = int(last) if last else size - 1
+        else:
+            start = max(0, size - int(last))   # suffix range: last N bytes
+            end = size - 1
+    except ValueError:
+        return None
+    if start >= size or end < start:
+        return "invalid"
+    return start, min(end, size - 1)
+
+
 # ---------------------------------------------------------------------------
 # HTTP Handler
 # ---------------------------------------------------------------------------
@@ -1034,6 +1556,13 @@ class Handler(http.server.BaseHTTPRequestHandler):
             self._handle_firmware_list()
         elif path == "/api/ble/status":
             self._handle_ble_status()
+        elif path == "/api/ble/bench":
+            self._handle_ble_bench_results()
+        elif path == "/api/bench/peer":
+            qs = parse_qs(parsed.query)
+            self._handle_bench_peer(qs)
+        elif path == "/api/ota/fleet":
+            self._handle_fleet_ota_status()
         elif path.startswith("/firmware/"):
             self._handle_firmware_download(path)
         elif path in ("/", "/index.html"):
@@ -1086,6 +1615,8 @@ class Handler(http.server.BaseHTTPRequestHandler):
             self._handle_gpio_set()
         elif path == "/api/firmware/upload":
             self._handle_firmware_upload()
+        elif path == "/api/ota/fleet":
+            self._handle_fleet_ota_start()
         elif path == "/api/ble/scan":
             self._handle_ble_scan()
         elif path == "/api/ble/connect":
@@ -1094,6 +1625,8 @@ class Handler(http.server.BaseHTTPRequestHandler):
             self._handle_ble_disconnect()
         elif path == "/api/ble/write":
             self._handle_ble_write()
+        elif path == "/api/ble/bench":
+            self._handle_ble_bench()
         else:
             self._send_json({"error": "not found"}, 404)
 
@@ -1101,6 +1634,7 @@ class Handler(http.server.BaseHTTPRequestHandler):
         path = urlparse(self.path).path
         if path == "/api/udplog":
             _udp_log.clear()
+            _udp_stats.clear()
             self._send_json({"ok": True})
         elif path == "/api/firmware/delete":
             self._handle_firmware_delete()
@@ -1765,7 +2299,10 @@ class Handler(http.server.BaseHTTPRequestHandler):
             lines.append(entry)
             if len(lines) >= limit:
                 break
-        self._send_json({"ok": True, "lines": lines})
+        stats = {ip: {"datagrams": st["datagrams"], "lost": st["lost"]}
+                 for ip, st in _udp_stats.items()
+                 if not source or ip == source}
+        self._send_json({"ok": True, "lines": lines, "stats": stats})
 
     # -- firmware handlers --
 
@@ -1806,19 +2343,30 @@ class Handler(http.server.BaseHTTPRequestHandler):
             self._send_json({"error": "not found"}, 404)
             return
         try:
-            fsize = os.path.getsize(fpath)
-            self.send_response(200)
+            data = memoryview(_firmware_map(fpath))
+            fsize = len(data)
+            start, end = 0, fsize - 1
+            rng = _parse_byte_range(self.headers.get("Range"), fsize)
+            if rng == "invalid":
+                self.send_response(416)
+                self.send_header("Content-Range", f"bytes */{fsize}")
+                self.send_header("Content-Length", 0)
+                self.end_headers()
+                return
+            if rng:
+                start, end = rng
+                self.send_response(206)
+                self.send_header("Content-Range", f"bytes {start}-{end}/{fsize}")
+            else:
+                self.send_response(200)
             self.send_header("Content-Type", "application/octet-stream")
-            self.send_header("Content-Length", fsize)
+            self.send_header("Content-Length", end - start + 1)
+            self.send_header("Accept-Ranges", "bytes")
             self.send_header("Content-Disposition", f'attachment; filename="{filename}"')
             self.end_headers()
-            with open(fpath, "rb") as f:
-                while True:
-                    chunk = f.read(8192)
-                    if not chunk:
-                        break
-                    self.wfile.write(chunk)
-        except BrokenPipeError:
+            for off in range(start, end + 1, 65536):
+                self.wfile.write(data[off:min(off + 65536, end + 1)])
+        except (BrokenPipeError, ConnectionResetError):
             pass
 
     def _handle_firmware_upload(self):
@@ -1876,8 +2424,12 @@ class Handler(http.server.BaseHTTPRequestHandler):
         proj_dir = os.path.join(FIRMWARE_DIR, project)
         os.makedirs(proj_dir, exist_ok=True)
         fpath = os.path.join(proj_dir, file_name)
-        with open(fpath, "wb") as f:
+        # Write-then-rename: downloads in flight keep streaming the old file
+        tmp = fpath + ".part"
+        with open(tmp, "wb") as f:
             f.write(file_data)
+        os.replace(tmp, fpath)
+        _firmware_forget(fpath)
         log_activity(f"firmware.upload({project}/{file_name}, {len(file_data)} bytes)", "ok")
         self._send_json({"ok": True, "project": project, "filename": file_name, "size": len(file_data)})
 
@@ -1899,9 +2451,81 @@ class Handler(http.server.BaseHTTPRequestHandler):
             self._send_json({"ok": False, "error": "not found"}, 404)
             return
         os.remove(fpath)
+        _firmware_forget(fpath)
         log_activity(f"firmware.delete({project}/{filename})", "ok")
         self._send_json({"ok": True})
 
+    def _handle_fleet_ota_start(self):
+        global _fleet
+        body = self._read_json()
+        if not body:
+            self._send_json({"ok": False, "error": "empty body"}, 400)
+            return
+        devices = body.get("devices") or []
+        if not isinstance(devices, list) or not devices:
+            self._send_json({"ok": False, "error": "missing devices"}, 400)
+            return
+        url = body.get("url")
+        if not url:
+            project = body.get("project", "")
+            filename = body.get("filename", "")
+            if not project or not filename:
+                self._send_json({"ok": False, "error": "missing url or project/filename"}, 400)
+                return
+            if ".." in project or "/" in project or ".." in filename or "/" in filename:
+                self._send_json({"ok": False, "error": "path traversal not allowed"}, 400)
+                return
+            fpath = os.path.join(FIRMWARE_DIR, project, filename)
+            if not os.path.isfile(fpath):
+                self._send_json({"ok": False, "error": "not found"}, 404)
+                return
+            _firmware_map(fpath)   # warm the cache before the first board asks
+            _refresh_host_ip()
+            url = f"http://{host_ip}:8080/firmware/{project}/{filename}"
+        parallel = body.get("parallel", FLEET_OTA_PARALLEL)
+        if isinstance(parallel, bool) or not isinstance(parallel, int) or parallel < 1:
+            self._send_json({"ok": False, "error": "parallel must be a positive integer"}, 400)
+            return
+        parallel = min(parallel, len(devices), FLEET_OTA_PARALLEL_MAX)
+        timeout = body.get("timeout", 300)
+        if isinstance(timeout, bool) or not isinstance(timeout, (int, float)) or timeout <= 0:
+            self._send_json({"ok": False, "error": "timeout must be a positive number"}, 400)
+            return
+
+        with _fleet_lock:
+            if _fleet and _fleet["running"]:
+                self._send_json({"ok": False, "error": "fleet OTA already running"}, 409)
+                return
+            _fleet = {
+                "running": True,
+                "url": url,
+                "parallel": parallel,
+                "timeout": float(timeout),
+                "started": time.time(),
+                "elapsed": None,
+                "boards": {str(ip): {"state": "queued", "started": None, "written": 0,
+                                     "total": 0, "resumes": 0, "download_s": None,
+                                     "elapsed": None, "error": None}
+                           for ip in devices},
+            }
+            fleet = _fleet
+        log_activity(f"fleet OTA: {len(fleet['boards'])} boards, {parallel} at a time, {url}", "step")
+        threading.Thread(target=_fleet_run, args=(fleet,), daemon=True, name="fleet-ota").start()
+        self._send_json({"ok": True, "url": url, "boards": len(fleet["boards"]), "parallel": parallel})
+
+    def _handle_fleet_ota_status(self):
+        with _fleet_lock:
+            fleet = _fleet
+        if fleet is None:
+            self._send_json({"ok": True, "running": False, "boards": {}})
+            return
+        elapsed = fleet["elapsed"]
+        if elapsed is None:
+            elapsed = round(time.time() - fleet["started"], 1)
+        self._send_json({"ok": True, "running": fleet["running"], "url": fleet["url"],
+                         "parallel": fleet["parallel"], "elapsed": elapsed,
+                         "boards": fleet["boards"]})
+
     # -- BLE handlers --
 
     def _handle_ble_scan(self):
@@ -1973,6 +2597,59 @@ class Handler(http.server.BaseHTTPRequestHandler):
         result = ble_controller.write(characteristic, data, response=response)
         self._send_json(result, 200 if result.get("ok") else 500)
 
+    def _handle_ble_bench(self):
+        if not ble_controller or not ble_controller.available():
+            self._send_json({"ok": False, "error": "BLE not available (bleak not installed)"}, 501)
+            return
+        body = self._read_json() or {}
+        test = body.get("test", "tx")
+        try:
+            duration_ms = int(body.get("duration_ms", 5000))
+            count = int(body.get("count", 100))
+            length = int(body.get("length", 8))
+        except (TypeError, ValueError):
+            self._send_json({"ok": False, "error": "duration_ms, count and length must be integers"}, 400)
+            return
+        address = ble_controller.status().get("address")
+        log_activity(f"ble.bench({test}) on {address}", "step")
+        result = ble_controller.bench(test, duration_ms=duration_ms, count=count, length=length)
+        if not result.get("ok"):
+            log_activity(f"ble.bench({test}) — {result.get('error')}", "error")
+            self._send_json(result, 409 if result.get("error") == "not connected" else 500)
+            return
+        summary = result["reports"][-1] if result["reports"] else {}
+        if "bps" in summary:
+            log_activity(f"ble.bench({test}) — {summary['bps']} B/s", "ok")
+        elif "p50_us" in summary:
+            log_activity(f"ble.bench({test}) — p50 {summary['p50_us']} us, "
+                         f"p99 {summary['p99_us']} us", "ok")
+        result["address"] = address
+        result["timestamp"] = time.time()
+        with _ble_bench_lock:
+            _ble_bench_results.setdefault(address, {})[test] = result
+        self._send_json(result)
+
+    def _handle_ble_bench_results(self):
+        with _ble_bench_lock:
+            results = {addr: dict(tests) for addr, tests in _ble_bench_results.items()}
+        self._send_json({"ok": True, "devices": results})
+
+    def _handle_bench_peer(self, qs):
+        source = qs.get("source", [""])[0]
+        runs = []
+        with _bench_peer_lock:
+            for st in _bench_peer.values():
+                if source and st["source"] != source:
+                    continue
+                secs = st.get("last", st["first"]) - st["first"]
+                runs.append({
+                    "source": st["source"], "proto": st["proto"],
+                    "bytes": st["bytes"], "datagrams": st["datagrams"],
+                    "lost": st["lost"], "seconds": round(secs, 3),
+                    "mbps": round(st["bytes"] * 8 / secs / 1e6, 3) if secs > 0 else None,
+                })
+        self._send_json({"ok": True, "port": BENCH_PORT, "runs": runs})
+
     def _serve_ui(self):
         html = _UI_HTML
         body = html.encode()
@@ -2525,6 +3202,12 @@ def main():
     # Start UDP log receiver
     start_udp_log()
 
+    # Start network benchmark peer
+    start_bench_peer()
+
+    # Start SNTP responder for board log timestamps
+    start_time_server()
+
     # Ensure firmware directory exists
     os.makedirs(FIRMWARE_DIR, exist_ok=True)
 
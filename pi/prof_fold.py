@@ -0,0 +1,184 @@
+#!/usr/bin/env python3
+"""
+Profile Folder
+
+Turns the PC samples streamed by the test firmware's profiling build
+(CONFIG_WB_PROFILER, see test-firmware/main/profiler.h) into folded stacks
+for flame graph tools, resolving addresses against the firmware ELF.
+
+Sample lines, anywhere in the input (raw logs, /api/udplog JSON, ...):
+    WBPROF H <hz> <cores>
+    WBPROF T <task handle> <name>
+    WBPROF S <core> <pc><caller><task>...     8 hex digits each, per sample
+
+Output is one "task;caller;function count" line per distinct stack, ready
+for flamegraph.pl, inferno-flamegraph or speedscope.
+
+Usage:
+    curl -s 'http://192.168.0.87:8080/api/udplog?source=192.168.0.121&limit=2000' \\
+        | prof_fold.py --elf build-prof/wb-test-firmware.elf > prof.folded
+    prof_fold.py --elf build-prof/wb-test-firmware.elf --udp 5556 --seconds 30 --top 20
+    flamegraph.pl prof.folded > prof.svg
+"""
+
+import argparse
+import bisect
+import collections
+import re
+import socket
+import struct
+import sys
+import time
+
+SHT_SYMTAB = 2
+STT_FUNC = 2
+
+_LINE_RE = re.compile(r"WBPROF ([HTS]) ([0-9A-Za-z_ .:\-]*)")
+
+
+class ElfSymbols:
+    """Resolve code addresses to function names from an ELF32 symbol table."""
+
+    def __init__(self, path):
+        with open(path, "rb") as f:
+            data = f.read()
+        if data[:4] != b"\x7fELF" or data[4] != 1:
+            raise ValueError(f"{path}: not an ELF32 file")
+        shoff, = struct.unpack_from("<I", data, 0x20)
+        shentsize, shnum = struct.unpack_from("<HH", data, 0x2E)
+        sections = [struct.unpack_from("<10I", data, shoff + i * shentsize) for i in range(shnum)]
+
+        syms = {}
+        for sh in sections:
+            if sh[1] != SHT_SYMTAB:
+                continue
+            offset, size, link, entsize = sh[4], sh[5], sh[6], sh[9] or 16
+            str_off = sections[link][4]
+            for pos in range(offset, offset + size, entsize):
+                name_off, value, sym_size, info = struct.unpack_from("<IIIB", data, pos)
+                if info & 0x0F != STT_FUNC or not value:
+                    continue
+                end = data.find(b"\0", str_off + name_off)
+                name = data[str_off + name_off:end].decode("utf-8", errors="replace")
+                value &= ~1          # RISC-V compressed / Thumb-style low bit
+                if value not in syms or (sym_size and not syms[value][1]):
+                    syms[value] = (name, sym_size)
+        self.addrs = sorted(syms)
+        self.syms = [syms[a] for a in self.addrs]
+
+    def name(self, addr):
+        i = bisect.bisect_right(self.addrs, addr) - 1
+        if i >= 0:
+            name, size = self.syms[i]
+            if not size or addr < self.addrs[i] + size:
+                return name
+        return f"0x{addr:08x}"
+
+
+class Profile:
+    def __init__(self, elf):
+        self.elf = elf
+        self.hz = None
+        self.tasks = {}                       # handle -> name
+        self.samples = collections.Counter()  # (core, task, caller, pc) -> count
+
+    def feed(self, text):
+        for kind, rest in _LINE_RE.findall(text):
+            fields = rest.split()
+            if kind == "H" and fields:
+                self.hz = int(fields[0])
+            elif kind == "T" and len(fields) >= 2:
+                self.tasks[int(fields[0], 16)] = rest.split(None, 1)[1].strip()   # "Tmr Svc"
+            elif kind == "S" and len(fields) == 2:
+                core, hexs = int(fields[0]), fields[1]
+                for pos in range(0, len(hexs) - 23, 24):
+                    pc, caller, task = (int(hexs[pos + k:pos + k + 8], 16) for k in (0, 8, 16))
+                    self.samples[(core, task, caller, pc)] += 1
+
+    def folded(self, per_core=False):
+        names = {}
+        out = collections.Counter()
+        for (core, task, caller, pc), n in self.samples.items():
+            if pc not in names:
+                names[pc] = self.elf.name(pc)
+            if caller not in names:
+                names[caller] = self.elf.name(caller - 1) if caller else "?"
+            frames = [self.tasks.get(task, f"task@{task:08x}"), names[caller], names[pc]]
+            if per_core:
+                frames.insert(0, f"core{core}")
+            out[";".join(frames)] += n
+        return out
+
+    def top(self, count):
+        flat = collections.Counter()
+        for (_core, _task, _caller, pc), n in self.samples.items():
+            flat[self.elf.name(pc)] += n
+        return flat.most_common(count)
+
+
+def _listen(port, seconds, profile):
+    """Collect from log datagrams sent straight to us (POST /log-target)."""
+    import log_decoder
+
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    sock.bind(("0.0.0.0", port))
+    sock.settimeout(0.5)
+    print(f"Collecting on UDP :{port} for {seconds} s", file=sys.stderr)
+    deadline = time.monotonic() + seconds
+    while time.monotonic() < deadline:
+        try:
+            data, _addr = sock.recvfrom(4096)
+        except socket.timeout:
+            continue
+        flags = 0
+        if data[:2] == log_decoder.BATCH_MAGIC and len(data) >= log_decoder.BATCH_HDR_LEN:
+            flags = data[3]
+            data = data[log_decoder.BATCH_HDR_LEN:]
+        binary = bool(flags & log_decoder.BATCH_FLAG_BINARY)
+        if flags & log_decoder.BATCH_FLAG_TIMESTAMPS:
+            lines = [ln for _us, ln in log_decoder.decode_timestamped_batch(data, binary)]
+        elif binary:
+            lines = log_decoder.decode_binary_batch(data)
+        else:
+            lines = [data.decode("utf-8", errors="replace")]
+        profile.feed("\n".join(lines))
+    sock.close()
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Fold firmware PC samples into flame graph stacks")
+    parser.add_argument("--elf", required=True, help="ELF of the profiling build")
+    parser.add_argument("inputs", nargs="*", help="Log files with WBPROF lines (default: stdin)")
+    parser.add_argument("--udp", type=int, metavar="PORT", help="Collect from UDP log datagrams instead")
+    parser.add_argument("--seconds", type=float, default=30, help="Collection time with --udp (default: 30)")
+    parser.add_argument("--per-core", action="store_true", help="Root each stack at its core")
+    parser.add_argument("--top", type=int, metavar="N", help="Also print the N hottest functions to stderr")
+    args = parser.parse_args()
+
+    profile = Profile(ElfSymbols(args.elf))
+    if args.udp:
+        _listen(args.udp, args.seconds, profile)
+    elif args.inputs:
+        for path in args.inputs:
+            with open(path, encoding="utf-8", errors="replace") as f:
+                profile.feed(f.read())
+    else:
+        profile.feed(sys.stdin.read())
+
+    total = sum(profile.samples.values())
+    if not total:
+        print("No WBPROF samples in the input", file=sys.stderr)
+        sys.exit(1)
+    for stack, n in sorted(profile.folded(args.per_core).items()):
+        print(f"{stack} {n}")
+
+    hz = f" at {profile.hz} Hz" if profile.hz else ""
+    print(f"{total} samples{hz}, {len(profile.tasks)} tasks named", file=sys.stderr)
+    if args.top:
+        for name, n in profile.top(args.top):
+            print(f"{100.0 * n / total:6.2f}%  {n:7d}  {name}", file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()
@@ -13,7 +13,9 @@ Usage:
 """
 
 import argparse
+import collections
 import os
+import queue
 import sys
 import time
 import socket
@@ -45,6 +47,21 @@ SET_MODEMSTATE_MASK = 11
 SET_DTR = 8
 SET_RTS = 11
 
+# Framed log records from test firmware built with CONFIG_WB_UART_LOG_FRAMED:
+#   0x1F 'L', level (u8), timestamp ms (u32 BE), length (u16 BE), payload
+LOG_FRAME_MARKER = b"\x1fL"
+LOG_FRAME_HDR_LEN = 9
+LOG_FRAME_LEVELS = {1: "E", 2: "W", 3: "I", 4: "D", 5: "V"}
+LOG_FRAME_PAYLOAD_MAX = 256     # MAX_LOG_LINE in udp_log.c; a longer length isn't a frame
+LOG_FRAME_PENDING_MAX = LOG_FRAME_HDR_LEN + LOG_FRAME_PAYLOAD_MAX
+
+# Data path: the proxy never blocks on the client, the device or the disk
+CLIENT_BUF_MAX = 256 * 1024     # serial -> client; serial reads pause when full
+SERIAL_BUF_MAX = 64 * 1024      # client -> serial; client reads pause when full
+READ_CHUNK = 16384
+SELECT_TIMEOUT_S = 0.5          # only bounds how long stop() takes to be noticed
+LOG_QUEUE_MAX = 4096            # entries waiting for the log writer thread
+
 class SerialLogger:
     """Logs serial data with timestamps"""
 
@@ -69,8 +86,38 @@ class SerialLogger:
 
         self.log_file = None
         self.current_date = None
+        self._pending = b""     # incomplete framed record carried to the next read
         self._rotate_log()
 
+        # Callers only queue entries; one thread formats and writes them
+        self._queue = queue.Queue(maxsize=LOG_QUEUE_MAX)
+        self._dropped = 0
+        self._thread = threading.Thread(target=self._writer, daemon=True, name="serial-log")
+        self._thread.start()
+
+    def _submit(self, fn, *args):
+        try:
+            self._queue.put_nowait((fn, datetime.now(), args))
+        except queue.Full:
+            self._dropped += 1      # disk can't keep up; never stall the data path
+
+    def _writer(self):
+        while True:
+            item = self._queue.get()
+            if item is None:
+                break
+            try:
+                if self._dropped:
+                    dropped, self._dropped = self._dropped, 0
+                    self._write_message(datetime.now(), f"{dropped} log entries dropped (log writer behind)", 'INFO')
+                fn, when, args = item
+                fn(when, *args)
+                if self._queue.empty():
+                    self.log_file.flush()
+            except Exception as e:
+                # One bad entry (or a full disk) must not end logging for good
+                print(f"serial-log {self.device_name}: {e}", file=sys.stderr)
+
     def _rotate_log(self):
         """Create new log file for current date"""
         today = datetime.now().strftime('%Y-%m-%d')
@@ -79,37 +126,98 @@ class SerialLogger:
                 self.log_file.close()
             self.current_date = today
             log_path = self.log_dir / f"{self.device_name}_{today}.log"
-            self.log_file = open(log_path, 'a', buffering=1)  # Line buffered
-            self.log(f"=== Log opened for {self.device_name} ===")
+            self.log_file = open(log_path, 'a')  # flushed when the queue drains
+            self._write_message(datetime.now(), f"=== Log opened for {self.device_name} ===", 'INFO')
 
     def log(self, message, direction='INFO'):
         """Log a message with timestamp"""
-        self._rotate_log()
-        timestamp = datetime.now().strftime('%Y-%m-%d %H:%M:%S.%f')[:-3]
-        self.log_file.write(f"[{timestamp}] [{direction}] {message}\n")
+        self._submit(self._write_message, message, direction)
 
     def log_data(self, data, direction='RX'):
         """Log binary data, converting to readable format"""
+        self._submit(self._write_data, bytes(data), direction)
+
+    def _write_message(self, when, message, direction):
+        self._rotate_log()
+        timestamp = when.strftime('%Y-%m-%d %H:%M:%S.%f')[:-3]
+        self.log_file.write(f"[{timestamp}] [{direction}] {message}\n")
+
+    def _write_data(self, when, data, direction):
         self._rotate_log()
-        timestamp = datetime.now().strftime('%Y-%m-%d %H:%M:%S.%f')[:-3]
+        timestamp = when.strftime('%Y-%m-%d %H:%M:%S.%f')[:-3]
+
+        if direction == 'RX' and (self._pending or LOG_FRAME_MARKER[:1] in data):
+            self._log_frames(self._pending + data, timestamp, direction)
+        else:
+            self.log_file.write(self._format_text(data, timestamp, direction))
 
+    def _format_text(self, data, timestamp, direction):
+        """Plain console output: escape control characters, one entry per line"""
         # Try to decode as text, fall back to hex
         try:
             text = data.decode('utf-8', errors='replace')
             # Remove or escape control characters except newline
             printable = ''.join(c if c.isprintable() or c in '\n\r\t' else f'\\x{ord(c):02x}' for c in text)
-            for line in printable.split('\n'):
-                if line.strip():
-                    self.log_file.write(f"[{timestamp}] [{direction}] {line.rstrip()}\n")
+            return ''.join(f"[{timestamp}] [{direction}] {line.rstrip()}\n"
+                           for line in printable.split('\n') if line.strip())
         except:
             # Fall back to hex dump
-            hex_str = data.hex()
-            self.log_file.write(f"[{timestamp}] [{direction}] HEX: {hex_str}\n")
+            return f"[{timestamp}] [{direction}] HEX: {data.hex()}\n"
+
+    def _log_frames(self, buf, timestamp, direction):
+        """Framed records: sliced by length and written in one batch. Plain
+        text between them (boot ROM, panics) takes the slow path."""
+        out = []
+        pos = search = 0
+        end = len(buf)
+        while pos < end:
+            start = buf.find(LOG_FRAME_MARKER, search)
+            if start < 0:
+                # A lone marker byte at the end may be the start of a frame
+                start = end - 1 if buf[-1:] == LOG_FRAME_MARKER[:1] else end
+                if start > pos:
+                    out.append(self._format_text(buf[pos:start], timestamp, direction))
+                pos = start
+                break
+            if (end - start >= LOG_FRAME_HDR_LEN and
+                    int.from_bytes(buf[start + 7:start + 9], 'big') > LOG_FRAME_PAYLOAD_MAX):
+                search = start + 1      # marker bytes in plain text, not a frame
+                continue
+            if start > pos:
+                out.append(self._format_text(buf[pos:start], timestamp, direction))
+            if end - start < LOG_FRAME_HDR_LEN:
+                pos = start
+                break
+            n = int.from_bytes(buf[start + 7:start + 9], 'big')
+            if end - start < LOG_FRAME_HDR_LEN + n:
+                pos = start
+                break
+            level = LOG_FRAME_LEVELS.get(buf[start + 2])
+            ms = int.from_bytes(buf[start + 3:start + 7], 'big')
+            payload = buf[start + LOG_FRAME_HDR_LEN:start + LOG_FRAME_HDR_LEN + n]
+            line = payload.decode('utf-8', errors='replace').rstrip()
+            if level:
+                out.append(f"[{timestamp}] [{direction}] {level} ({ms}) {line}\n")
+            elif line:
+                out.append(f"[{timestamp}] [{direction}] {line}\n")
+            pos = search = start + LOG_FRAME_HDR_LEN + n
+
+        self._pending = buf[pos:]
+        if len(self._pending) > LOG_FRAME_PENDING_MAX:
+            # Not a frame after all (or a corrupted length): log it as text
+            out.append(self._format_text(self._pending, timestamp, direction))
+            self._pending = b""
+        if out:
+            self.log_file.write(''.join(out))
 
     def close(self):
-        if self.log_file:
+        if self._thread.is_alive():
             self.log("=== Log closed ===")
+            self._queue.put(None)
+            self._thread.join(timeout=5)
+        if self.log_file:
             self.log_file.close()
+            self.log_file = None
 
 
 class RFC2217Proxy:
@@ -123,6 +231,13 @@ class RFC2217Proxy:
         self.server_socket = None
         self.client_socket = None
         self.running = False
+        self._to_client = bytearray()
+        self._to_serial = bytearray()
+        # COM-PORT options wait until the data sent before them has gone out:
+        # (bytes queued for serial when received, subcmd, data)
+        self._serial_opts = collections.deque()
+        self._serial_queued = 0     # bytes ever queued for / written to serial
+        self._serial_written = 0
 
         # Get device info for better log naming
         device_info = self._get_device_info(device)
@@ -164,8 +279,8 @@ class RFC2217Proxy:
         self.serial = serial.Serial(
             self.device,
             baudrate=self.baudrate,
-            timeout=0.1,
-            write_timeout=1
+            timeout=0,          # non-blocking: select() says when to read/write
+            write_timeout=0
         )
         self.logger.log(f"Opened {self.device} at {self.baudrate} baud")
 
@@ -208,7 +323,7 @@ class RFC2217Proxy:
                         if se_idx != -1:
                             subcmd = data[i + 3] if i + 3 < se_idx else 0
                             subdata = data[i + 4:se_idx]
-                            self._handle_com_port_option(subcmd, subdata)
+                            self._serial_opts.append((self._serial_queued + len(output), subcmd, subdata))
                             i = se_idx + 2
                             continue
                     i += 2
@@ -311,112 +426,157 @@ class RFC2217Proxy:
             self.logger.log(f"Error handling COM-PORT option: {e}")
 
     def _send_telnet(self, cmd, opt):
-        """Send telnet command to client"""
+        """Queue telnet command to client"""
         if self.client_socket:
-            try:
-                self.client_socket.send(bytes([IAC, cmd, opt]))
-            except:
-                pass
+            self._to_client += bytes([IAC, cmd, opt])
 
     def _send_com_port_option(self, subcmd, data):
-        """Send COM-PORT-OPTION subnegotiation response"""
+        """Queue COM-PORT-OPTION subnegotiation response, in order with serial data"""
         if self.client_socket:
-            try:
-                msg = bytes([IAC, SB, COM_PORT_OPTION, subcmd]) + data + bytes([IAC, SE])
-                self.client_socket.send(msg)
-            except:
-                pass
+            self._to_client += bytes([IAC, SB, COM_PORT_OPTION, subcmd]) + data + bytes([IAC, SE])
 
     def run(self):
-        """Main loop"""
+        """Main loop: one select() over both ends, reads bounded by the
+        space left in the opposite direction's buffer"""
         self.running = True
         self.open_serial()
         self.start_server()
 
         try:
             while self.running:
-                # Build list of sockets to monitor
                 read_list = [self.server_socket]
+                write_list = []
                 if self.serial and self.serial.is_open:
-                    read_list.append(self.serial)
+                    if not self.client_socket or len(self._to_client) < CLIENT_BUF_MAX:
+                        read_list.append(self.serial)
+                    if self._to_serial:
+                        write_list.append(self.serial)
                 if self.client_socket:
-                    read_list.append(self.client_socket)
+                    if len(self._to_serial) < SERIAL_BUF_MAX:
+                        read_list.append(self.client_socket)
+                    if self._to_client:
+                        write_list.append(self.client_socket)
 
                 try:
-                    readable, _, _ = select.select(read_list, [], [], 0.1)
+                    readable, writable, _ = select.select(read_list, write_list, [], SELECT_TIMEOUT_S)
                 except (ValueError, OSError):
                     continue
 
-                for sock in readable:
-                    if sock == self.server_socket:
-                        # New client connection
-                        try:
-                            if self.client_socket:
-                                self.client_socket.close()
-                                self.logger.log("Previous client disconnected (new connection)")
-
-                            self.client_socket, addr = self.server_socket.accept()
-                            self.client_socket.setblocking(False)
-                            self.logger.log(f"Client connected from {addr[0]}:{addr[1]}")
-                        except:
-                            pass
-
-                    elif sock == self.client_socket:
-                        # Data from client
-                        try:
-                            data = self.client_socket.recv(4096)
-                            if data:
-                                # Process RFC2217 commands, get raw data
-                                raw_data = self.handle_rfc2217(data)
-                                if raw_data:
-                                    self.serial.write(raw_data)
-                                    self.logger.log_data(raw_data, 'TX')
-                            else:
-                                # Client disconnected
-                                self.logger.log("Client disconnected")
-                                self.client_socket.close()
-                                self.client_socket = None
-                        except (ConnectionResetError, BrokenPipeError):
-                            self.logger.log("Client connection reset")
-                            self.client_socket.close()
-                            self.client_socket = None
-                        except BlockingIOError:
-                            pass
-
-                    elif sock == self.serial:
-                        # Data from serial
-                        try:
-                            data = self.serial.read(self.serial.in_waiting or 1)
-                            if data:
-                                self.logger.log_data(data, 'RX')
-                                if self.client_socket:
-                                    try:
-                                        self.client_socket.send(data)
-                                    except:
-                                        pass
-                        except:
-                            pass
-
-                # Also check for serial data even if not in select
-                if self.serial and self.serial.is_open and self.serial not in readable:
-                    try:
-                        if self.serial.in_waiting:
-                            data = self.serial.read(self.serial.in_waiting)
-                            if data:
-                                self.logger.log_data(data, 'RX')
-                                if self.client_socket:
-                                    try:
-                                        self.client_socket.send(data)
-                                    except:
-                                        pass
-                    except:
-                        pass
+                # Drain first, so reads below see the freed space
+                if self.serial in writable:
+                    self._flush_serial()
+                if self.client_socket and self.client_socket in writable:
+                    self._flush_client()
+
+                if self.server_socket in readable:
+                    self._accept_client()
+                if self.client_socket and self.client_socket in readable:
+                    self._read_client()
+                if self.serial in readable:
+                    self._read_serial()
 
         except KeyboardInterrupt:
             pass
         finally:
             self.stop()
 
+    def _accept_client(self):
+        try:
+            sock, addr = self.server_socket.accept()
+        except OSError:
+            return
+        if self.client_socket:
+            self._drop_client("Previous client disconnected (new connection)")
+        sock.setblocking(False)
+        self.client_socket = sock
+        self.logger.log(f"Client connected from {addr[0]}:{addr[1]}")
+
+    def _drop_client(self, reason):
+        self.logger.log(reason)
+        try:
+            self.client_socket.close()
+        except OSError:
+            pass
+        self.client_socket = None
+        self._to_client.clear()     # nobody left to receive it
+        self._to_serial.clear()
+        self._serial_opts.clear()
+        self._serial_written = self._serial_queued
+
+    def _read_client(self):
+        try:
+            data = self.client_socket.recv(READ_CHUNK)
+        except BlockingIOError:
+            return
+        except OSError:
+            self._drop_client("Client connection reset")
+            return
+        if not data:
+            self._drop_client("Client disconnected")
+            return
+        # Process RFC2217 commands, get raw data
+        raw_data = self.handle_rfc2217(data)
+        if raw_data:
+            self._to_serial += raw_data
+            self._serial_queued += len(raw_data)
+            self.logger.log_data(raw_data, 'TX')
+        self._apply_serial_opts()
+
+    def _flush_client(self):
+        try:
+            sent = self.client_socket.send(self._to_client)
+        except BlockingIOError:
+            return
+        except OSError:
+            self._drop_client("Client connection reset")
+            return
+        del self._to_client[:sent]
+
+    def _read_serial(self):
+        try:
+            data = self.serial.read(self.serial.in_waiting or 1)
+        except (serial.SerialException, OSError) as e:
+            self._serial_failed(e)
+            return
+        if data:
+            self.logger.log_data(data, 'RX')
+            if self.client_socket:
+                self._to_client += data
+
+    def _flush_serial(self):
+        # Stop short of the next queued option; it applies once that is out
+        end = self._serial_opts[0][0] - self._serial_written if self._serial_opts else len(self._to_serial)
+        try:
+            written = self.serial.write(self._to_serial[:end])
+        except serial.SerialTimeoutException:
+            return          # device not accepting data yet
+        except (serial.SerialException, OSError) as e:
+            self._serial_failed(e)
+            return
+        del self._to_serial[:written or 0]
+        self._serial_written += written or 0
+        self._apply_serial_opts()
+
+    def _apply_serial_opts(self):
+        """Apply queued COM-PORT options whose preceding data has been written,
+        so e.g. esptool's baud switch or reset never catches bytes in flight"""
+        drained = False
+        while self._serial_opts and self._serial_opts[0][0] <= self._serial_written:
+            _mark, subcmd, data = self._serial_opts.popleft()
+            if not drained and self._serial_written:
+                try:
+                    self.serial.flush()     # and out of the tty buffer, too
+                except (serial.SerialException, OSError) as e:
+                    self._serial_failed(e)
+                    return
+                drained = True
+            self._handle_com_port_option(subcmd, data)
+
+    def _serial_failed(self, err):
+        # Unplugged or re-enumerated: readable forever, so stop rather than spin
+        self.logger.log(f"Serial error: {err}")
+        self.running = False
+
     def stop(self):
         """Stop the proxy"""
         self.running = False
@@ -339,3 +339,159 @@ class TestWiFiScan:
         status = wifi_tester.ap_status()
         assert status["active"] is True
         wifi_tester.ap_stop()
+
+
+# =====================================================================
+# WT-13xx  Network Benchmark
+# =====================================================================
+
+
+@pytest.mark.requires_dut
+class TestNetworkBenchmark:
+    """WT-13xx: Throughput matrix against test firmware /bench (requires DUT).
+
+    The DUT dials the portal's bench peer (BENCH_PORT 5201) at the AP
+    address for the socket modes; results come from GET /bench.
+    """
+
+    BENCH_MS = 3000
+
+    @pytest.fixture
+    def dut_url(self, wifi_tester, wifi_network):
+        """Wait for DUT to connect and return its test firmware URL."""
+        station = wifi_tester.wait_for_station(timeout=60)
+        return f"http://{station['ip']}:8080"
+
+    @staticmethod
+    def _result(wifi_tester, dut_url, mode, timeout=20):
+        """Poll GET /bench until `mode` has finished; return its entry."""
+        deadline = time.monotonic() + timeout
+        while time.monotonic() < deadline:
+            resp = wifi_tester.http_get(f"{dut_url}/bench")
+            assert resp.status_code == 200
+            entry = next(r for r in resp.json() if r["mode"] == mode)
+            if not entry["running"] and "bytes" in entry:
+                return entry
+            time.sleep(0.5)
+        pytest.fail(f"{mode} did not finish within {timeout}s")
+
+    def _run(self, wifi_tester, wifi_network, dut_url, mode, **extra):
+        resp = wifi_tester.http_post(
+            f"{dut_url}/bench",
+            json_data={"mode": mode, "host": wifi_network["ap_ip"],
+                       "ms": self.BENCH_MS, **extra},
+        )
+        assert resp.status_code == 200
+        assert resp.json()["status"] == "started"
+        entry = self._result(wifi_tester, dut_url, mode,
+                             timeout=self.BENCH_MS / 1000 + 15)
+        print(f"\n{mode}: {entry['kbps'] / 1000:.2f} Mbit/s, "
+              f"retransmits {entry['retransmits']}, rssi {entry['rssi']}")
+        return entry
+
+    def test_wt1300_http_download(self, wifi_tester, dut_url):
+        """WT-1300: /bench/download streams the requested byte count."""
+        resp = wifi_tester.http_get(f"{dut_url}/bench/download?bytes=2048")
+        assert resp.status_code == 200
+        assert len(resp.content) == 2048
+        entry = self._result(wifi_tester, dut_url, "http_download")
+        assert entry["result"] == "ok"
+        assert entry["bytes"] == 2048
+
+    def test_wt1301_http_upload(self, wifi_tester, dut_url):
+        """WT-1301: /bench/upload counts the body and reports the rate."""
+        resp = wifi_tester.http_request("POST", f"{dut_url}/bench/upload",
+                                        body=bytes(2048))
+        assert resp.status_code == 200
+        entry = resp.json()
+        assert entry["mode"] == "http_upload"
+        assert entry["bytes"] == 2048
+        assert entry["result"] == "ok"
+
+    def test_wt1302_udp_blast(self, wifi_tester, wifi_network, dut_url):
+        """WT-1302: UDP blast sends datagrams for the whole duration."""
+        entry = self._run(wifi_tester, wifi_network, dut_url, "udp_blast")
+        assert entry["result"] == "ok"
+        assert entry["packets"] > 0
+        assert entry["kbps"] > 0
+        assert entry["rssi"] < 0
+
+    def test_wt1303_udp_echo(self, wifi_tester, wifi_network, dut_url):
+        """WT-1303: UDP echo measures round trips through the peer."""
+        entry = self._run(wifi_tester, wifi_network, dut_url, "udp_echo", size=64)
+        assert entry["result"] == "ok"
+        assert entry["packets"] > 0
+        assert 0 < entry["rtt_avg_us"] <= entry["rtt_max_us"]
+
+    def test_wt1304_tcp_send(self, wifi_tester, wifi_network, dut_url):
+        """WT-1304: TCP stream board -> peer."""
+        entry = self._run(wifi_tester, wifi_network, dut_url, "tcp_send")
+        assert entry["result"] == "ok"
+        assert entry["kbps"] > 0
+
+    def test_wt1305_tcp_recv(self, wifi_tester, wifi_network, dut_url):
+        """WT-1305: TCP stream peer -> board."""
+        entry = self._run(wifi_tester, wifi_network, dut_url, "tcp_recv")
+        assert entry["result"] == "ok"
+        assert entry["kbps"] > 0
+
+    def test_wt1306_concurrent_rejected(self, wifi_tester, wifi_network, dut_url):
+        """WT-1306: A second benchmark while one runs returns 409."""
+        body = {"mode": "udp_blast", "host": wifi_network["ap_ip"], "ms": self.BENCH_MS}
+        first = wifi_tester.http_post(f"{dut_url}/bench", json_data=body)
+        assert first.status_code == 200
+        second = wifi_tester.http_post(f"{dut_url}/bench", json_data=body)
+        assert second.status_code == 409
+        self._result(wifi_tester, dut_url, "udp_blast", timeout=self.BENCH_MS / 1000 + 15)
+
+    def test_wt1307_bad_mode_rejected(self, wifi_tester, dut_url):
+        """WT-1307: Unknown or HTTP-only modes are rejected by POST /bench."""
+        for mode in ("nope", "http_download"):
+            resp = wifi_tester.http_post(f"{dut_url}/bench", json_data={"mode": mode})
+            assert resp.status_code == 400
+
+
+# =====================================================================
+# WT-14xx  Captive Portal Provisioning
+# =====================================================================
+
+
+@pytest.mark.requires_dut
+class TestProvisioning:
+    """WT-14xx: /connect on the DUT's captive portal (requires an unprovisioned DUT).
+
+    The tester joins WB-Test-Setup, posts credentials for an AP it then
+    starts itself; the DUT only shows up as a station if it stored the
+    SSID and password byte for byte. The DUT keeps these credentials.
+    """
+
+    PORTAL_SSID = "WB-Test-Setup"
+    PORTAL_URL = "http://192.168.4.1"
+
+    def test_wt1400_non_ascii_ssid(self, wifi_tester):
+        """WT-1400: Raw UTF-8 SSID and password posted to /connect survive intact."""
+        import json
+        import uuid
+        ssid = f"WT-Café-{uuid.uuid4().hex[:4].upper()}"
+        password = "pässwörd-123"
+        try:
+            wifi_tester.sta_join(self.PORTAL_SSID, timeout=20)
+        except CommandError:
+            pytest.skip(f"DUT is not serving {self.PORTAL_SSID}")
+
+        body = json.dumps({"ssid": ssid, "password": password},
+                          ensure_ascii=False).encode("utf-8")   # no \u escapes
+        resp = wifi_tester.http_request(
+            "POST", f"{self.PORTAL_URL}/connect",
+            headers={"Content-Type": "application/json"}, body=body,
+        )
+        wifi_tester.sta_leave()
+        assert resp.status_code == 200
+
+        wifi_tester.drain_events()
+        wifi_tester.ap_start(ssid, password)
+        try:
+            station = wifi_tester.wait_for_station(timeout=60)
+            assert station["ip"]
+        finally:
+            wifi_tester.ap_stop()
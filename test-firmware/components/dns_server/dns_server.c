@@ -6,6 +6,8 @@
 
 #include <sys/param.h>
 #include <inttypes.h>
+#include <string.h>
+#include <strings.h>
 
 #include "esp_log.h"
 #include "esp_system.h"
@@ -17,274 +19,425 @@
 #include "lwip/sys.h"
 #include "lwip/netdb.h"
 #include "dns_server.h"
+#include "metrics.h"
+#include "net_loop.h"
 
 #define DNS_PORT (53)
-#define DNS_MAX_LEN (256)
+#define DNS_MAX_LEN (512)           /* classic UDP limit; EDNS is not offered */
+#define DNS_HDR_LEN (12)
+#define DNS_ANSWER_LEN (16)         /* name pointer, type, class, TTL, rdlength, IPv4 */
+#define DNS_SOA_LEN (33)            /* root owner, type..rdlength, root MNAME/RNAME, 5 timers */
+#define DNS_MAX_QUESTIONS (4)
+#define DNS_RX_BURST (8)            /* queries handled per wakeup before yielding the loop */
+
+/* Header byte 2 (QR, opcode, AA, TC, RD) and byte 3 (RA, Z, AD, CD, rcode) */
+#define FLAG_QR (0x80)
+#define FLAG_AA (0x04)
+#define OPCODE_MASK (0x78)
+#define RCODE_NOTIMP (4)
+
+#define QD_TYPE_A (1)
+#define QD_TYPE_SOA (6)
+#define QD_TYPE_AAAA (28)
+#define QD_TYPE_SVCB (64)
+#define QD_TYPE_HTTPS (65)
+#define QD_CLASS_IN (1)
 
-#define OPCODE_MASK (0x7800)
-#define QR_FLAG (1 << 7)
-#define QD_TYPE_A (0x0001)
 #define ANS_TTL_SEC (300)
+#define NEG_TTL_SEC (300)           /* how long clients cache "no AAAA/HTTPS here" */
+
+#define SLOT_EMPTY (0xFF)
 
 static const char *TAG = "example_dns_redirect_server";
 
-// DNS Header Packet
-typedef struct __attribute__((__packed__))
-{
-    uint16_t id;
-    uint16_t flags;
-    uint16_t qd_count;
-    uint16_t an_count;
-    uint16_t ns_count;
-    uint16_t ar_count;
-} dns_header_t;
-
-// DNS Question Packet
-typedef struct {
-    uint16_t type;
-    uint16_t class;
-} dns_question_t;
+static metric_t s_m_queries = METRIC_COUNTER_INIT("dns_queries_total");
+static metric_t s_m_answers = METRIC_COUNTER_INIT("dns_answers_total");
+static metric_t s_m_negative = METRIC_COUNTER_INIT("dns_negative_answers_total");
+static metric_t s_m_errors = METRIC_COUNTER_INIT("dns_errors_total");
 
-// DNS Answer Packet
-typedef struct __attribute__((__packed__))
-{
-    uint16_t ptr_offset;
-    uint16_t type;
-    uint16_t class;
-    uint32_t ttl;
-    uint16_t addr_len;
-    uint32_t ip_addr;
-} dns_answer_t;
+// One precompiled rule: name hash for the lookup table, netif resolved on first use
+typedef struct {
+    const char *name;
+    uint32_t hash;
+    const char *if_key;
+    esp_netif_t *netif;
+    esp_ip4_addr_t ip;
+} dns_rule_t;
 
 // DNS server handle
 struct dns_server_handle {
-    bool started;
-    TaskHandle_t task;
-    int num_of_entries;
-    dns_entry_pair_t entry[];
+    int sock;
+    int wildcard;               // rule answering every other name ("*"), or -1
+    uint32_t slot_mask;
+    uint8_t *slots;             // open-addressed: name hash -> rule index
+    int num_of_rules;
+    dns_rule_t rule[];
 };
 
-/*
-    Parse the name from the packet from the DNS name format to a regular .-seperated name
-    returns the pointer to the next part of the packet
-*/
-static char *parse_dns_name(char *raw_name, char *parsed_name, size_t parsed_name_max_len)
+static inline uint16_t get16(const uint8_t *p)
 {
+    return (uint16_t)(p[0] << 8 | p[1]);
+}
 
-    char *label = raw_name;
-    char *name_itr = parsed_name;
-    int name_len = 0;
+static inline void put16(uint8_t *p, uint16_t v)
+{
+    p[0] = (uint8_t)(v >> 8);
+    p[1] = (uint8_t)v;
+}
 
-    do {
-        int sub_name_len = *label;
-        // (len + 1) since we are adding  a '.'
-        name_len += (sub_name_len + 1);
-        if (name_len > parsed_name_max_len) {
-            return NULL;
-        }
+static inline void put32(uint8_t *p, uint32_t v)
+{
+    put16(p, (uint16_t)(v >> 16));
+    put16(p + 2, (uint16_t)v);
+}
 
-        // Copy the sub name that follows the the label
-        memcpy(name_itr, label + 1, sub_name_len);
-        name_itr[sub_name_len] = '.';
-        name_itr += (sub_name_len + 1);
-        label += sub_name_len + 1;
-    } while (*label != 0);
-
-    // Terminate the final string, replacing the last '.'
-    parsed_name[name_len - 1] = '\0';
-    // Return pointer to first char after the name
-    return label + 1;
+static inline uint8_t lower(uint8_t c)
+{
+    return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
 }
 
-// Parses the DNS request and prepares a DNS response with the IP of the softAP
-static int parse_dns_request(char *req, size_t req_len, char *dns_reply, size_t dns_reply_max_len, dns_server_handle_t h)
+// FNV-1a over the lower-cased dotted name
+static inline uint32_t hash_step(uint32_t h, uint8_t c)
 {
-    if (req_len > dns_reply_max_len) {
-        return -1;
+    return (h ^ lower(c)) * 16777619u;
+}
+
+static uint32_t hash_name(const char *name)
+{
+    uint32_t h = 2166136261u;
+    while (*name) {
+        h = hash_step(h, (uint8_t)*name++);
     }
+    return h;
+}
 
-    // Prepare the reply
-    memset(dns_reply, 0, dns_reply_max_len);
-    memcpy(dns_reply, req, req_len);
+/*
+    Walk the uncompressed name at pkt[*off], hashing it as its dotted form.
+    Advances *off past the name; false if it is malformed or runs off the end.
+*/
+static bool walk_name(const uint8_t *pkt, size_t len, size_t *off, uint32_t *hash)
+{
+    uint32_t h = 2166136261u;
+    size_t p = *off;
+    bool first = true;
+
+    while (p < len && pkt[p] != 0) {
+        uint8_t label = pkt[p++];
+        if (label > 63 || p + label > len) {
+            return false;           // compression pointer or truncated
+        }
+        if (!first) {
+            h = hash_step(h, '.');
+        }
+        for (uint8_t i = 0; i < label; i++) {
+            h = hash_step(h, pkt[p + i]);
+        }
+        p += label;
+        first = false;
+    }
+    if (p >= len) {
+        return false;
+    }
+    *off = p + 1;
+    *hash = h;
+    return true;
+}
 
-    // Endianess of NW packet different from chip
-    dns_header_t *header = (dns_header_t *)dns_reply;
-    ESP_LOGD(TAG, "DNS query with header id: 0x%X, flags: 0x%X, qd_count: %d",
-             ntohs(header->id), ntohs(header->flags), ntohs(header->qd_count));
+// Case-insensitive compare of a wire-format name with a dotted one
+static bool name_matches(const uint8_t *qname, const char *name)
+{
+    while (*qname) {
+        uint8_t label = *qname++;
+        for (uint8_t i = 0; i < label; i++, name++) {
+            if (lower(qname[i]) != lower((uint8_t)*name)) {
+                return false;
+            }
+        }
+        qname += label;
+        if (*qname && *name++ != '.') {
+            return false;
+        }
+    }
+    return *name == '\0';
+}
 
-    // Not a standard query
-    if ((header->flags & OPCODE_MASK) != 0) {
-        return 0;
+static const dns_rule_t *dns_lookup(dns_server_handle_t h, const uint8_t *qname, uint32_t hash)
+{
+    for (uint32_t i = hash & h->slot_mask; h->slots[i] != SLOT_EMPTY; i = (i + 1) & h->slot_mask) {
+        const dns_rule_t *r = &h->rule[h->slots[i]];
+        if (r->hash == hash && name_matches(qname, r->name)) {
+            return r;
+        }
     }
+    return h->wildcard >= 0 ? &h->rule[h->wildcard] : NULL;
+}
 
-    // Set question response flag
-    header->flags |= QR_FLAG;
+static bool rule_ip(dns_rule_t *r, esp_ip4_addr_t *ip)
+{
+    if (!r->if_key) {
+        *ip = r->ip;
+        return ip->addr != IPADDR_ANY;
+    }
+    if (!r->netif) {
+        r->netif = esp_netif_get_handle_from_ifkey(r->if_key);
+    }
+    esp_netif_ip_info_t ip_info;
+    if (!r->netif || esp_netif_get_ip_info(r->netif, &ip_info) != ESP_OK) {
+        return false;
+    }
+    ip->addr = ip_info.ip.addr;
+    return ip->addr != IPADDR_ANY;
+}
 
-    uint16_t qd_count = ntohs(header->qd_count);
-    header->an_count = htons(qd_count);
+// Negative answer: SOA for the root zone in the authority section, so the
+// client caches the absence for NEG_TTL_SEC (RFC 2308) instead of retrying
+static void put_soa(uint8_t *p)
+{
+    p[0] = 0;                       // owner: root
+    put16(p + 1, QD_TYPE_SOA);
+    put16(p + 3, QD_CLASS_IN);
+    put32(p + 5, NEG_TTL_SEC);
+    put16(p + 9, DNS_SOA_LEN - 11);
+    p[11] = 0;                      // MNAME: root
+    p[12] = 0;                      // RNAME: root
+    put32(p + 13, 1);               // serial
+    put32(p + 17, 3600);            // refresh
+    put32(p + 21, 600);             // retry
+    put32(p + 25, 86400);           // expire
+    put32(p + 29, NEG_TTL_SEC);     // minimum
+}
 
-    int reply_len = qd_count * sizeof(dns_answer_t) + req_len;
-    if (reply_len > dns_reply_max_len) {
+/*
+    Turn the query in pkt into its response, in place. Anything after the
+    question section (e.g. an EDNS OPT record) is dropped and the answers
+    take its place. Returns the reply length, or -1 to drop the packet.
+*/
+static int dns_reply(dns_server_handle_t h, uint8_t *pkt, size_t len)
+{
+    if (len < DNS_HDR_LEN || (pkt[2] & FLAG_QR)) {
         return -1;
     }
+    uint16_t qd_count = get16(pkt + 4);
 
-    // Pointer to current answer and question
-    char *cur_ans_ptr = dns_reply + req_len;
-    char *cur_qd_ptr = dns_reply + sizeof(dns_header_t);
-    char name[128];
+    pkt[2] |= FLAG_QR | FLAG_AA;
+    pkt[3] = 0;
+    put16(pkt + 6, 0);
+    put16(pkt + 8, 0);
+    put16(pkt + 10, 0);
 
-    // Respond to all questions based on configured rules
-    for (int qd_i = 0; qd_i < qd_count; qd_i++) {
-        char *name_end_ptr = parse_dns_name(cur_qd_ptr, name, sizeof(name));
-        if (name_end_ptr == NULL) {
-            ESP_LOGE(TAG, "Failed to parse DNS question: %s", cur_qd_ptr);
+    // Not a standard query
+    if (pkt[2] & OPCODE_MASK) {
+        pkt[3] = RCODE_NOTIMP;
+        put16(pkt + 4, 0);
+        return DNS_HDR_LEN;
+    }
+    if (qd_count == 0 || qd_count > DNS_MAX_QUESTIONS) {
+        return -1;
+    }
+
+    struct {
+        uint16_t name_off;
+        uint16_t type;
+        uint16_t class;
+        uint32_t hash;
+    } q[DNS_MAX_QUESTIONS];
+
+    size_t off = DNS_HDR_LEN;
+    for (int i = 0; i < qd_count; i++) {
+        q[i].name_off = off;
+        if (!walk_name(pkt, len, &off, &q[i].hash) || off + 4 > len) {
             return -1;
         }
+        q[i].type = get16(pkt + off);
+        q[i].class = get16(pkt + off + 2);
+        off += 4;
+    }
 
-        dns_question_t *question = (dns_question_t *)(name_end_ptr);
-        uint16_t qd_type = ntohs(question->type);
-        uint16_t qd_class = ntohs(question->class);
-
-        ESP_LOGD(TAG, "Received type: %d | Class: %d | Question for: %s", qd_type, qd_class, name);
-
-        if (qd_type == QD_TYPE_A) {
-            esp_ip4_addr_t ip = { .addr = IPADDR_ANY };
-            // Check the configured rules to decide whether to answer this question or not
-            for (int i = 0; i < h->num_of_entries; ++i) {
-                // check if the name either corresponds to the entry, or if we should answer to all queries ("*")
-                if (strcmp(h->entry[i].name, "*") == 0 || strcmp(h->entry[i].name, name) == 0) {
-                    if (h->entry[i].if_key) {
-                        esp_netif_ip_info_t ip_info;
-                        esp_netif_get_ip_info(esp_netif_get_handle_from_ifkey(h->entry[i].if_key), &ip_info);
-                        ip.addr = ip_info.ip.addr;
-                        break;
-                    } else if (h->entry->ip.addr != IPADDR_ANY) {
-                        ip.addr = h->entry[i].ip.addr;
-                        break;
-                    }
-                }
-            }
-            if (ip.addr == IPADDR_ANY) {    // no rule applies, continue with another question
-                continue;
-            }
-            dns_answer_t *answer = (dns_answer_t *)cur_ans_ptr;
-
-            answer->ptr_offset = htons(0xC000 | (cur_qd_ptr - dns_reply));
-            answer->type = htons(qd_type);
-            answer->class = htons(qd_class);
-            answer->ttl = htonl(ANS_TTL_SEC);
+    size_t end = off;
+    uint16_t an_count = 0;
+    bool negative = false;
+    for (int i = 0; i < qd_count; i++) {
+        if (q[i].class != QD_CLASS_IN) {
+            continue;
+        }
+        if (q[i].type == QD_TYPE_AAAA || q[i].type == QD_TYPE_SVCB || q[i].type == QD_TYPE_HTTPS) {
+            negative = true;
+            continue;
+        }
+        if (q[i].type != QD_TYPE_A || end + DNS_ANSWER_LEN > DNS_MAX_LEN) {
+            continue;
+        }
+        dns_rule_t *r = (dns_rule_t *)dns_lookup(h, pkt + q[i].name_off, q[i].hash);
+        esp_ip4_addr_t ip;
+        if (!r || !rule_ip(r, &ip)) {   // no rule applies, continue with another question
+            continue;
+        }
+        uint8_t *a = pkt + end;
+        put16(a, 0xC000 | q[i].name_off);
+        put16(a + 2, QD_TYPE_A);
+        put16(a + 4, QD_CLASS_IN);
+        put32(a + 6, ANS_TTL_SEC);
+        put16(a + 10, sizeof(ip.addr));
+        memcpy(a + 12, &ip.addr, sizeof(ip.addr));     // already in network order
+        end += DNS_ANSWER_LEN;
+        an_count++;
+    }
+    put16(pkt + 6, an_count);
+    metric_add(&s_m_answers, an_count);
+
+    if (negative && an_count == 0 && end + DNS_SOA_LEN <= DNS_MAX_LEN) {
+        put_soa(pkt + end);
+        end += DNS_SOA_LEN;
+        put16(pkt + 8, 1);
+        metric_inc(&s_m_negative);
+    }
+    return end;
+}
 
-            ESP_LOGD(TAG, "Answer with PTR offset: 0x%" PRIX16 " and IP 0x%" PRIX32, ntohs(answer->ptr_offset), ip.addr);
+/*
+    Runs on the net_loop task whenever the socket is readable: drain up to
+    DNS_RX_BURST queries, reply to type A queries with the configured IPs.
+    Nothing is logged per packet; see the dns_* metrics.
+*/
+static void dns_on_readable(int sock, void *arg)
+{
+    dns_server_handle_t handle = arg;
+    uint8_t pkt[DNS_MAX_LEN];
+
+    for (int i = 0; i < DNS_RX_BURST; i++) {
+        struct sockaddr_in6 source_addr; // Large enough for both IPv4 or IPv6
+        socklen_t socklen = sizeof(source_addr);
+        int len = recvfrom(sock, pkt, sizeof(pkt), 0, (struct sockaddr *)&source_addr, &socklen);
+        if (len < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                metric_inc(&s_m_errors);
+            }
+            return;
+        }
+        metric_inc(&s_m_queries);
 
-            answer->addr_len = htons(sizeof(ip.addr));
-            answer->ip_addr = ip.addr;
+        int reply_len = dns_reply(handle, pkt, len);
+        if (reply_len <= 0) {
+            metric_inc(&s_m_errors);
+            continue;
         }
+        if (sendto(sock, pkt, reply_len, 0, (struct sockaddr *)&source_addr, socklen) < 0) {
+            // Typically ENOMEM under load: drop this reply, the client retries
+            metric_inc(&s_m_errors);
+        }
+    }
+}
+
+static int dns_open_socket(void)
+{
+    struct sockaddr_in addr = {
+        .sin_addr.s_addr = htonl(INADDR_ANY),
+        .sin_family = AF_INET,
+        .sin_port = htons(DNS_PORT),
+    };
+
+    int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
+    if (sock < 0) {
+        ESP_LOGE(TAG, "Unable to create socket: errno %d", errno);
+        return -1;
+    }
+    if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        ESP_LOGE(TAG, "Socket unable to bind: errno %d", errno);
+        close(sock);
+        return -1;
     }
-    return reply_len;
+    fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK);
+    return sock;
 }
 
 /*
-    Sets up a socket and listen for DNS queries,
-    replies to all type A queries with the IP of the softAP
+    Compile the config into the lookup table. Rules behind the first "*"
+    could never match (first match wins), so they are left out.
 */
-void dns_server_task(void *pvParameters)
+static int compile_rules(dns_server_handle_t h, const dns_server_config_t *config)
 {
-    char rx_buffer[128];
-    char addr_str[128];
-    int addr_family;
-    int ip_protocol;
-    dns_server_handle_t handle = pvParameters;
-
-    while (handle->started) {
-
-        struct sockaddr_in dest_addr;
-        dest_addr.sin_addr.s_addr = htonl(INADDR_ANY);
-        dest_addr.sin_family = AF_INET;
-        dest_addr.sin_port = htons(DNS_PORT);
-        addr_family = AF_INET;
-        ip_protocol = IPPROTO_IP;
-        inet_ntoa_r(dest_addr.sin_addr, addr_str, sizeof(addr_str) - 1);
-
-        int sock = socket(addr_family, SOCK_DGRAM, ip_protocol);
-        if (sock < 0) {
-            ESP_LOGE(TAG, "Unable to create socket: errno %d", errno);
+    int n = 0;
+    h->wildcard = -1;
+    memset(h->slots, SLOT_EMPTY, h->slot_mask + 1);
+
+    for (int i = 0; i < config->num_of_entries; i++) {
+        const dns_entry_pair_t *e = &config->item[i];
+        dns_rule_t *r = &h->rule[n];
+        *r = (dns_rule_t) {
+            .name = e->name, .hash = hash_name(e->name), .if_key = e->if_key, .ip = e->ip,
+        };
+        if (strcmp(e->name, "*") == 0) {
+            h->wildcard = n++;
             break;
         }
-        ESP_LOGI(TAG, "Socket created");
 
-        int err = bind(sock, (struct sockaddr *)&dest_addr, sizeof(dest_addr));
-        if (err < 0) {
-            ESP_LOGE(TAG, "Socket unable to bind: errno %d", errno);
-        }
-        ESP_LOGI(TAG, "Socket bound, port %d", DNS_PORT);
-
-        while (handle->started) {
-            ESP_LOGI(TAG, "Waiting for data");
-            struct sockaddr_in6 source_addr; // Large enough for both IPv4 or IPv6
-            socklen_t socklen = sizeof(source_addr);
-            int len = recvfrom(sock, rx_buffer, sizeof(rx_buffer) - 1, 0, (struct sockaddr *)&source_addr, &socklen);
-
-            // Error occurred during receiving
-            if (len < 0) {
-                ESP_LOGE(TAG, "recvfrom failed: errno %d", errno);
-                close(sock);
+        uint32_t slot = r->hash & h->slot_mask;
+        bool dup = false;
+        while (h->slots[slot] != SLOT_EMPTY) {
+            const dns_rule_t *o = &h->rule[h->slots[slot]];
+            if (o->hash == r->hash && strcasecmp(o->name, r->name) == 0) {
+                dup = true;         // first one wins
                 break;
             }
-            // Data received
-            else {
-                // Get the sender's ip address as string
-                if (source_addr.sin6_family == PF_INET) {
-                    inet_ntoa_r(((struct sockaddr_in *)&source_addr)->sin_addr.s_addr, addr_str, sizeof(addr_str) - 1);
-                } else if (source_addr.sin6_family == PF_INET6) {
-                    inet6_ntoa_r(source_addr.sin6_addr, addr_str, sizeof(addr_str) - 1);
-                }
-
-                // Null-terminate whatever we received and treat like a string...
-                rx_buffer[len] = 0;
-
-                char reply[DNS_MAX_LEN];
-                int reply_len = parse_dns_request(rx_buffer, len, reply, DNS_MAX_LEN, handle);
-
-                ESP_LOGI(TAG, "Received %d bytes from %s | DNS reply with len: %d", len, addr_str, reply_len);
-                if (reply_len <= 0) {
-                    ESP_LOGE(TAG, "Failed to prepare a DNS reply");
-                } else {
-                    int err = sendto(sock, reply, reply_len, 0, (struct sockaddr *)&source_addr, sizeof(source_addr));
-                    if (err < 0) {
-                        ESP_LOGE(TAG, "Error occurred during sending: errno %d", errno);
-                        break;
-                    }
-                }
-            }
+            slot = (slot + 1) & h->slot_mask;
         }
-
-        if (sock != -1) {
-            ESP_LOGE(TAG, "Shutting down socket");
-            shutdown(sock, 0);
-            close(sock);
+        if (!dup) {
+            h->slots[slot] = n++;
         }
     }
-    vTaskDelete(NULL);
+    return n;
 }
 
 dns_server_handle_t start_dns_server(dns_server_config_t *config)
 {
-    dns_server_handle_t handle = calloc(1, sizeof(struct dns_server_handle) + config->num_of_entries * sizeof(dns_entry_pair_t));
+    ESP_RETURN_ON_FALSE(config->num_of_entries > 0 && config->num_of_entries < SLOT_EMPTY / 2,
+                        NULL, TAG, "Invalid number of entries");
+
+    // At most half full, so probe chains stay short
+    uint32_t slots = 4;
+    while (slots < 2 * (uint32_t)config->num_of_entries) {
+        slots <<= 1;
+    }
+    size_t rules_size = config->num_of_entries * sizeof(dns_rule_t);
+    dns_server_handle_t handle = calloc(1, sizeof(struct dns_server_handle) + rules_size + slots);
     ESP_RETURN_ON_FALSE(handle, NULL, TAG, "Failed to allocate dns server handle");
 
-    handle->started = true;
-    handle->num_of_entries = config->num_of_entries;
-    memcpy(handle->entry, config->item, config->num_of_entries * sizeof(dns_entry_pair_t));
+    static bool s_metrics_registered;
+    if (!s_metrics_registered) {
+        metrics_register(&s_m_queries);
+        metrics_register(&s_m_answers);
+        metrics_register(&s_m_negative);
+        metrics_register(&s_m_errors);
+        s_metrics_registered = true;
+    }
 
-    xTaskCreate(dns_server_task, "dns_server", 4096, handle, 5, &handle->task);
+    handle->slot_mask = slots - 1;
+    handle->slots = (uint8_t *)handle->rule + rules_size;
+    handle->num_of_rules = compile_rules(handle, config);
+
+    handle->sock = dns_open_socket();
+    if (handle->sock < 0) {
+        free(handle);
+        return NULL;
+    }
+    esp_err_t err = net_loop_add(handle->sock, dns_on_readable, handle);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "net_loop_add failed: %s", esp_err_to_name(err));
+        close(handle->sock);
+        free(handle);
+        return NULL;
+    }
+    ESP_LOGI(TAG, "Listening on UDP port %d, %d rule(s)%s", DNS_PORT,
+             handle->num_of_rules, handle->wildcard >= 0 ? ", wildcard" : "");
     return handle;
 }
 
 void stop_dns_server(dns_server_handle_t handle)
 {
-    if (handle) {
-        handle->started = false;
-        vTaskDelete(handle->task);
+    // The loop closes the socket and frees the handle once its callback
+    // can no longer run
+    if (handle && net_loop_close(handle->sock, free) != ESP_OK) {
+        close(handle->sock);
         free(handle);
     }
 }
@@ -61,13 +61,20 @@ typedef struct dns_server_handle *dns_server_handle_t;
  * @brief Set ups and starts a simple DNS server that will respond to all A queries (IPv4)
  * based on configured rules, pairs of name and either IPv4 address or a netif ID (to respond by it's IPv4 add)
  *
+ * Names are matched case-insensitively through a hash table built here; a "*" rule answers
+ * every name without an earlier exact rule. AAAA, SVCB and HTTPS queries get a cacheable
+ * negative answer (NOERROR, no records, root SOA) so clients stop asking.
+ *
+ * The socket is served by the shared net_loop task (net_loop_start() must have run); no task
+ * of its own is created.
+ *
  * @param config Configuration structure listing the pairs of (name, IP/netif-id)
- * @return dns_server's handle on success, NULL on failure
+ * @return dns_server's handle on success, NULL on failure (e.g. port 53 could not be bound)
  */
 dns_server_handle_t start_dns_server(dns_server_config_t *config);
 
 /**
- * @brief Stops and destroys DNS server's task and structs
+ * @brief Stops the DNS server; the socket is closed and the handle freed on the net_loop task
  * @param handle DNS server's handle to destroy
  */
 void stop_dns_server(dns_server_handle_t handle);
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Number of histogram buckets; bucket i counts samples < 2^i,
+ *        the last one everything above.
+ */
+#define METRICS_HIST_BUCKETS 16
+
+typedef enum {
+    METRIC_COUNTER,     /**<! Monotonic, updated with metric_inc/metric_add */
+    METRIC_GAUGE,       /**<! Point-in-time value, set directly or read via callback */
+    METRIC_HISTOGRAM,   /**<! Power-of-two buckets plus sum and count */
+} metric_type_t;
+
+/**
+ * @brief One metric. Define as a static in the owning module with one of the
+ * METRIC_*_INIT initialisers and hand it to metrics_register() once.
+ *
+ * @note `name` may carry Prometheus-style labels, e.g. "udp_log_dropped{core=\"0\"}".
+ */
+typedef struct metric {
+    const char *name;
+    metric_type_t type;
+    uint32_t value;                     /**<! Counter / gauge value */
+    int32_t (*read)(void *arg);         /**<! Optional callback, overrides `value` */
+    void *arg;
+    uint32_t *hist;                     /**<! METRICS_HIST_BUCKETS counters, histograms only */
+    uint32_t sum;
+    uint32_t count;
+    struct metric *next;
+} metric_t;
+
+#define METRIC_COUNTER_INIT(n)            { .name = (n), .type = METRIC_COUNTER }
+#define METRIC_COUNTER_FN_INIT(n, fn, a)  { .name = (n), .type = METRIC_COUNTER, .read = (fn), .arg = (a) }
+#define METRIC_GAUGE_INIT(n)              { .name = (n), .type = METRIC_GAUGE }
+#define METRIC_GAUGE_FN_INIT(n, fn, a)    { .name = (n), .type = METRIC_GAUGE, .read = (fn), .arg = (a) }
+#define METRIC_HISTOGRAM_INIT(n)          { .name = (n), .type = METRIC_HISTOGRAM, \
+                                            .hist = (uint32_t[METRICS_HIST_BUCKETS]){ 0 } }
+
+/**
+ * @brief Source of metrics that are only known when scraped (e.g. one gauge
+ * per running task). `collect` calls `emit` once per sample.
+ */
+typedef void (*metrics_emit_fn)(const char *name, int64_t value, void *ctx);
+
+typedef struct metric_collector {
+    void (*collect)(metrics_emit_fn emit, void *ctx);
+    struct metric_collector *next;
+} metric_collector_t;
+
+/**
+ * @brief Register built-in system gauges (heap, uptime, and with
+ *        CONFIG_FREERTOS_USE_TRACE_FACILITY per-task stack headroom, plus
+ *        CPU time and share with CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS).
+ *        Call once at boot.
+ */
+void metrics_init(void);
+
+/**
+ * @brief Add a metric to the registry. Lock-free; metrics are never removed.
+ */
+void metrics_register(metric_t *m);
+
+/**
+ * @brief Visit every registered metric (most recently registered first)
+ */
+void metrics_foreach(void (*cb)(const metric_t *m, void *ctx), void *ctx);
+
+/**
+ * @brief Add a collector. Lock-free; collectors are never removed.
+ */
+void metrics_register_collector(metric_collector_t *c);
+
+/**
+ * @brief Run every collector, passing its samples to `emit`
+ */
+void metrics_collect(metrics_emit_fn emit, void *ctx);
+
+/**
+ * @brief Current value of a counter or gauge (calls the callback if set)
+ */
+int64_t metric_value(const metric_t *m);
+
+static inline void metric_inc(metric_t *m)
+{
+    __atomic_fetch_add(&m->value, 1, __ATOMIC_RELAXED);
+}
+
+static inline void metric_add(metric_t *m, uint32_t n)
+{
+    __atomic_fetch_add(&m->value, n, __ATOMIC_RELAXED);
+}
+
+static inline void metric_set(metric_t *m, uint32_t v)
+{
+    __atomic_store_n(&m->value, v, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Record one histogram sample
+ */
+void metric_observe(metric_t *m, uint32_t v);
+
+#ifdef __cplusplus
+}
+#endif
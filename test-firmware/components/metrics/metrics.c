@@ -0,0 +1,177 @@
+#include "metrics.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+static metric_t *s_head;
+static metric_collector_t *s_collectors;
+
+static int32_t read_heap_free(void *arg)
+{
+    return (int32_t)esp_get_free_heap_size();
+}
+
+static int32_t read_heap_min_free(void *arg)
+{
+    return (int32_t)esp_get_minimum_free_heap_size();
+}
+
+static int32_t read_heap_largest_block(void *arg)
+{
+    return (int32_t)heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+}
+
+static int32_t read_uptime_s(void *arg)
+{
+    return (int32_t)(esp_timer_get_time() / 1000000);
+}
+
+static metric_t s_heap_free = METRIC_GAUGE_FN_INIT("heap_free_bytes", read_heap_free, NULL);
+static metric_t s_heap_min = METRIC_GAUGE_FN_INIT("heap_min_free_bytes", read_heap_min_free, NULL);
+static metric_t s_heap_block = METRIC_GAUGE_FN_INIT("heap_largest_block_bytes", read_heap_largest_block, NULL);
+static metric_t s_uptime = METRIC_GAUGE_FN_INIT("uptime_seconds", read_uptime_s, NULL);
+
+#if CONFIG_FREERTOS_USE_TRACE_FACILITY
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+#define CPU_PREV_MAX    48
+
+typedef configRUN_TIME_COUNTER_TYPE runtime_t;
+
+/* Run time of each task at the previous scrape */
+static struct {
+    TaskHandle_t task;
+    runtime_t runtime;
+} s_cpu_prev[CPU_PREV_MAX];
+static runtime_t s_cpu_prev_total;
+static SemaphoreHandle_t s_cpu_lock;
+
+/* Per mille of all cores' time each task ran since the previous scrape
+   (since boot on the first one), then make this scrape the reference */
+static void cpu_shares(const TaskStatus_t *tasks, UBaseType_t n, runtime_t total, uint16_t *permille)
+{
+    xSemaphoreTake(s_cpu_lock, portMAX_DELAY);
+    uint64_t span = (uint64_t)(runtime_t)(total - s_cpu_prev_total) * portNUM_PROCESSORS;
+    for (UBaseType_t i = 0; i < n; i++) {
+        runtime_t prev = 0;
+        for (int j = 0; j < CPU_PREV_MAX; j++) {
+            if (s_cpu_prev[j].task == tasks[i].xHandle) {
+                prev = s_cpu_prev[j].runtime;
+                break;
+            }
+        }
+        if (tasks[i].ulRunTimeCounter < prev) prev = 0;     /* handle reused by a new task */
+        permille[i] = span ? (uint16_t)((uint64_t)(tasks[i].ulRunTimeCounter - prev) * 1000 / span) : 0;
+    }
+    for (int j = 0; j < CPU_PREV_MAX; j++) {
+        s_cpu_prev[j].task = j < (int)n ? tasks[j].xHandle : NULL;
+        s_cpu_prev[j].runtime = j < (int)n ? tasks[j].ulRunTimeCounter : 0;
+    }
+    s_cpu_prev_total = total;
+    xSemaphoreGive(s_cpu_lock);
+}
+#endif
+
+/* Smallest free stack each task has had, in bytes (IDF stacks are byte-sized);
+   with run-time stats also the CPU time each task used */
+static void collect_tasks(metrics_emit_fn emit, void *ctx)
+{
+    UBaseType_t n = uxTaskGetNumberOfTasks() + 2;   /* room for tasks created meanwhile */
+    TaskStatus_t *tasks = malloc(n * (sizeof(*tasks) + sizeof(uint16_t)));
+    if (!tasks) return;
+
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+    runtime_t total;
+    uint16_t *permille = (uint16_t *)(tasks + n);
+    n = uxTaskGetSystemState(tasks, n, &total);
+    cpu_shares(tasks, n, total, permille);
+#else
+    n = uxTaskGetSystemState(tasks, n, NULL);
+#endif
+    emit("task_count", n, ctx);
+    for (UBaseType_t i = 0; i < n; i++) {
+        /* Names are not unique (several "httpd" in AP mode); the task number is */
+        char labels[48], name[96];
+        snprintf(labels, sizeof(labels), "task=\"%s\",num=\"%u\"",
+                 tasks[i].pcTaskName, (unsigned)tasks[i].xTaskNumber);
+        snprintf(name, sizeof(name), "task_stack_free_min_bytes{%s}", labels);
+        emit(name, tasks[i].usStackHighWaterMark, ctx);
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+        snprintf(name, sizeof(name), "task_cpu_runtime_us_total{%s}", labels);
+        emit(name, tasks[i].ulRunTimeCounter, ctx);
+        snprintf(name, sizeof(name), "task_cpu_share_permille{%s}", labels);
+        emit(name, permille[i], ctx);
+#endif
+    }
+    free(tasks);
+}
+
+static metric_collector_t s_task_collector = { .collect = collect_tasks };
+#endif
+
+void metrics_init(void)
+{
+#if CONFIG_FREERTOS_USE_TRACE_FACILITY
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+    static StaticSemaphore_t lock_buf;
+    s_cpu_lock = xSemaphoreCreateMutexStatic(&lock_buf);
+#endif
+    metrics_register_collector(&s_task_collector);
+#endif
+    metrics_register(&s_uptime);
+    metrics_register(&s_heap_block);
+    metrics_register(&s_heap_min);
+    metrics_register(&s_heap_free);
+}
+
+void metrics_register(metric_t *m)
+{
+    metric_t *head = __atomic_load_n(&s_head, __ATOMIC_RELAXED);
+    do {
+        m->next = head;
+    } while (!__atomic_compare_exchange_n(&s_head, &head, m, true,
+                                          __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+void metrics_register_collector(metric_collector_t *c)
+{
+    metric_collector_t *head = __atomic_load_n(&s_collectors, __ATOMIC_RELAXED);
+    do {
+        c->next = head;
+    } while (!__atomic_compare_exchange_n(&s_collectors, &head, c, true,
+                                          __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+void metrics_collect(metrics_emit_fn emit, void *ctx)
+{
+    for (const metric_collector_t *c = __atomic_load_n(&s_collectors, __ATOMIC_ACQUIRE); c; c = c->next) {
+        c->collect(emit, ctx);
+    }
+}
+
+void metrics_foreach(void (*cb)(const metric_t *m, void *ctx), void *ctx)
+{
+    for (const metric_t *m = __atomic_load_n(&s_head, __ATOMIC_ACQUIRE); m; m = m->next) {
+        cb(m, ctx);
+    }
+}
+
+int64_t metric_value(const metric_t *m)
+{
+    if (m->read) return m->read(m->arg);
+    uint32_t v = __atomic_load_n(&m->value, __ATOMIC_RELAXED);
+    return (m->type == METRIC_GAUGE) ? (int64_t)(int32_t)v : (int64_t)v;
+}
+
+void metric_observe(metric_t *m, uint32_t v)
+{
+    int bucket = v ? 32 - __builtin_clz(v) : 0;   /* first power of two > v */
+    if (bucket >= METRICS_HIST_BUCKETS) bucket = METRICS_HIST_BUCKETS - 1;
+    __atomic_fetch_add(&m->hist[bucket], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&m->sum, v, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&m->count, 1, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Maximum number of sockets watched at once
+ */
+#define NET_LOOP_MAX_FDS 8
+
+/**
+ * @brief Called on the loop task when `fd` is readable. Must not block:
+ *        sockets handed to the loop should be non-blocking.
+ */
+typedef void (*net_loop_readable_fn)(int fd, void *arg);
+
+/**
+ * @brief Start the shared network task: one select() over every registered
+ *        socket plus an eventfd to wake it when the set changes.
+ *
+ * Call once at boot, after esp_netif_init().
+ */
+esp_err_t net_loop_start(void);
+
+/**
+ * @brief Watch `fd` for reads. The loop takes ownership of the socket.
+ *
+ * @return ESP_ERR_NO_MEM when NET_LOOP_MAX_FDS sockets are registered,
+ *         ESP_ERR_INVALID_STATE before net_loop_start()
+ */
+esp_err_t net_loop_add(int fd, net_loop_readable_fn on_readable, void *arg);
+
+/**
+ * @brief Stop watching `fd` and close it on the loop task
+ *
+ * Returns immediately. `done(arg)` runs on the loop task once the socket is
+ * closed and no callback for it can run any more, so it may free `arg`.
+ */
+esp_err_t net_loop_close(int fd, void (*done)(void *arg));
+
+#ifdef __cplusplus
+}
+#endif
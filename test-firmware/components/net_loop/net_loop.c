@@ -0,0 +1,184 @@
+#include "net_loop.h"
+#include "metrics.h"
+#include "esp_log.h"
+#include "esp_vfs_eventfd.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "lwip/sockets.h"
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <unistd.h>
+
+static const char *TAG = "net_loop";
+
+#define LOOP_STACK          4096
+#define LOOP_PRIO           5
+#define SELECT_ERR_BACKOFF  pdMS_TO_TICKS(100)
+
+typedef struct {
+    int fd;                         /* -1 when the slot is free */
+    net_loop_readable_fn on_readable;
+    void *arg;
+    void (*done)(void *arg);
+    bool closing;
+} net_loop_entry_t;
+
+static net_loop_entry_t s_entries[NET_LOOP_MAX_FDS];
+static SemaphoreHandle_t s_lock;
+static int s_wake_fd = -1;
+
+static int32_t read_fds(void *arg)
+{
+    int32_t n = 0;
+    for (int i = 0; i < NET_LOOP_MAX_FDS; i++) {
+        if (s_entries[i].fd >= 0 && !s_entries[i].closing) n++;
+    }
+    return n;
+}
+
+static metric_t s_m_wakeups = METRIC_COUNTER_INIT("net_loop_wakeups_total");
+static metric_t s_m_errors = METRIC_COUNTER_INIT("net_loop_select_errors_total");
+static metric_t s_m_fds = METRIC_GAUGE_FN_INIT("net_loop_fds", read_fds, NULL);
+
+static void loop_wake(void)
+{
+    uint64_t one = 1;
+    write(s_wake_fd, &one, sizeof(one));
+}
+
+/* Close sockets marked by net_loop_close() and collect the rest into `set`.
+   Runs on the loop task only, so a callback never sees its socket vanish. */
+static int loop_prepare(fd_set *set)
+{
+    void (*done[NET_LOOP_MAX_FDS])(void *);
+    void *done_arg[NET_LOOP_MAX_FDS];
+    int n_done = 0;
+    int max_fd = s_wake_fd;
+
+    FD_ZERO(set);
+    FD_SET(s_wake_fd, set);
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (int i = 0; i < NET_LOOP_MAX_FDS; i++) {
+        net_loop_entry_t *e = &s_entries[i];
+        if (e->fd < 0) continue;
+        if (e->closing) {
+            close(e->fd);
+            if (e->done) {
+                done[n_done] = e->done;
+                done_arg[n_done++] = e->arg;
+            }
+            *e = (net_loop_entry_t){ .fd = -1 };
+            continue;
+        }
+        FD_SET(e->fd, set);
+        if (e->fd > max_fd) max_fd = e->fd;
+    }
+    xSemaphoreGive(s_lock);
+
+    for (int i = 0; i < n_done; i++) {
+        done[i](done_arg[i]);
+    }
+    return max_fd;
+}
+
+static void loop_task(void *arg)
+{
+    fd_set set;
+
+    while (1) {
+        int max_fd = loop_prepare(&set);
+        int n = select(max_fd + 1, &set, NULL, NULL, NULL);
+        if (n < 0) {
+            /* Should not happen with sockets we own; never spin on it */
+            metric_inc(&s_m_errors);
+            ESP_LOGW(TAG, "select failed: errno %d", errno);
+            vTaskDelay(SELECT_ERR_BACKOFF);
+            continue;
+        }
+        metric_inc(&s_m_wakeups);
+
+        if (FD_ISSET(s_wake_fd, &set)) {
+            uint64_t count;
+            read(s_wake_fd, &count, sizeof(count));
+        }
+        for (int i = 0; i < NET_LOOP_MAX_FDS; i++) {
+            /* Slots only change under the lock from other tasks, and are
+               freed only in loop_prepare(), so this snapshot stays valid */
+            xSemaphoreTake(s_lock, portMAX_DELAY);
+            net_loop_entry_t e = s_entries[i];
+            xSemaphoreGive(s_lock);
+            if (e.fd >= 0 && !e.closing && FD_ISSET(e.fd, &set)) {
+                e.on_readable(e.fd, e.arg);
+            }
+        }
+    }
+}
+
+esp_err_t net_loop_start(void)
+{
+    if (s_lock) return ESP_OK;
+
+    esp_vfs_eventfd_config_t cfg = ESP_VFS_EVENTD_CONFIG_DEFAULT();
+    esp_err_t err = esp_vfs_eventfd_register(&cfg);
+    if (err != ESP_OK && err != ESP_ERR_INVALID_STATE) return err;   /* already registered is fine */
+
+    s_wake_fd = eventfd(0, 0);
+    if (s_wake_fd < 0) return ESP_FAIL;
+
+    for (int i = 0; i < NET_LOOP_MAX_FDS; i++) {
+        s_entries[i].fd = -1;
+    }
+    s_lock = xSemaphoreCreateMutex();
+    if (!s_lock) return ESP_ERR_NO_MEM;
+
+    if (xTaskCreate(loop_task, "net_loop", LOOP_STACK, NULL, LOOP_PRIO, NULL) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    metrics_register(&s_m_wakeups);
+    metrics_register(&s_m_errors);
+    metrics_register(&s_m_fds);
+    return ESP_OK;
+}
+
+esp_err_t net_loop_add(int fd, net_loop_readable_fn on_readable, void *arg)
+{
+    if (!s_lock) return ESP_ERR_INVALID_STATE;
+    if (fd < 0 || !on_readable) return ESP_ERR_INVALID_ARG;
+
+    esp_err_t err = ESP_ERR_NO_MEM;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (int i = 0; i < NET_LOOP_MAX_FDS; i++) {
+        if (s_entries[i].fd < 0) {
+            s_entries[i] = (net_loop_entry_t){ .fd = fd, .on_readable = on_readable, .arg = arg };
+            err = ESP_OK;
+            break;
+        }
+    }
+    xSemaphoreGive(s_lock);
+
+    if (err == ESP_OK) loop_wake();
+    return err;
+}
+
+esp_err_t net_loop_close(int fd, void (*done)(void *arg))
+{
+    if (!s_lock) return ESP_ERR_INVALID_STATE;
+
+    esp_err_t err = ESP_ERR_NOT_FOUND;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (int i = 0; i < NET_LOOP_MAX_FDS; i++) {
+        if (s_entries[i].fd == fd && !s_entries[i].closing) {
+            s_entries[i].closing = true;
+            s_entries[i].done = done;
+            err = ESP_OK;
+            break;
+        }
+    }
+    xSemaphoreGive(s_lock);
+
+    if (err == ESP_OK) loop_wake();
+    return err;
+}
@@ -1,61 +1,180 @@
 #include "esp_log.h"
 #include "esp_netif.h"
 #include "esp_event.h"
+#include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "boot_seq.h"
 #include "nvs_store.h"
 #include "udp_log.h"
+#include "net_loop.h"
 #include "wifi_prov.h"
 #include "ble_nus.h"
+#include "ble_bench.h"
+#include "coex_policy.h"
+#include "power_profile.h"
+#include "time_sync.h"
+#include "profiler.h"
+#include "ota_update.h"
 #include "http_server.h"
+#include "metrics.h"
+#include <stdio.h>
+#include <time.h>
 
 static const char *TAG = "app_main";
 
 #define FW_VERSION "0.1.0"
 
+/* Logs a line and returns the delay to the next one. How late it runs
+   against that delay is the wake-up latency of the active power profile. */
+static uint32_t heartbeat(void)
+{
+    static uint32_t tick = 0;
+    static int64_t due_us = 0;
+
+    int64_t now = esp_timer_get_time();
+    if (due_us && now > due_us) power_profile_observe_wake((uint32_t)(now - due_us));
+
+    char utc[32] = "unsynced";
+    int64_t unix_us;
+    if (time_sync_to_unix_us(now, &unix_us)) {
+        time_t secs = unix_us / 1000000;
+        struct tm tm;
+        gmtime_r(&secs, &tm);
+        size_t n = strftime(utc, sizeof(utc), "%Y-%m-%dT%H:%M:%S", &tm);
+        snprintf(utc + n, sizeof(utc) - n, ".%06ldZ", (long)(unix_us % 1000000));
+    }
+    ESP_LOGI(TAG, "heartbeat %"PRIu32" | wifi=%d ble=%d | %s",
+             tick++, wifi_prov_is_connected(), ble_nus_is_connected(), utc);
+
+    uint32_t ms = power_profile_heartbeat_ms();
+    due_us = now + ms * 1000LL;
+    return ms;
+}
+
+#if CONFIG_WB_MEM_CONSOLIDATED
+static esp_timer_handle_t s_heartbeat_timer;
+
+/* Runs on the esp_timer task, which exists anyway */
+static void heartbeat_timer_cb(void *arg)
+{
+    esp_timer_start_once(s_heartbeat_timer, heartbeat() * 1000ULL);
+}
+
+static void heartbeat_start(void)
+{
+    static const esp_timer_create_args_t args = {
+        .callback = heartbeat_timer_cb, .name = "heartbeat"
+    };
+    if (esp_timer_create(&args, &s_heartbeat_timer) != ESP_OK ||
+        esp_timer_start_once(s_heartbeat_timer, heartbeat() * 1000ULL) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start heartbeat timer");
+    }
+}
+#else
 static void heartbeat_task(void *arg)
 {
-    uint32_t tick = 0;
     while (1) {
-        ESP_LOGI(TAG, "heartbeat %"PRIu32" | wifi=%d ble=%d",
-                 tick++, wifi_prov_is_connected(), ble_nus_is_connected());
-        vTaskDelay(pdMS_TO_TICKS(10000));
+        vTaskDelay(pdMS_TO_TICKS(heartbeat()));
     }
 }
 
-void app_main(void)
+static void heartbeat_start(void)
 {
-    ESP_LOGI(TAG, "=== Workbench Test Firmware v%s ===", FW_VERSION);
+    xTaskCreate(heartbeat_task, "heartbeat", 4096, NULL, 1, NULL);
+}
+#endif
 
-    /* 1. NVS */
-    nvs_store_init();
+/* ── Boot stages ───────────────────────────────────────────────── */
 
-    /* 2. Network stack — must be up before UDP logging */
-    ESP_ERROR_CHECK(esp_netif_init());
-    ESP_ERROR_CHECK(esp_event_loop_create_default());
+static esp_err_t stage_nvs(void)
+{
+    return nvs_store_init();
+}
 
-    /* 3. UDP debug logging — captures all subsequent logs */
-    udp_log_init("192.168.0.87", 5555);
+/* Network stack, default event loop, shared select() task (captive DNS) */
+static esp_err_t stage_netif(void)
+{
+    esp_err_t err = esp_netif_init();
+    if (err == ESP_OK) err = esp_event_loop_create_default();
+    if (err == ESP_OK) err = net_loop_start();
+    return err;
+}
 
-    /* 4. WiFi — STA (stored creds) or AP (captive portal) */
-    wifi_prov_init();
+/* Debug log stream (UDP unless another target is stored) — captures all logs from here on */
+static esp_err_t stage_log(void)
+{
+    return udp_log_init("192.168.0.87", 5555);
+}
 
-    /* 5. In STA mode, wait for WiFi before starting BLE to avoid coexistence
-     *    conflicts during association. In AP mode, start BLE immediately. */
-    if (!wifi_prov_is_ap_mode()) {
-        ESP_LOGI(TAG, "Waiting for WiFi STA connection before starting BLE...");
-        for (int i = 0; i < 150 && !wifi_prov_is_connected(); i++)
-            vTaskDelay(pdMS_TO_TICKS(100));   /* up to 15s */
-    }
+/* WiFi — STA (stored creds) or AP (captive portal); signals BOOT_WIFI_READY.
+   The stored power profile applies once the driver runs. */
+static esp_err_t stage_wifi(void)
+{
+    esp_err_t err = power_profile_init();
+    if (err == ESP_OK) err = wifi_prov_init();
+    if (err == ESP_OK) err = power_profile_start();
+    return err;
+}
 
-    /* 6. BLE — NUS advertisement (no command handler) */
-    ble_nus_init();
+/* BLE — NUS advertisement, link benchmark on the RX characteristic,
+   coexistence policy once both radios are up */
+static esp_err_t stage_ble(void)
+{
+    esp_err_t err = ble_nus_init();
+    if (err == ESP_OK) err = ble_bench_init();
+    if (err == ESP_OK) err = coex_policy_start();
+    return err;
+}
 
-    /* 7. HTTP server — /status, /ota, /wifi-reset */
-    http_server_start();
+/* SNTP against the log target host, so log records carry Unix time */
+static esp_err_t stage_time(void)
+{
+    return time_sync_start();
+}
 
-    /* 8. Heartbeat — periodic log to confirm firmware is alive */
-    xTaskCreate(heartbeat_task, "heartbeat", 4096, NULL, 1, NULL);
+#if CONFIG_WB_PROFILER
+/* PC sampler, streamed out with the logs (profiling build only) */
+static esp_err_t stage_prof(void)
+{
+    return profiler_start();
+}
+#endif
+
+/* HTTP server — /status, /metrics, /ota, /wifi-reset */
+static esp_err_t stage_http(void)
+{
+    ota_update_init();
+    return http_server_start();
+}
+
+/* Each stage starts as soon as what it needs is ready. BLE waits for the
+   STA to associate (or the AP to come up) to avoid coexistence conflicts
+   during association, but no longer than 15 s. */
+static const boot_stage_t s_boot_stages[] = {
+    { "nvs",   stage_nvs,   0,                              BOOT_NVS },
+    { "netif", stage_netif, 0,                              BOOT_NETIF },
+    { "log",   stage_log,   BOOT_NVS | BOOT_NETIF,          BOOT_LOG },
+    { "wifi",  stage_wifi,  BOOT_NVS | BOOT_NETIF,          BOOT_WIFI_STARTED },
+    { "ble",   stage_ble,   BOOT_NVS | BOOT_WIFI_READY,     BOOT_BLE, 15000 },
+    { "http",  stage_http,  BOOT_NETIF | BOOT_WIFI_STARTED, BOOT_HTTP },
+    { "time",  stage_time,  BOOT_LOG | BOOT_WIFI_STARTED,   BOOT_TIME },
+#if CONFIG_WB_PROFILER
+    { "prof",  stage_prof,  BOOT_LOG,                       0 },
+#endif
+};
+
+void app_main(void)
+{
+    ESP_LOGI(TAG, "=== Workbench Test Firmware v%s ===", FW_VERSION);
+
+    /* Metrics registry first: every stage registers into it */
+    metrics_init();
+
+    boot_seq_run(s_boot_stages, sizeof(s_boot_stages) / sizeof(s_boot_stages[0]));
+
+    /* Heartbeat — periodic log to confirm firmware is alive */
+    heartbeat_start();
 
     ESP_LOGI(TAG, "Init complete, running event-driven");
 }
@@ -0,0 +1,351 @@
+#include "ble_bench.h"
+
+#if CONFIG_WB_BLE_BENCH
+
+#include "ble_nus.h"
+#include "metrics.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *TAG = "ble_bench";
+
+#define BENCH_CMD_MAX       48
+#define BENCH_MS_DEFAULT    5000
+#define BENCH_MS_MAX        60000
+#define BENCH_LAT_MAX       1000        /* pings per !lat, bounds s_rtt */
+#define BENCH_PING_LEN      8
+#define BENCH_PING_MAX      244         /* one LL data PDU at MTU 247 */
+#define BENCH_PING_TMO_MS   1000
+#define BENCH_ITVL_TMO_MS   3000        /* wait for the central to apply an interval */
+#define BENCH_FILL          0xA5        /* never '#', so reports stay parseable */
+
+typedef enum {
+    BENCH_IDLE,
+    BENCH_TX,
+    BENCH_RX,
+    BENCH_LAT,
+} bench_mode_t;
+
+typedef struct {
+    char line[BENCH_CMD_MAX];
+} bench_cmd_t;
+
+static QueueHandle_t s_cmd_q;
+static TaskHandle_t s_task;
+static volatile bench_mode_t s_mode;
+static volatile bool s_running;     /* a command is being run */
+static volatile bool s_abort;
+
+/* Outstanding ping, matched against the echo in the RX handler */
+static volatile uint32_t s_ping_seq;
+static volatile int64_t s_ping_sent_us;
+static volatile uint32_t s_ping_rtt_us;
+
+static uint32_t s_rtt[BENCH_LAT_MAX];
+
+static metric_t s_m_runs = METRIC_COUNTER_INIT("ble_bench_runs_total");
+static metric_t s_m_rtt = METRIC_HISTOGRAM_INIT("ble_bench_rtt_us");
+
+/* ── Reporting ─────────────────────────────────────────────────── */
+
+static void bench_report(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+
+static void bench_report(const char *fmt, ...)
+{
+    char buf[384];
+    buf[0] = '#';
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(buf + 1, sizeof(buf) - 2, fmt, ap);
+    va_end(ap);
+    if (n < 0) return;
+    if (n > (int)sizeof(buf) - 3) n = sizeof(buf) - 3;
+
+    ESP_LOGI(TAG, "%s", buf + 1);
+    buf[1 + n] = '\n';
+    ble_nus_send(buf, n + 2, pdMS_TO_TICKS(1000));
+}
+
+static unsigned us_to_ms(int64_t us)
+{
+    return (unsigned)(us / 1000);
+}
+
+/* ── Tests ─────────────────────────────────────────────────────── */
+
+/* Notify filler bytes for `ms`, then wait for the queue to drain so the
+   byte count covers data that actually left the stack. */
+static void bench_tx(const char *test, uint32_t ms, bool done)
+{
+    static uint8_t fill[512];
+    memset(fill, BENCH_FILL, sizeof(fill));
+
+    ble_nus_link_t a, b;
+    ble_nus_get_link(&a);
+    s_mode = BENCH_TX;
+
+    int64_t start = esp_timer_get_time();
+    int64_t deadline = start + (int64_t)ms * 1000;
+    while (!s_abort && esp_timer_get_time() < deadline) {
+        if (ble_nus_send(fill, sizeof(fill), pdMS_TO_TICKS(20)) == 0 && !ble_nus_is_connected()) {
+            break;
+        }
+    }
+    while (ble_nus_tx_queued() && esp_timer_get_time() < deadline + 2000000) {
+        vTaskDelay(1);
+    }
+    int64_t dur = esp_timer_get_time() - start;
+    ble_nus_get_link(&b);
+    s_mode = BENCH_IDLE;
+
+    uint32_t bytes = b.tx_bytes - a.tx_bytes;
+    uint32_t pkts = b.tx_notifications - a.tx_notifications;
+    uint32_t itvl_us = b.conn_itvl * 1250;
+    uint32_t per_itvl = dur > 0 ? (uint32_t)((uint64_t)pkts * itvl_us * 100 / dur) : 0;
+
+    bench_report("{\"test\":\"%s\",\"ms\":%u,\"bytes\":%" PRIu32 ",\"bps\":%" PRIu32
+                 ",\"notifications\":%" PRIu32 ",\"per_interval\":%" PRIu32 ".%02" PRIu32
+                 ",\"stalls\":%" PRIu32 ",\"mtu\":%u,\"itvl_us\":%" PRIu32
+                 "%s,\"done\":%s}",
+                 test, us_to_ms(dur), bytes,
+                 dur > 0 ? (uint32_t)((uint64_t)bytes * 1000000 / dur) : 0,
+                 pkts, per_itvl / 100, per_itvl % 100, b.tx_stalls - a.tx_stalls,
+                 b.mtu, itvl_us, s_abort ? ",\"aborted\":true" : "",
+                 done ? "true" : "false");
+}
+
+/* Count what the central writes for `ms`; the RX handler swallows it */
+static void bench_rx(uint32_t ms)
+{
+    ble_nus_link_t a, b;
+    ble_nus_get_link(&a);
+    s_mode = BENCH_RX;
+
+    int64_t start = esp_timer_get_time();
+    int64_t deadline = start + (int64_t)ms * 1000;
+    while (!s_abort && ble_nus_is_connected() && esp_timer_get_time() < deadline) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    int64_t dur = esp_timer_get_time() - start;
+    ble_nus_get_link(&b);
+    s_mode = BENCH_IDLE;
+
+    uint32_t bytes = b.rx_bytes - a.rx_bytes;
+    bench_report("{\"test\":\"rx\",\"ms\":%u,\"bytes\":%" PRIu32 ",\"bps\":%" PRIu32
+                 ",\"mtu\":%u,\"itvl_us\":%u%s,\"done\":true}",
+                 us_to_ms(dur), bytes,
+                 dur > 0 ? (uint32_t)((uint64_t)bytes * 1000000 / dur) : 0,
+                 b.mtu, b.conn_itvl * 1250, s_abort ? ",\"aborted\":true" : "");
+}
+
+static int cmp_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+/* Same bucket layout as METRIC_HISTOGRAM: bucket i counts samples < 2^i */
+static int hist_bucket(uint32_t v)
+{
+    int i = 0;
+    while (i < METRICS_HIST_BUCKETS - 1 && v >= (1u << i)) i++;
+    return i;
+}
+
+/* Ping-pong round trips: one notification out, the central's write back */
+static void bench_lat(uint32_t count, uint32_t len)
+{
+    uint8_t ping[BENCH_PING_MAX];
+    uint32_t hist[METRICS_HIST_BUCKETS] = { 0 };
+    uint32_t got = 0, lost = 0;
+    uint64_t sum = 0;
+
+    /* One ping per notification, so the echo is a single write */
+    uint32_t max = ble_nus_mtu() - 3;
+    if (max > sizeof(ping)) max = sizeof(ping);
+    if (len > max) len = max;
+    memset(ping, 0, len);
+    ping[0] = 'P';
+
+    s_mode = BENCH_LAT;
+    for (uint32_t seq = 1; seq <= count && !s_abort && ble_nus_is_connected(); seq++) {
+        memcpy(ping + 1, &seq, sizeof(seq));
+        ulTaskNotifyTake(pdTRUE, 0);
+        s_ping_seq = seq;
+        s_ping_sent_us = esp_timer_get_time();
+        ble_nus_send(ping, len, pdMS_TO_TICKS(BENCH_PING_TMO_MS));
+
+        if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(BENCH_PING_TMO_MS)) == 0) {
+            lost++;
+            continue;
+        }
+        uint32_t rtt = s_ping_rtt_us;
+        s_rtt[got++] = rtt;
+        sum += rtt;
+        hist[hist_bucket(rtt)]++;
+        metric_observe(&s_m_rtt, rtt);
+    }
+    s_ping_seq = 0;
+    s_mode = BENCH_IDLE;
+
+    ble_nus_link_t link;
+    ble_nus_get_link(&link);
+
+    uint32_t p50 = 0, p99 = 0, lo = 0, hi = 0;
+    if (got) {
+        qsort(s_rtt, got, sizeof(s_rtt[0]), cmp_u32);
+        lo = s_rtt[0];
+        hi = s_rtt[got - 1];
+        p50 = s_rtt[(got - 1) / 2];
+        p99 = s_rtt[(got - 1) * 99 / 100];
+    }
+
+    char hbuf[METRICS_HIST_BUCKETS * 11 + 1];
+    int h = 0;
+    for (int i = 0; i < METRICS_HIST_BUCKETS; i++) {
+        h += snprintf(hbuf + h, sizeof(hbuf) - h, "%s%" PRIu32, i ? "," : "", hist[i]);
+    }
+
+    bench_report("{\"test\":\"lat\",\"count\":%" PRIu32 ",\"lost\":%" PRIu32 ",\"len\":%" PRIu32
+                 ",\"min_us\":%" PRIu32 ",\"avg_us\":%" PRIu32 ",\"p50_us\":%" PRIu32
+                 ",\"p99_us\":%" PRIu32 ",\"max_us\":%" PRIu32 ",\"hist_pow2_us\":[%s]"
+                 ",\"itvl_us\":%u%s,\"done\":true}",
+                 got, lost, len, lo, got ? (uint32_t)(sum / got) : 0, p50, p99, hi, hbuf,
+                 link.conn_itvl * 1250, s_abort ? ",\"aborted\":true" : "");
+}
+
+/* Bulk TX at each connection interval the central agrees to */
+static void bench_sweep(uint32_t ms)
+{
+    static const uint16_t itvls[] = { 6, 12, 24, 40 };     /* 7.5, 15, 30, 50 ms */
+    const size_t n = sizeof(itvls) / sizeof(itvls[0]);
+
+    ble_nus_link_t link;
+    ble_nus_get_link(&link);
+    uint16_t orig = link.conn_itvl;
+
+    size_t i;
+    for (i = 0; i < n && !s_abort && ble_nus_is_connected(); i++) {
+        if (ble_nus_request_conn_itvl(itvls[i], itvls[i]) == ESP_OK) {
+            for (int t = 0; t < BENCH_ITVL_TMO_MS / 50; t++) {
+                ble_nus_get_link(&link);
+                if (link.conn_itvl == itvls[i]) break;
+                vTaskDelay(pdMS_TO_TICKS(50));
+            }
+        }
+        if (link.conn_itvl != itvls[i]) {
+            ESP_LOGW(TAG, "Central kept interval %u (asked %u)", link.conn_itvl, itvls[i]);
+        }
+        bench_tx("sweep", ms, i == n - 1);
+    }
+    if (i < n) {
+        /* Cut short before the last interval's report: close the command */
+        bench_report("{\"test\":\"sweep\",\"intervals\":%u,\"error\":\"%s\",\"done\":true}",
+                     (unsigned)i, s_abort ? "aborted" : "disconnected");
+    }
+    if (orig) ble_nus_request_conn_itvl(orig, orig);
+}
+
+/* ── Command dispatch ──────────────────────────────────────────── */
+
+static void bench_run(const char *line)
+{
+    char cmd[8];
+    unsigned long a = 0, b = 0;
+    int n = sscanf(line, "!%7s %lu %lu", cmd, &a, &b);
+    if (n < 1) return;
+
+    uint32_t ms = (n >= 2 && a) ? a : BENCH_MS_DEFAULT;
+    if (ms > BENCH_MS_MAX) ms = BENCH_MS_MAX;
+
+    s_abort = false;
+    s_running = true;
+    metric_inc(&s_m_runs);
+    ESP_LOGI(TAG, "Running: %s", line);
+
+    if (strcmp(cmd, "tx") == 0) {
+        bench_tx("tx", ms, true);
+    } else if (strcmp(cmd, "rx") == 0) {
+        bench_rx(ms);
+    } else if (strcmp(cmd, "lat") == 0) {
+        uint32_t count = (n >= 2 && a) ? a : 100;
+        if (count > BENCH_LAT_MAX) count = BENCH_LAT_MAX;
+        bench_lat(count, (n >= 3 && b >= 5) ? b : BENCH_PING_LEN);
+    } else if (strcmp(cmd, "sweep") == 0) {
+        bench_sweep(ms);
+    } else if (strcmp(cmd, "stop") != 0) {
+        bench_report("{\"error\":\"unknown command\",\"done\":true}");
+    }
+    s_running = false;
+}
+
+static void bench_task(void *arg)
+{
+    bench_cmd_t cmd;
+    while (1) {
+        if (xQueueReceive(s_cmd_q, &cmd, portMAX_DELAY) == pdTRUE) {
+            bench_run(cmd.line);
+        }
+    }
+}
+
+/* NimBLE host task: must not block */
+static void bench_rx_cb(const uint8_t *data, size_t len)
+{
+    if (len > 1 && data[0] == '!') {
+        bench_cmd_t cmd;
+        size_t n = len < sizeof(cmd.line) - 1 ? len : sizeof(cmd.line) - 1;
+        memcpy(cmd.line, data, n);
+        cmd.line[n] = '\0';
+        if (s_running) s_abort = true;      /* a new command (or !stop) ends the running one */
+        if (xQueueSend(s_cmd_q, &cmd, 0) != pdTRUE) {
+            ESP_LOGW(TAG, "Busy, dropped: %s", cmd.line);
+        }
+        return;
+    }
+
+    switch (s_mode) {
+    case BENCH_LAT: {
+        uint32_t seq;
+        if (len < 1 + sizeof(seq) || data[0] != 'P') return;
+        memcpy(&seq, data + 1, sizeof(seq));
+        if (seq == s_ping_seq) {
+            s_ping_rtt_us = (uint32_t)(esp_timer_get_time() - s_ping_sent_us);
+            xTaskNotifyGive(s_task);
+        }
+        return;
+    }
+    case BENCH_RX:
+        return;     /* counted by ble_nus */
+    default:
+#if CONFIG_WB_BLE_NUS_ECHO
+        ble_nus_send(data, len, 0);
+#endif
+        return;
+    }
+}
+
+esp_err_t ble_bench_init(void)
+{
+    metrics_register(&s_m_runs);
+    metrics_register(&s_m_rtt);
+
+    s_cmd_q = xQueueCreate(2, sizeof(bench_cmd_t));
+    if (!s_cmd_q) return ESP_ERR_NO_MEM;
+    if (xTaskCreate(bench_task, "ble_bench", 4096, NULL, 4, &s_task) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    ble_nus_set_rx_cb(bench_rx_cb);
+    ESP_LOGI(TAG, "BLE benchmark ready (write !tx, !rx, !lat, !sweep to RX)");
+    return ESP_OK;
+}
+
+#endif /* CONFIG_WB_BLE_BENCH */
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "esp_err.h"
+#include "sdkconfig.h"
+
+/* BLE link benchmark, driven over the NUS characteristics.
+ *
+ * The central writes an ASCII command to RX; anything else keeps being
+ * echoed. Each test reports one line on TX: '#', a JSON object, '\n'.
+ * The last report of a command carries "done":true, also when it was
+ * cut short ("aborted":true, or a sweep's "error").
+ *
+ *   !tx <ms>            bulk notifications for <ms>; payload bytes are 0xA5
+ *   !rx <ms>            count bytes the central writes during <ms>
+ *   !lat <count> [len]  <count> pings 'P' <u32 seq> <pad to len>; the
+ *                       central writes each one back unchanged
+ *   !sweep <ms>         !tx at 7.5, 15, 30 and 50 ms connection intervals
+ *   !stop               abort the running test; any other command also
+ *                       aborts it, then runs
+ */
+
+#if CONFIG_WB_BLE_BENCH
+/**
+ * @brief Take over the NUS RX handler and start the benchmark task
+ */
+esp_err_t ble_bench_init(void);
+#else
+static inline esp_err_t ble_bench_init(void) { return ESP_OK; }
+#endif
@@ -1,9 +1,18 @@
 #include "ble_nus.h"
+#include "boot_seq.h"
+#include "power_profile.h"
 
 #if CONFIG_BT_ENABLED
 
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "metrics.h"
+#include "wb_event.h"
 #include "nvs_flash.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/stream_buffer.h"
+#include "freertos/task.h"
 #include "nimble/nimble_port.h"
 #include "nimble/nimble_port_freertos.h"
 #include "host/ble_hs.h"
@@ -29,13 +38,145 @@ static const ble_uuid128_t nus_tx_chr_uuid =
     BLE_UUID128_INIT(0x9e, 0xca, 0xdc, 0x24, 0x0e, 0xe5, 0xa9, 0xe0,
                      0x93, 0xf3, 0xa3, 0xb5, 0x03, 0x00, 0x40, 0x6e);
 
+/* Throughput-oriented link parameters requested after connecting */
+#define NUS_DATA_LEN_OCTETS     251         /* LL data length extension maximum */
+#define NUS_DATA_LEN_TIME_US    2120
+#define NUS_CONN_ITVL_MIN       BLE_NUS_CONN_ITVL_MIN
+#define NUS_CONN_ITVL_MAX       BLE_NUS_CONN_ITVL_MAX
+#define NUS_SUPERVISION_TMO     400         /* 4 s, in 10 ms units */
+
+#define NUS_TX_CHUNK_MAX        BLE_ATT_ATTR_MAX_LEN   /* 512, max attribute value */
+#define NUS_RATE_INTERVAL_US    1000000
+
 static uint16_t s_tx_attr_handle;
 static uint16_t s_conn_handle = BLE_HS_CONN_HANDLE_NONE;
 static uint8_t s_own_addr_type;
 
+static uint16_t s_mtu = BLE_ATT_MTU_DFLT;
+static uint16_t s_conn_itvl;                /* 1.25 ms units, 0 when disconnected */
+static bool s_notify_enabled;
+
+static StreamBufferHandle_t s_tx_stream;
+static SemaphoreHandle_t s_tx_lock;         /* serialises ble_nus_send() writers */
+static TaskHandle_t s_tx_task;
+static ble_nus_rx_cb_t s_rx_cb;
+
+static int32_t read_ble_connected(void *arg)
+{
+    return s_conn_handle != BLE_HS_CONN_HANDLE_NONE;
+}
+
+static metric_t s_m_connections = METRIC_COUNTER_INIT("ble_connections_total");
+static metric_t s_m_rx_bytes = METRIC_COUNTER_INIT("ble_rx_bytes_total");
+static metric_t s_m_tx_bytes = METRIC_COUNTER_INIT("ble_tx_bytes_total");
+static metric_t s_m_tx_notify = METRIC_COUNTER_INIT("ble_tx_notifications_total");
+static metric_t s_m_mtu = METRIC_GAUGE_INIT("ble_att_mtu");
+static metric_t s_m_connected = METRIC_GAUGE_FN_INIT("ble_connected", read_ble_connected, NULL);
+static metric_t s_m_tx_stalls = METRIC_COUNTER_INIT("ble_tx_stalls_total");
+static metric_t s_m_tx_errors = METRIC_COUNTER_INIT("ble_tx_errors_total");
+static metric_t s_m_tx_rate = METRIC_GAUGE_INIT("ble_tx_bytes_per_second");
+static metric_t s_m_rx_rate = METRIC_GAUGE_INIT("ble_rx_bytes_per_second");
+static metric_t s_m_phy = METRIC_GAUGE_INIT("ble_phy");
+
 /* Forward declarations */
 static int nus_gap_event(struct ble_gap_event *event, void *arg);
 static void nus_advertise(void);
+static void nus_request_fast_link(uint16_t conn_handle);
+
+/* ── Data path ─────────────────────────────────────────────────── */
+
+#if CONFIG_WB_BLE_NUS_ECHO
+static void nus_echo(const uint8_t *data, size_t len)
+{
+    ble_nus_send(data, len, 0);
+}
+#endif
+
+static void nus_tx_kick(void)
+{
+    if (s_tx_task) xTaskNotifyGive(s_tx_task);
+}
+
+/* Push queued bytes out as notifications while mbufs last. Each queued
+   notification holds an msys mbuf until the controller has sent it, so
+   the free count is the flow-control credit. Returns true when stalled. */
+static bool nus_tx_pump(uint8_t *chunk, size_t *pending)
+{
+    while (s_conn_handle != BLE_HS_CONN_HANDLE_NONE && s_notify_enabled) {
+        if (os_msys_num_free() <= CONFIG_WB_BLE_NUS_MSYS_RESERVE) {
+            metric_inc(&s_m_tx_stalls);
+            return true;
+        }
+
+        /* A chunk that failed to go out is retried before reading more */
+        if (*pending == 0) {
+            size_t max = s_mtu - 3;
+            if (max > NUS_TX_CHUNK_MAX) max = NUS_TX_CHUNK_MAX;
+            *pending = xStreamBufferReceive(s_tx_stream, chunk, max, 0);
+            if (*pending == 0) return false;
+        }
+
+        struct os_mbuf *om = ble_hs_mbuf_from_flat(chunk, *pending);
+        if (!om) {
+            metric_inc(&s_m_tx_stalls);
+            return true;
+        }
+        int rc = ble_gatts_notify_custom(s_conn_handle, s_tx_attr_handle, om);  /* consumes om */
+        if (rc == BLE_HS_ENOMEM) {
+            metric_inc(&s_m_tx_stalls);
+            return true;
+        }
+        if (rc != 0) {
+            metric_inc(&s_m_tx_errors);
+        } else {
+            metric_add(&s_m_tx_bytes, *pending);
+            metric_inc(&s_m_tx_notify);
+        }
+        *pending = 0;
+    }
+    return false;
+}
+
+static void nus_tx_task(void *arg)
+{
+    static uint8_t chunk[NUS_TX_CHUNK_MAX];
+    size_t pending = 0;
+    int64_t last_us = esp_timer_get_time();
+    uint32_t last_tx = 0, last_rx = 0;
+    bool stalled = false;
+
+    while (1) {
+        /* Stalled on mbufs: nothing signals their release, so poll each tick */
+        ulTaskNotifyTake(pdTRUE, stalled ? 1 : pdMS_TO_TICKS(100));
+        if (s_conn_handle == BLE_HS_CONN_HANDLE_NONE &&
+            (pending || !xStreamBufferIsEmpty(s_tx_stream))) {
+            /* Drop what was queued for the old connection */
+            xSemaphoreTake(s_tx_lock, portMAX_DELAY);
+            xStreamBufferReset(s_tx_stream);
+            xSemaphoreGive(s_tx_lock);
+            pending = 0;
+        }
+        stalled = nus_tx_pump(chunk, &pending);
+
+        /* Achieved throughput over the last interval */
+        int64_t now = esp_timer_get_time();
+        if (now - last_us >= NUS_RATE_INTERVAL_US) {
+            uint32_t tx = (uint32_t)metric_value(&s_m_tx_bytes);
+            uint32_t rx = (uint32_t)metric_value(&s_m_rx_bytes);
+            uint32_t tx_rate = (uint32_t)((uint64_t)(tx - last_tx) * 1000000 / (now - last_us));
+            uint32_t rx_rate = (uint32_t)((uint64_t)(rx - last_rx) * 1000000 / (now - last_us));
+            metric_set(&s_m_tx_rate, tx_rate);
+            metric_set(&s_m_rx_rate, rx_rate);
+            if (tx_rate || rx_rate) {
+                ESP_LOGI(TAG, "throughput: tx %lu B/s, rx %lu B/s (mtu %u)",
+                         (unsigned long)tx_rate, (unsigned long)rx_rate, s_mtu);
+            }
+            last_tx = tx;
+            last_rx = rx;
+            last_us = now;
+        }
+    }
+}
 
 /* ── GATT access callback ──────────────────────────────────────── */
 
@@ -43,8 +184,13 @@ static int nus_chr_access(uint16_t conn_handle, uint16_t attr_handle,
                           struct ble_gatt_access_ctxt *ctxt, void *arg)
 {
     if (ctxt->op == BLE_GATT_ACCESS_OP_WRITE_CHR) {
-        uint16_t om_len = OS_MBUF_PKTLEN(ctxt->om);
-        ESP_LOGI(TAG, "RX %d bytes from conn=%d (ignored)", om_len, conn_handle);
+        static uint8_t buf[BLE_ATT_ATTR_MAX_LEN];   /* host task only */
+        uint16_t len;
+        if (ble_hs_mbuf_to_flat(ctxt->om, buf, sizeof(buf), &len) != 0) {
+            return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
+        }
+        metric_add(&s_m_rx_bytes, len);
+        if (s_rx_cb) s_rx_cb(buf, len);
         return 0;
     }
     return BLE_ATT_ERR_UNLIKELY;
@@ -114,6 +260,68 @@ static void nus_advertise(void)
                            &adv_params, nus_gap_event, NULL);
     if (rc != 0) {
         ESP_LOGE(TAG, "adv_start failed: %d", rc);
+        return;
+    }
+    boot_seq_mark(BOOT_MARK_BLE_ADV);
+}
+
+/* ── Link parameters ─────────────────────────────────────────── */
+
+static int nus_mtu_cb(uint16_t conn_handle, const struct ble_gatt_error *error,
+                      uint16_t mtu, void *arg)
+{
+    if (error->status != 0) {
+        ESP_LOGW(TAG, "MTU exchange failed: %d", error->status);
+    }
+    return 0;
+}
+
+/* Ask for the largest MTU, LL data length, 2M PHY and a short connection
+   interval. The central may refuse any of them; each outcome is reported
+   through its own GAP event. */
+static void nus_request_fast_link(uint16_t conn_handle)
+{
+    int rc = ble_gattc_exchange_mtu(conn_handle, nus_mtu_cb, NULL);
+    if (rc != 0) ESP_LOGW(TAG, "exchange_mtu failed: %d", rc);
+
+    rc = ble_gap_set_data_len(conn_handle, NUS_DATA_LEN_OCTETS, NUS_DATA_LEN_TIME_US);
+    if (rc != 0) ESP_LOGW(TAG, "set_data_len failed: %d", rc);
+
+#if CONFIG_BT_NIMBLE_50_FEATURE_SUPPORT
+    rc = ble_gap_set_prefered_le_phy(conn_handle, BLE_GAP_LE_PHY_2M_MASK,
+                                     BLE_GAP_LE_PHY_2M_MASK, BLE_GAP_LE_PHY_CODED_ANY);
+    if (rc != 0) ESP_LOGW(TAG, "set_prefered_le_phy failed: %d", rc);
+#else
+    metric_set(&s_m_phy, 1);    /* LE 1M only on BLE 4.2 controllers */
+#endif
+
+    struct ble_gap_upd_params params = {
+        .itvl_min = NUS_CONN_ITVL_MIN,
+        .itvl_max = NUS_CONN_ITVL_MAX,
+        .latency = 0,
+        .supervision_timeout = NUS_SUPERVISION_TMO,
+    };
+    rc = ble_gap_update_params(conn_handle, &params);
+    if (rc != 0) ESP_LOGW(TAG, "update_params failed: %d", rc);
+}
+
+static void nus_post_state(void)
+{
+    wb_event_ble_t ev = {
+        .connected = s_conn_handle != BLE_HS_CONN_HANDLE_NONE,
+        .mtu = s_mtu,
+    };
+    wb_event_post(WB_EVENT_BLE, &ev, sizeof(ev));
+}
+
+static void nus_update_conn_itvl(uint16_t conn_handle)
+{
+    struct ble_gap_conn_desc desc;
+    if (ble_gap_conn_find(conn_handle, &desc) == 0) {
+        s_conn_itvl = desc.conn_itvl;
+        ESP_LOGI(TAG, "Conn params: interval=%d.%02d ms latency=%d timeout=%d ms",
+                 desc.conn_itvl * 125 / 100, desc.conn_itvl * 125 % 100,
+                 desc.conn_latency, desc.supervision_timeout * 10);
     }
 }
 
@@ -125,7 +333,12 @@ static int nus_gap_event(struct ble_gap_event *event, void *arg)
     case BLE_GAP_EVENT_LINK_ESTAB:
         if (event->connect.status == 0) {
             s_conn_handle = event->connect.conn_handle;
+            metric_inc(&s_m_connections);
             ESP_LOGI(TAG, "Connected, handle=%d", s_conn_handle);
+            power_awake_begin(POWER_AWAKE_BLE);     /* connection events need the radio clock */
+            nus_update_conn_itvl(s_conn_handle);
+            nus_request_fast_link(s_conn_handle);
+            nus_post_state();
         } else {
             ESP_LOGW(TAG, "Connection failed, status=%d", event->connect.status);
             nus_advertise();
@@ -134,7 +347,15 @@ static int nus_gap_event(struct ble_gap_event *event, void *arg)
 
     case BLE_GAP_EVENT_DISCONNECT:
         ESP_LOGI(TAG, "Disconnected, reason=%d", event->disconnect.reason);
+        if (s_conn_handle != BLE_HS_CONN_HANDLE_NONE) power_awake_end(POWER_AWAKE_BLE);
         s_conn_handle = BLE_HS_CONN_HANDLE_NONE;
+        s_notify_enabled = false;
+        s_mtu = BLE_ATT_MTU_DFLT;
+        s_conn_itvl = 0;
+        metric_set(&s_m_mtu, 0);
+        metric_set(&s_m_phy, 0);
+        nus_post_state();
+        nus_tx_kick();
         nus_advertise();
         break;
 
@@ -144,10 +365,36 @@ static int nus_gap_event(struct ble_gap_event *event, void *arg)
 
     case BLE_GAP_EVENT_MTU:
         ESP_LOGI(TAG, "MTU updated: %d", event->mtu.value);
+        s_mtu = event->mtu.value;
+        metric_set(&s_m_mtu, event->mtu.value);
+        nus_post_state();
+        break;
+
+    case BLE_GAP_EVENT_CONN_UPDATE:
+        nus_update_conn_itvl(event->conn_update.conn_handle);
+        break;
+
+#ifdef BLE_GAP_EVENT_PHY_UPDATE_COMPLETE
+    case BLE_GAP_EVENT_PHY_UPDATE_COMPLETE:
+        ESP_LOGI(TAG, "PHY updated: tx=%d rx=%d",
+                 event->phy_updated.tx_phy, event->phy_updated.rx_phy);
+        metric_set(&s_m_phy, event->phy_updated.tx_phy);
+        break;
+#endif
+
+#ifdef BLE_GAP_EVENT_DATA_LEN_CHG
+    case BLE_GAP_EVENT_DATA_LEN_CHG:
+        ESP_LOGI(TAG, "Data length: tx=%d rx=%d octets",
+                 event->data_len_chg.max_tx_octets, event->data_len_chg.max_rx_octets);
         break;
+#endif
 
     case BLE_GAP_EVENT_SUBSCRIBE:
         ESP_LOGI(TAG, "Subscribe: cur_notify=%d", event->subscribe.cur_notify);
+        if (event->subscribe.attr_handle == s_tx_attr_handle) {
+            s_notify_enabled = event->subscribe.cur_notify;
+            nus_tx_kick();
+        }
         break;
 
     case BLE_GAP_EVENT_REPEAT_PAIRING: {
@@ -202,6 +449,27 @@ void ble_store_config_init(void);
 
 esp_err_t ble_nus_init(void)
 {
+    metrics_register(&s_m_connections);
+    metrics_register(&s_m_rx_bytes);
+    metrics_register(&s_m_tx_bytes);
+    metrics_register(&s_m_tx_notify);
+    metrics_register(&s_m_mtu);
+    metrics_register(&s_m_connected);
+    metrics_register(&s_m_tx_stalls);
+    metrics_register(&s_m_tx_errors);
+    metrics_register(&s_m_tx_rate);
+    metrics_register(&s_m_rx_rate);
+    metrics_register(&s_m_phy);
+
+    s_tx_stream = xStreamBufferCreate(CONFIG_WB_BLE_NUS_TX_BUF_SIZE, 1);
+    s_tx_lock = xSemaphoreCreateMutex();
+    if (!s_tx_stream || !s_tx_lock) {
+        return ESP_ERR_NO_MEM;
+    }
+#if CONFIG_WB_BLE_NUS_ECHO
+    if (!s_rx_cb) s_rx_cb = nus_echo;
+#endif
+
     esp_err_t ret = nimble_port_init();
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "nimble_port_init failed: %d", ret);
@@ -231,7 +499,13 @@ esp_err_t ble_nus_init(void)
         ESP_LOGW(TAG, "gap_device_name_set failed: %d", rc);
     }
 
+    rc = ble_att_set_preferred_mtu(BLE_ATT_MTU_MAX);
+    if (rc != 0) {
+        ESP_LOGW(TAG, "set_preferred_mtu failed: %d", rc);
+    }
+
     ble_store_config_init();
+    xTaskCreate(nus_tx_task, "nus_tx", 3072, NULL, 5, &s_tx_task);
     nimble_port_freertos_init(nus_host_task);
 
     ESP_LOGI(TAG, "BLE NUS initialized (device: WB-Test)");
@@ -243,4 +517,62 @@ bool ble_nus_is_connected(void)
     return s_conn_handle != BLE_HS_CONN_HANDLE_NONE;
 }
 
+void ble_nus_set_rx_cb(ble_nus_rx_cb_t cb)
+{
+    s_rx_cb = cb;
+}
+
+size_t ble_nus_send(const void *data, size_t len, TickType_t wait)
+{
+    if (s_conn_handle == BLE_HS_CONN_HANDLE_NONE || !s_notify_enabled) {
+        return 0;
+    }
+    if (xSemaphoreTake(s_tx_lock, wait) != pdTRUE) {
+        return 0;
+    }
+    size_t n = xStreamBufferSend(s_tx_stream, data, len, wait);
+    xSemaphoreGive(s_tx_lock);
+    nus_tx_kick();
+    return n;
+}
+
+uint16_t ble_nus_mtu(void)
+{
+    return s_mtu;
+}
+
+void ble_nus_get_link(ble_nus_link_t *out)
+{
+    out->mtu = s_mtu;
+    out->conn_itvl = s_conn_itvl;
+    out->tx_bytes = (uint32_t)metric_value(&s_m_tx_bytes);
+    out->tx_notifications = (uint32_t)metric_value(&s_m_tx_notify);
+    out->rx_bytes = (uint32_t)metric_value(&s_m_rx_bytes);
+    out->tx_stalls = (uint32_t)metric_value(&s_m_tx_stalls);
+}
+
+size_t ble_nus_tx_queued(void)
+{
+    return xStreamBufferBytesAvailable(s_tx_stream);
+}
+
+esp_err_t ble_nus_request_conn_itvl(uint16_t itvl_min, uint16_t itvl_max)
+{
+    if (s_conn_handle == BLE_HS_CONN_HANDLE_NONE) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    struct ble_gap_upd_params params = {
+        .itvl_min = itvl_min,
+        .itvl_max = itvl_max,
+        .latency = 0,
+        .supervision_timeout = NUS_SUPERVISION_TMO,
+    };
+    int rc = ble_gap_update_params(s_conn_handle, &params);
+    if (rc != 0) {
+        ESP_LOGW(TAG, "update_params failed: %d", rc);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
 #endif /* CONFIG_BT_ENABLED */
@@ -1,12 +1,74 @@
 #pragma once
 
 #include "esp_err.h"
+#include "freertos/FreeRTOS.h"
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Connection interval requested on connect, in 1.25 ms units */
+#define BLE_NUS_CONN_ITVL_MIN   6       /* 7.5 ms */
+#define BLE_NUS_CONN_ITVL_MAX   12      /* 15 ms */
+
+/* Called from the NimBLE host task for every write on the RX characteristic */
+typedef void (*ble_nus_rx_cb_t)(const uint8_t *data, size_t len);
+
+/* Link parameters and running data-path counters */
+typedef struct {
+    uint16_t mtu;
+    uint16_t conn_itvl;             /* 1.25 ms units, 0 when disconnected */
+    uint32_t tx_bytes;
+    uint32_t tx_notifications;
+    uint32_t rx_bytes;
+    uint32_t tx_stalls;
+} ble_nus_link_t;
 
 #if CONFIG_BT_ENABLED
 esp_err_t ble_nus_init(void);
 bool      ble_nus_is_connected(void);
+
+/**
+ * @brief Register the RX handler (replaces the default echo)
+ */
+void      ble_nus_set_rx_cb(ble_nus_rx_cb_t cb);
+
+/**
+ * @brief Queue bytes for the TX characteristic
+ *
+ * Data is split into notifications of up to ATT MTU - 3 bytes and sent as
+ * fast as the link and the host's mbuf pool allow.
+ *
+ * @return bytes queued; 0 when not connected or notifications are off
+ */
+size_t    ble_nus_send(const void *data, size_t len, TickType_t wait);
+
+/**
+ * @brief Current ATT MTU (23 until the exchange completes)
+ */
+uint16_t  ble_nus_mtu(void);
+
+void      ble_nus_get_link(ble_nus_link_t *out);
+
+/**
+ * @brief Bytes queued by ble_nus_send() that have not been notified yet
+ */
+size_t    ble_nus_tx_queued(void);
+
+/**
+ * @brief Ask the central for a connection interval (1.25 ms units)
+ *
+ * The outcome arrives asynchronously; poll ble_nus_get_link() for it.
+ *
+ * @return ESP_ERR_INVALID_STATE when not connected
+ */
+esp_err_t ble_nus_request_conn_itvl(uint16_t itvl_min, uint16_t itvl_max);
 #else
 static inline esp_err_t ble_nus_init(void) { return ESP_OK; }
 static inline bool ble_nus_is_connected(void) { return false; }
+static inline void ble_nus_set_rx_cb(ble_nus_rx_cb_t cb) { }
+static inline size_t ble_nus_send(const void *data, size_t len, TickType_t wait) { return 0; }
+static inline uint16_t ble_nus_mtu(void) { return 0; }
+static inline void ble_nus_get_link(ble_nus_link_t *out) { *out = (ble_nus_link_t){ 0 }; }
+static inline size_t ble_nus_tx_queued(void) { return 0; }
+static inline esp_err_t ble_nus_request_conn_itvl(uint16_t itvl_min, uint16_t itvl_max) { return ESP_ERR_NOT_SUPPORTED; }
 #endif
@@ -0,0 +1,239 @@
+#include "boot_seq.h"
+#include "metrics.h"
+#include "nvs_store.h"
+#include "esp_log.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include <stdio.h>
+
+static const char *TAG = "boot_seq";
+
+#define STAGE_DONE(i)   (BIT(16 + (i)))    /* above the BOOT_* readiness bits */
+#define STAGE_STACK     4096
+#define STAGE_PRIO      5
+
+static EventGroupHandle_t s_events;
+static const boot_stage_t *s_stages;
+static boot_stage_stat_t s_stat[BOOT_STAGES_MAX];
+static size_t s_n_done;                     /* set once the timeline is complete */
+static uint32_t s_ready_ms;
+static int32_t s_mark_ms[BOOT_MARK_COUNT] = { [0 ... BOOT_MARK_COUNT - 1] = -1 };
+
+static const char *const s_mark_names[BOOT_MARK_COUNT] = {
+    [BOOT_MARK_IP] = "ip", [BOOT_MARK_AP] = "ap",
+    [BOOT_MARK_BLE_ADV] = "ble_adv", [BOOT_MARK_HTTP] = "http",
+    [BOOT_MARK_TIME] = "time",
+};
+
+#if CONFIG_WB_MEM_STAGE_HEAP_EXACT
+static SemaphoreHandle_t s_start_lock;     /* one start() at a time */
+#endif
+
+static char s_names[BOOT_STAGES_MAX][3][48];
+static metric_t s_m_run[BOOT_STAGES_MAX];
+static metric_t s_m_done[BOOT_STAGES_MAX];
+static metric_t s_m_heap[BOOT_STAGES_MAX];
+static metric_t s_m_ready = METRIC_GAUGE_INIT("boot_ready_ms");
+
+static int32_t read_boot_count(void *arg)
+{
+    return (int32_t)nvs_store_boot_count();
+}
+
+static int32_t read_reset_reason(void *arg)
+{
+    return (int32_t)esp_reset_reason();
+}
+
+static metric_t s_m_count = METRIC_GAUGE_FN_INIT("boot_count", read_boot_count, NULL);
+static metric_t s_m_reason = METRIC_GAUGE_FN_INIT("boot_reset_reason", read_reset_reason, NULL);
+
+/* Marks appear on /metrics once reached */
+static void collect_marks(metrics_emit_fn emit, void *ctx)
+{
+    for (int i = 0; i < BOOT_MARK_COUNT; i++) {
+        int32_t ms = boot_seq_mark_ms(i);
+        if (ms < 0) continue;
+        char name[40];
+        snprintf(name, sizeof(name), "boot_mark_ms{mark=\"%s\"}", s_mark_names[i]);
+        emit(name, ms, ctx);
+    }
+}
+
+static metric_collector_t s_mark_collector = { .collect = collect_marks };
+
+static void stage_task(void *arg)
+{
+    size_t i = (size_t)arg;
+    const boot_stage_t *st = &s_stages[i];
+    boot_stage_stat_t *r = &s_stat[i];
+
+    int64_t t0 = esp_timer_get_time();
+    if (st->needs) {
+        TickType_t wait = st->max_wait_ms ? pdMS_TO_TICKS(st->max_wait_ms) : portMAX_DELAY;
+        EventBits_t got = xEventGroupWaitBits(s_events, st->needs, pdFALSE, pdTRUE, wait);
+        if ((got & st->needs) != st->needs) {
+            r->timed_out = true;
+            ESP_LOGW(TAG, "%s: dependencies not ready after %lu ms, starting anyway",
+                     st->name, (unsigned long)st->max_wait_ms);
+        }
+    }
+#if CONFIG_WB_MEM_STAGE_HEAP_EXACT
+    xSemaphoreTake(s_start_lock, portMAX_DELAY);
+#endif
+    int64_t t1 = esp_timer_get_time();
+    uint32_t heap0 = esp_get_free_heap_size();
+    r->err = st->start();
+    r->heap_used = (int32_t)(heap0 - esp_get_free_heap_size());
+    int64_t t2 = esp_timer_get_time();
+#if CONFIG_WB_MEM_STAGE_HEAP_EXACT
+    xSemaphoreGive(s_start_lock);
+#endif
+
+    r->wait_ms = (uint32_t)((t1 - t0) / 1000);
+    r->run_ms = (uint32_t)((t2 - t1) / 1000);
+    r->done_ms = (uint32_t)(t2 / 1000);
+    if (r->err != ESP_OK) {
+        ESP_LOGE(TAG, "%s failed: %s", st->name, esp_err_to_name(r->err));
+    }
+
+    /* Provide even on failure: dependents degrade instead of hanging */
+    xEventGroupSetBits(s_events, st->provides | STAGE_DONE(i));
+    vTaskDelete(NULL);
+}
+
+static void register_metrics(size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        snprintf(s_names[i][0], sizeof(s_names[i][0]), "boot_stage_ms{stage=\"%s\"}", s_stages[i].name);
+        snprintf(s_names[i][1], sizeof(s_names[i][1]), "boot_stage_done_ms{stage=\"%s\"}", s_stages[i].name);
+        snprintf(s_names[i][2], sizeof(s_names[i][2]), "boot_stage_heap_bytes{stage=\"%s\"}", s_stages[i].name);
+        s_m_run[i] = (metric_t)METRIC_GAUGE_INIT(s_names[i][0]);
+        s_m_done[i] = (metric_t)METRIC_GAUGE_INIT(s_names[i][1]);
+        s_m_heap[i] = (metric_t)METRIC_GAUGE_INIT(s_names[i][2]);
+        metrics_register(&s_m_run[i]);
+        metrics_register(&s_m_done[i]);
+        metrics_register(&s_m_heap[i]);
+    }
+    metrics_register(&s_m_ready);
+    metrics_register(&s_m_count);
+    metrics_register(&s_m_reason);
+    metrics_register_collector(&s_mark_collector);
+}
+
+static void boot_events_init(void)
+{
+    if (!s_events) s_events = xEventGroupCreate();
+}
+
+esp_err_t boot_seq_run(const boot_stage_t *stages, size_t n)
+{
+    if (n > BOOT_STAGES_MAX) return ESP_ERR_INVALID_ARG;
+    boot_events_init();
+    if (!s_events) return ESP_ERR_NO_MEM;
+#if CONFIG_WB_MEM_STAGE_HEAP_EXACT
+    if (!s_start_lock) s_start_lock = xSemaphoreCreateMutex();
+    if (!s_start_lock) return ESP_ERR_NO_MEM;
+#endif
+    s_stages = stages;
+
+    EventBits_t all_done = 0;
+    for (size_t i = 0; i < n; i++) {
+        all_done |= STAGE_DONE(i);
+        if (xTaskCreate(stage_task, stages[i].name, STAGE_STACK, (void *)i, STAGE_PRIO, NULL) != pdPASS) {
+            ESP_LOGE(TAG, "No memory for stage %s, running it inline", stages[i].name);
+            s_stat[i].err = stages[i].start();
+            xEventGroupSetBits(s_events, stages[i].provides | STAGE_DONE(i));
+        }
+    }
+    xEventGroupWaitBits(s_events, all_done, pdFALSE, pdTRUE, portMAX_DELAY);
+
+    /* Timeline, in the order the stages were declared */
+    register_metrics(n);
+    esp_err_t ret = ESP_OK;
+    uint32_t ready = 0;
+    for (size_t i = 0; i < n; i++) {
+        const boot_stage_stat_t *r = &s_stat[i];
+        ESP_LOGI(TAG, "%-8s waited %5lu ms, ran %5lu ms, done at %5lu ms, heap %6ld B%s%s",
+                 stages[i].name, (unsigned long)r->wait_ms, (unsigned long)r->run_ms,
+                 (unsigned long)r->done_ms, (long)r->heap_used, r->timed_out ? " (dependency timeout)" : "",
+                 r->err != ESP_OK ? " (failed)" : "");
+        metric_set(&s_m_run[i], r->run_ms);
+        metric_set(&s_m_done[i], r->done_ms);
+        metric_set(&s_m_heap[i], r->heap_used);
+        if (r->done_ms > ready) ready = r->done_ms;
+        if (r->err != ESP_OK) ret = ESP_FAIL;
+    }
+    metric_set(&s_m_ready, ready);
+    s_ready_ms = ready;
+    __atomic_store_n(&s_n_done, n, __ATOMIC_RELEASE);
+    ESP_LOGI(TAG, "Ready %lu ms after boot (boot #%lu, reset: %s)", (unsigned long)ready,
+             (unsigned long)nvs_store_boot_count(), boot_seq_reset_reason());
+    return ret;
+}
+
+void boot_seq_signal(EventBits_t bits)
+{
+    boot_events_init();
+    if (s_events) xEventGroupSetBits(s_events, bits);
+}
+
+bool boot_seq_wait(EventBits_t bits, TickType_t wait)
+{
+    boot_events_init();
+    if (!s_events) return false;
+    return (xEventGroupWaitBits(s_events, bits, pdFALSE, pdTRUE, wait) & bits) == bits;
+}
+
+void boot_seq_mark(boot_mark_t mark)
+{
+    if (mark >= BOOT_MARK_COUNT) return;
+    int32_t expected = -1;
+    int32_t ms = (int32_t)(esp_timer_get_time() / 1000);
+    if (__atomic_compare_exchange_n(&s_mark_ms[mark], &expected, ms, false,
+                                    __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        ESP_LOGI(TAG, "Boot mark %s at %ld ms", s_mark_names[mark], (long)ms);
+    }
+}
+
+int32_t boot_seq_mark_ms(boot_mark_t mark)
+{
+    return mark < BOOT_MARK_COUNT ? __atomic_load_n(&s_mark_ms[mark], __ATOMIC_RELAXED) : -1;
+}
+
+const char *boot_seq_mark_name(boot_mark_t mark)
+{
+    return mark < BOOT_MARK_COUNT ? s_mark_names[mark] : "?";
+}
+
+size_t boot_seq_timeline(const boot_stage_t **stages, const boot_stage_stat_t **stats)
+{
+    size_t n = __atomic_load_n(&s_n_done, __ATOMIC_ACQUIRE);
+    *stages = s_stages;
+    *stats = s_stat;
+    return n;
+}
+
+uint32_t boot_seq_ready_ms(void)
+{
+    return s_ready_ms;       /* published before s_n_done */
+}
+
+const char *boot_seq_reset_reason(void)
+{
+    switch (esp_reset_reason()) {
+    case ESP_RST_POWERON:   return "poweron";
+    case ESP_RST_EXT:       return "external";
+    case ESP_RST_SW:        return "software";
+    case ESP_RST_PANIC:     return "panic";
+    case ESP_RST_INT_WDT:   return "int_wdt";
+    case ESP_RST_TASK_WDT:  return "task_wdt";
+    case ESP_RST_WDT:       return "wdt";
+    case ESP_RST_DEEPSLEEP: return "deepsleep";
+    case ESP_RST_BROWNOUT:  return "brownout";
+    case ESP_RST_SDIO:      return "sdio";
+    default:                return "unknown";
+    }
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include "esp_bit_defs.h"
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Readiness bits. Stages set the bit they provide when their start function
+   returns; BOOT_WIFI_READY is signalled by wifi_prov once the STA has an IP
+   or the provisioning AP is up. */
+#define BOOT_NVS            BIT0
+#define BOOT_NETIF          BIT1
+#define BOOT_LOG            BIT2
+#define BOOT_WIFI_STARTED   BIT3
+#define BOOT_WIFI_READY     BIT4
+#define BOOT_BLE            BIT5
+#define BOOT_HTTP           BIT6
+#define BOOT_TIME           BIT7
+
+#define BOOT_STAGES_MAX     8
+
+/* Points in the boot that no stage return marks, in ms since boot */
+typedef enum {
+    BOOT_MARK_IP,               /* STA got its first IP */
+    BOOT_MARK_AP,               /* provisioning AP and portal up */
+    BOOT_MARK_BLE_ADV,          /* first advertisement started */
+    BOOT_MARK_HTTP,             /* app endpoints registered */
+    BOOT_MARK_TIME,             /* first SNTP sync */
+    BOOT_MARK_COUNT,
+} boot_mark_t;
+
+typedef struct {
+    const char *name;
+    esp_err_t (*start)(void);
+    EventBits_t needs;          /* all of these before start() runs */
+    EventBits_t provides;       /* set once start() returns */
+    uint32_t max_wait_ms;       /* start anyway after this long; 0 waits forever */
+} boot_stage_t;
+
+typedef struct {
+    uint32_t wait_ms;           /* blocked on dependencies */
+    uint32_t run_ms;            /* inside start() */
+    uint32_t done_ms;           /* since boot */
+    int32_t heap_used;          /* free heap lost across start(), incl. the tasks it created */
+    esp_err_t err;
+    bool timed_out;
+} boot_stage_stat_t;
+
+/**
+ * @brief Start every stage as soon as its dependencies are ready
+ *
+ * Each stage gets its own task, so independent stages run in parallel.
+ * Blocks until all stages have finished, then logs the boot timeline and
+ * publishes it as boot_* metrics.
+ *
+ * @return ESP_FAIL if any stage failed (the others still run)
+ */
+esp_err_t boot_seq_run(const boot_stage_t *stages, size_t n);
+
+/**
+ * @brief Mark readiness bits from outside a stage (e.g. an event handler)
+ */
+void      boot_seq_signal(EventBits_t bits);
+
+/**
+ * @brief Wait for readiness bits
+ *
+ * @return true if all of them were set within `wait`
+ */
+bool      boot_seq_wait(EventBits_t bits, TickType_t wait);
+
+/**
+ * @brief Record the first time `mark` is reached; later calls are ignored
+ */
+void      boot_seq_mark(boot_mark_t mark);
+
+/**
+ * @return ms since boot when `mark` was reached, -1 if not (yet)
+ */
+int32_t   boot_seq_mark_ms(boot_mark_t mark);
+const char *boot_seq_mark_name(boot_mark_t mark);
+
+/**
+ * @brief Stage timeline, available once boot_seq_run() has returned
+ *
+ * @return number of stages, 0 before then
+ */
+size_t    boot_seq_timeline(const boot_stage_t **stages, const boot_stage_stat_t **stats);
+uint32_t  boot_seq_ready_ms(void);
+
+/**
+ * @return esp_reset_reason() of this boot as a short name ("poweron", "panic", ...)
+ */
+const char *boot_seq_reset_reason(void);
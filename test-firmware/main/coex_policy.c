@@ -0,0 +1,141 @@
+#include "coex_policy.h"
+#include "ble_nus.h"
+#include "ota_update.h"
+#include "metrics.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#if CONFIG_WB_COEX_POLICY
+#include "esp_coexist.h"
+#endif
+
+static const char *TAG = "coex";
+
+const char *coex_policy_workload_name(coex_workload_t w)
+{
+    switch (w) {
+    case COEX_WORKLOAD_IDLE:         return "idle";
+    case COEX_WORKLOAD_BLE_BULK:     return "ble_bulk";
+    case COEX_WORKLOAD_OTA:          return "ota";
+    case COEX_WORKLOAD_OTA_BLE_BULK: return "ota+ble_bulk";
+    default:                         return "?";
+    }
+}
+
+#if CONFIG_WB_COEX_POLICY
+
+#define TICK_MS             250
+#define BULK_HOLD_TICKS     (2000 / TICK_MS)
+#define ITVL_RETRY_TICKS    (2000 / TICK_MS)    /* between unanswered interval requests */
+#define BULK_BYTES_PER_TICK (CONFIG_WB_COEX_BLE_BULK_BPS * TICK_MS / 1000)
+
+static esp_timer_handle_t s_timer;
+static coex_workload_t s_workload = COEX_WORKLOAD_IDLE;
+static uint32_t s_last_bytes;
+static uint32_t s_bulk_hold;        /* ticks left before ble_bulk ends */
+static uint32_t s_itvl_wait;        /* ticks before another interval request */
+static bool s_relaxed;              /* we slowed the link down and owe it a restore */
+
+static metric_t s_m_workload = METRIC_GAUGE_INIT("coex_workload");
+static metric_t s_m_switches = METRIC_COUNTER_INIT("coex_switches_total");
+static metric_t s_m_itvl_req = METRIC_COUNTER_INIT("coex_itvl_requests_total");
+
+static void set_preference(coex_workload_t w)
+{
+    esp_coex_prefer_t prefer = ESP_COEX_PREFER_BALANCE;
+    if (w == COEX_WORKLOAD_BLE_BULK) prefer = ESP_COEX_PREFER_BT;
+    if (w == COEX_WORKLOAD_OTA) prefer = ESP_COEX_PREFER_WIFI;
+
+    esp_err_t err = esp_coex_preference_set(prefer);
+    if (err != ESP_OK) ESP_LOGW(TAG, "coex preference: %s", esp_err_to_name(err));
+}
+
+/* Nudge the link toward the interval this workload wants. Requests go out
+   at most every ITVL_RETRY_TICKS, since the central may refuse them. */
+static void steer_interval(coex_workload_t w, const ble_nus_link_t *link)
+{
+    if (link->conn_itvl == 0) {
+        s_relaxed = false;          /* a new connection asks for the NUS default itself */
+        return;
+    }
+    if (s_itvl_wait) {
+        s_itvl_wait--;
+        return;
+    }
+
+    uint16_t min = 0, max = 0;
+    if (w == COEX_WORKLOAD_OTA && link->conn_itvl < CONFIG_WB_COEX_OTA_ITVL) {
+        min = max = CONFIG_WB_COEX_OTA_ITVL;
+        s_relaxed = true;
+    } else if (w == COEX_WORKLOAD_IDLE && s_relaxed) {
+        if (link->conn_itvl <= BLE_NUS_CONN_ITVL_MAX) {
+            s_relaxed = false;
+            return;
+        }
+        min = BLE_NUS_CONN_ITVL_MIN;
+        max = BLE_NUS_CONN_ITVL_MAX;
+    } else {
+        return;
+    }
+
+    if (ble_nus_request_conn_itvl(min, max) == ESP_OK) metric_inc(&s_m_itvl_req);
+    s_itvl_wait = ITVL_RETRY_TICKS;
+}
+
+static void coex_tick(void *arg)
+{
+    ble_nus_link_t link;
+    ble_nus_get_link(&link);
+    uint32_t bytes = link.tx_bytes + link.rx_bytes;
+    uint32_t delta = bytes - s_last_bytes;
+    s_last_bytes = bytes;
+
+    if (link.conn_itvl && delta >= BULK_BYTES_PER_TICK) {
+        s_bulk_hold = BULK_HOLD_TICKS;
+    } else if (s_bulk_hold) {
+        s_bulk_hold--;
+    }
+
+    ota_progress_t ota;
+    ota_update_get_progress(&ota);
+    bool ota_busy = ota.state == OTA_STATE_DOWNLOADING || ota.state == OTA_STATE_VERIFYING;
+
+    coex_workload_t w = ota_busy ? COEX_WORKLOAD_OTA : COEX_WORKLOAD_IDLE;
+    if (s_bulk_hold) w = ota_busy ? COEX_WORKLOAD_OTA_BLE_BULK : COEX_WORKLOAD_BLE_BULK;
+
+    if (w != s_workload) {
+        ESP_LOGI(TAG, "%s -> %s", coex_policy_workload_name(s_workload), coex_policy_workload_name(w));
+        s_workload = w;
+        s_itvl_wait = 0;
+        set_preference(w);
+        metric_set(&s_m_workload, w);
+        metric_inc(&s_m_switches);
+    }
+    steer_interval(w, &link);
+}
+
+esp_err_t coex_policy_start(void)
+{
+    static const esp_timer_create_args_t args = {
+        .callback = coex_tick, .name = "coex"
+    };
+    esp_err_t err = esp_timer_create(&args, &s_timer);
+    if (err == ESP_OK) err = esp_timer_start_periodic(s_timer, TICK_MS * 1000ULL);
+    if (err != ESP_OK) return err;
+
+    set_preference(s_workload);
+    metrics_register(&s_m_workload);
+    metrics_register(&s_m_switches);
+    metrics_register(&s_m_itvl_req);
+    ESP_LOGI(TAG, "Coexistence policy running (bulk above %d B/s)", CONFIG_WB_COEX_BLE_BULK_BPS);
+    return ESP_OK;
+}
+
+coex_workload_t coex_policy_workload(void)
+{
+    return s_workload;
+}
+
+#endif
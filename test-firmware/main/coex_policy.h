@@ -0,0 +1,35 @@
+#pragma once
+
+#include "esp_err.h"
+#include "sdkconfig.h"
+
+/* Radio coexistence by workload.
+ *
+ * A 250 ms timer classifies what the board is doing and, on a change,
+ * sets the coexistence preference and the BLE connection interval:
+ *
+ *   workload      coex preference   BLE interval
+ *   idle          balance           NUS default (7.5-15 ms)
+ *   ble_bulk      BT                left to the central / ble_bench
+ *   ota           WiFi              relaxed (CONFIG_WB_COEX_OTA_ITVL)
+ *   ota+ble_bulk  balance           left alone
+ *
+ * ble_bulk means NUS traffic above CONFIG_WB_COEX_BLE_BULK_BPS, held for
+ * 2 s after it drops; ota means an update is downloading or verifying.
+ */
+typedef enum {
+    COEX_WORKLOAD_IDLE,
+    COEX_WORKLOAD_BLE_BULK,
+    COEX_WORKLOAD_OTA,
+    COEX_WORKLOAD_OTA_BLE_BULK,
+} coex_workload_t;
+
+#if CONFIG_WB_COEX_POLICY
+esp_err_t       coex_policy_start(void);
+coex_workload_t coex_policy_workload(void);
+#else
+static inline esp_err_t coex_policy_start(void) { return ESP_OK; }
+static inline coex_workload_t coex_policy_workload(void) { return COEX_WORKLOAD_IDLE; }
+#endif
+
+const char     *coex_policy_workload_name(coex_workload_t w);
@@ -0,0 +1,20 @@
+#!/usr/bin/env python3
+"""Gzip a web asset for embedding: gzip_asset.py <in> <out>.
+
+mtime is fixed at 0 so the output (and the ETag derived from it at run
+time) only changes when the asset does.
+"""
+import gzip
+import sys
+
+
+def main():
+    src, dst = sys.argv[1:3]
+    with open(src, "rb") as f:
+        data = f.read()
+    with open(dst, "wb") as f:
+        f.write(gzip.compress(data, compresslevel=9, mtime=0))
+
+
+if __name__ == "__main__":
+    main()
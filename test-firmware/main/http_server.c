@@ -1,51 +1,198 @@
 #include "http_server.h"
+#include "boot_seq.h"
+#include "nvs_store.h"
 #include "wifi_prov.h"
 #include "ble_nus.h"
+#include "coex_policy.h"
+#include "power_profile.h"
+#include "net_bench.h"
+#include "time_sync.h"
 #include "ota_update.h"
+#include "udp_log.h"
+#include "metrics.h"
+#include "json_stream.h"
+#include "wb_event.h"
 #include "esp_http_server.h"
 #include "esp_ota_ops.h"
 #include "esp_log.h"
-#include "cJSON.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 static const char *TAG = "http_srv";
 
-static uint32_t s_boot_count = 0;
+#define HTTP_PORT       8080
+#define HTTP_CTRL_PORT  32769   /* must differ from portal server's default 32768 */
 
-void http_server_set_boot_count(uint32_t count)
+/* "boot": reset reason, stage timeline and marks, all ms since boot */
+static void status_boot(json_stream_t *js)
 {
-    s_boot_count = count;
+    const boot_stage_t *stages;
+    const boot_stage_stat_t *stats;
+    size_t n = boot_seq_timeline(&stages, &stats);
+
+    json_obj_begin(js, "boot");
+    json_kv_str(js, "reset_reason", boot_seq_reset_reason());
+    if (n) {
+        json_kv_int(js, "ready_ms", boot_seq_ready_ms());
+    } else {
+        json_kv_null(js, "ready_ms");
+    }
+    json_obj_begin(js, "marks");
+    for (int i = 0; i < BOOT_MARK_COUNT; i++) {
+        int32_t ms = boot_seq_mark_ms(i);
+        if (ms >= 0) json_kv_int(js, boot_seq_mark_name(i), ms);
+    }
+    json_obj_end(js);
+    json_arr_begin(js, "stages");
+    for (size_t i = 0; i < n; i++) {
+        json_obj_begin(js, NULL);
+        json_kv_str(js, "name", stages[i].name);
+        json_kv_int(js, "wait_ms", stats[i].wait_ms);
+        json_kv_int(js, "run_ms", stats[i].run_ms);
+        json_kv_int(js, "done_ms", stats[i].done_ms);
+        json_kv_int(js, "heap", stats[i].heap_used);
+        json_kv_bool(js, "ok", stats[i].err == ESP_OK);
+        json_obj_end(js);
+    }
+    json_arr_end(js);
+    json_obj_end(js);
 }
 
 /* GET /status — JSON with device state */
 static esp_err_t status_handler(httpd_req_t *req)
 {
     const esp_app_desc_t *app = esp_app_get_description();
+    json_stream_t js;
 
-    cJSON *root = cJSON_CreateObject();
-    cJSON_AddStringToObject(root, "project", app->project_name);
-    cJSON_AddStringToObject(root, "version", app->version);
-    cJSON_AddNumberToObject(root, "boot_count", s_boot_count);
-    cJSON_AddBoolToObject(root, "wifi_connected", wifi_prov_is_connected());
-    cJSON_AddBoolToObject(root, "ble_connected", ble_nus_is_connected());
-
-    const char *json = cJSON_PrintUnformatted(root);
     httpd_resp_set_type(req, "application/json");
-    httpd_resp_sendstr(req, json);
+    json_stream_init(&js, req);
+    json_obj_begin(&js, NULL);
+    json_kv_str(&js, "project", app->project_name);
+    json_kv_str(&js, "version", app->version);
+    json_kv_str(&js, "build_profile", CONFIG_WB_BUILD_PROFILE);
+    json_kv_int(&js, "boot_count", nvs_store_boot_count());
+    json_kv_bool(&js, "wifi_connected", wifi_prov_is_connected());
+    json_kv_bool(&js, "ble_connected", ble_nus_is_connected());
+    json_kv_str(&js, "coex", coex_policy_workload_name(coex_policy_workload()));
+    json_kv_str(&js, "power", power_profile_name(power_profile_get()));
+    json_kv_int(&js, "time_sync_age_ms", time_sync_age_ms());
+    status_boot(&js);
 
-    cJSON_free((void *)json);
-    cJSON_Delete(root);
-    return ESP_OK;
+    ota_progress_t ota;
+    ota_update_get_progress(&ota);
+    json_obj_begin(&js, "ota");
+    json_kv_str(&js, "state", ota_update_state_name(ota.state));
+    json_kv_str(&js, "format", ota.format);
+    json_kv_int(&js, "downloaded", ota.downloaded);
+    json_kv_int(&js, "written", ota.written);
+    json_kv_int(&js, "total", ota.total);
+    json_kv_int(&js, "resumes", ota.resumes);
+    if (ota.state == OTA_STATE_FAILED) {
+        json_kv_str(&js, "error", esp_err_to_name(ota.last_err));
+    }
+    json_obj_end(&js);
+    json_obj_end(&js);
+    return json_stream_finish(&js);
+}
+
+/* One scrape: every sample carries the same Prometheus timestamp (Unix
+   ms) once the clock is synced, so boards scraped together line up */
+typedef struct {
+    json_stream_t js;
+    char ts[24];                /* " <ms>" or "" */
+} metrics_scrape_t;
+
+static void metrics_emit(const metric_t *m, void *ctx)
+{
+    metrics_scrape_t *sc = ctx;
+    json_stream_t *js = &sc->js;
+
+    if (m->type != METRIC_HISTOGRAM) {
+        json_stream_printf(js, "%s %" PRId64 "%s\n", m->name, metric_value(m), sc->ts);
+        return;
+    }
+
+    /* Cumulative buckets, every bound on every scrape: a series that comes
+       and goes breaks rate() and histogram_quantile() on the collector */
+    uint32_t cum = 0;
+    for (int i = 0; i < METRICS_HIST_BUCKETS - 1; i++) {
+        cum += __atomic_load_n(&m->hist[i], __ATOMIC_RELAXED);
+        json_stream_printf(js, "%s_bucket{le=\"%lu\"} %lu%s\n", m->name,
+                           (unsigned long)(1UL << i) - 1, (unsigned long)cum, sc->ts);
+    }
+    uint32_t count = __atomic_load_n(&m->count, __ATOMIC_RELAXED);
+    json_stream_printf(js, "%s_bucket{le=\"+Inf\"} %lu%s\n%s_sum %lu%s\n%s_count %lu%s\n",
+                       m->name, (unsigned long)count, sc->ts,
+                       m->name, (unsigned long)__atomic_load_n(&m->sum, __ATOMIC_RELAXED), sc->ts,
+                       m->name, (unsigned long)count, sc->ts);
 }
 
-/* POST /ota — trigger OTA update */
+static void metrics_emit_sample(const char *name, int64_t value, void *ctx)
+{
+    metrics_scrape_t *sc = ctx;
+    json_stream_printf(&sc->js, "%s %" PRId64 "%s\n", name, value, sc->ts);
+}
+
+/* GET /metrics — all registered metrics, Prometheus text format */
+static esp_err_t metrics_handler(httpd_req_t *req)
+{
+    metrics_scrape_t sc = { .ts = "" };
+    int64_t boot_us = esp_timer_get_time(), unix_us;
+
+    if (time_sync_to_unix_us(boot_us, &unix_us)) {
+        snprintf(sc.ts, sizeof(sc.ts), " %" PRId64, unix_us / 1000);
+    }
+    httpd_resp_set_type(req, "text/plain; version=0.0.4");
+    json_stream_init(&sc.js, req);
+    metrics_foreach(metrics_emit, &sc);
+    metrics_collect(metrics_emit_sample, &sc);
+    /* Pairs boot-relative log timestamps with the scrape's wall clock */
+    metrics_emit_sample("time_sync_scrape_boot_us", boot_us, &sc);
+    return json_stream_finish(&sc.js);
+}
+
+/* POST /ota — trigger OTA update. Optional JSON body {"url": "..."}
+   selects the image, otherwise OTA_DEFAULT_URL is used. */
 static esp_err_t ota_handler(httpd_req_t *req)
 {
+    char url[OTA_URL_MAX] = {0};
+    char body[OTA_URL_MAX + 32];
+
+    int len = httpd_req_recv(req, body, sizeof(body) - 1);
+    if (len > 0) {
+        body[len] = '\0';
+        json_get_string(body, "url", url, sizeof(url));
+    }
+    if (url[0] && strncmp(url, "http://", 7) != 0 && strncmp(url, "https://", 8) != 0) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "url must be http:// or https://");
+        return ESP_OK;
+    }
+
     ESP_LOGI(TAG, "OTA requested via HTTP");
-    esp_err_t err = ota_update_start();
+    esp_err_t err = ota_update_start(url[0] ? url : NULL);
 
     httpd_resp_set_type(req, "application/json");
     if (err == ESP_OK) {
-        httpd_resp_sendstr(req, "{\"status\":\"ok\",\"message\":\"OTA started\"}");
+        json_stream_t js;
+        json_stream_init(&js, req);
+        json_obj_begin(&js, NULL);
+        json_kv_str(&js, "status", "ok");
+        json_kv_str(&js, "message", "OTA started");
+        json_kv_str(&js, "url", url[0] ? url : OTA_DEFAULT_URL);
+        json_obj_end(&js);
+        return json_stream_finish(&js);
+    } else if (err == ESP_ERR_INVALID_STATE) {
+        httpd_resp_set_status(req, "409 Conflict");
+        httpd_resp_sendstr(req, "{\"status\":\"error\",\"message\":\"OTA already in progress\"}");
+    } else if (err == ESP_ERR_NOT_SUPPORTED) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "https:// needs CONFIG_MBEDTLS_CERTIFICATE_BUNDLE");
     } else {
         httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to start OTA");
     }
@@ -63,33 +210,754 @@ static esp_err_t wifi_reset_handler(httpd_req_t *req)
     return ESP_OK;
 }
 
-esp_err_t http_server_start(void)
+static esp_err_t log_target_send(httpd_req_t *req)
+{
+    nvs_log_target_t t;
+    udp_log_get_target(&t);
+
+    json_stream_t js;
+    httpd_resp_set_type(req, "application/json");
+    json_stream_init(&js, req);
+    json_obj_begin(&js, NULL);
+    json_kv_str(&js, "transport", udp_log_transport_name(t.transport));
+    json_kv_str(&js, "host", t.host);
+    json_kv_int(&js, "port", t.port);
+    json_kv_bool(&js, "connected", udp_log_is_connected());
+    json_kv_int(&js, "dropped", udp_log_dropped());
+    json_obj_end(&js);
+    return json_stream_finish(&js);
+}
+
+/* Optional "host" member into out. False if it doesn't fit: truncating
+   "192.168.100.1000" would leave a different but valid address */
+static bool get_host(const char *body, char *out, size_t out_sz)
+{
+    char host[64];
+    if (!json_get_string(body, "host", host, sizeof(host))) return true;
+    size_t n = strlen(host);
+    if (n >= out_sz) return false;
+    memcpy(out, host, n + 1);
+    return true;
+}
+
+/* GET /log-target — where the log stream goes, and ring drops so far */
+static esp_err_t log_target_get_handler(httpd_req_t *req)
+{
+    return log_target_send(req);
+}
+
+/* POST /log-target — {"transport": "udp"|"tcp"|"ws", "host": "a.b.c.d",
+   "port": n}; omitted members keep their current value. Stored in NVS. */
+static esp_err_t log_target_post_handler(httpd_req_t *req)
+{
+    char body[128];
+    int len = httpd_req_recv(req, body, sizeof(body) - 1);
+    if (len <= 0) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "JSON body required");
+        return ESP_OK;
+    }
+    body[len] = '\0';
+
+    nvs_log_target_t t;
+    udp_log_get_target(&t);
+
+    char transport[8];
+    int64_t port;
+    if (json_get_string(body, "transport", transport, sizeof(transport))) {
+        log_transport_t tr;
+        if (!udp_log_parse_transport(transport, &tr)) {
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "transport must be udp, tcp or ws");
+            return ESP_OK;
+        }
+        t.transport = tr;
+    }
+    if (!get_host(body, t.host, sizeof(t.host))) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "host must be an IPv4 address, port 1-65535");
+        return ESP_OK;
+    }
+    if (json_get_int(body, "port", &port)) {
+        t.port = (port > 0 && port <= 65535) ? (uint16_t)port : 0;
+    }
+
+    esp_err_t err = udp_log_set_target(&t);
+    if (err == ESP_ERR_INVALID_ARG) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "host must be an IPv4 address, port 1-65535");
+        return ESP_OK;
+    }
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Log target applied but not saved: %s", esp_err_to_name(err));
+    }
+    return log_target_send(req);
+}
+
+static esp_err_t power_send(httpd_req_t *req)
+{
+    json_stream_t js;
+    httpd_resp_set_type(req, "application/json");
+    json_stream_init(&js, req);
+    json_obj_begin(&js, NULL);
+    json_kv_str(&js, "profile", power_profile_name(power_profile_get()));
+    json_kv_int(&js, "listen_interval", power_profile_listen_interval());
+    json_kv_int(&js, "current_ma", power_profile_current_ma());
+    json_kv_int(&js, "charge_mas", power_profile_charge_mas());
+    json_obj_end(&js);
+    return json_stream_finish(&js);
+}
+
+/* GET /power — active profile and its current estimate */
+static esp_err_t power_get_handler(httpd_req_t *req)
+{
+    return power_send(req);
+}
+
+/* POST /power — {"profile": "default"|"performance"|"modem"|"light",
+   "listen_interval": n}; listen_interval is optional. Stored in NVS. */
+static esp_err_t power_post_handler(httpd_req_t *req)
+{
+    char body[96];
+    int len = httpd_req_recv(req, body, sizeof(body) - 1);
+    if (len <= 0) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "JSON body required");
+        return ESP_OK;
+    }
+    body[len] = '\0';
+
+    char name[16];
+    power_profile_t profile;
+    int64_t li = 0;
+    if (!json_get_string(body, "profile", name, sizeof(name)) || !power_profile_parse(name, &profile)) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "profile must be default, performance, modem or light");
+        return ESP_OK;
+    }
+    if (json_get_int(body, "listen_interval", &li) && (li < 1 || li > 100)) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "listen_interval must be 1-100");
+        return ESP_OK;
+    }
+
+    esp_err_t err = power_profile_set(profile, (uint8_t)li);
+    if (err == ESP_ERR_INVALID_STATE) {
+        httpd_resp_set_status(req, "409 Conflict");
+        httpd_resp_set_type(req, "application/json");
+        httpd_resp_sendstr(req, "{\"status\":\"error\",\"message\":\"Power profiles need STA mode\"}");
+        return ESP_OK;
+    }
+    if (err != ESP_OK) {
+        char msg[64];
+        snprintf(msg, sizeof(msg), "Profile rejected: %s", esp_err_to_name(err));
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, msg);
+        return ESP_OK;
+    }
+    return power_send(req);
+}
+
+/* ── Benchmarks ──────────────────────────────────────────────────── */
+
+#define BENCH_CHUNK             4096
+#define BENCH_DOWNLOAD_DEFAULT  (1024 * 1024)
+#define BENCH_DOWNLOAD_MAX      (64 * 1024 * 1024)
+
+static void bench_result_fields(json_stream_t *js, net_bench_mode_t mode)
+{
+    net_bench_result_t r;
+    net_bench_get(mode, &r);
+
+    json_kv_str(js, "mode", net_bench_mode_name(mode));
+    json_kv_str(js, "build_profile", CONFIG_WB_BUILD_PROFILE);
+    json_kv_bool(js, "running", r.running);
+    if (!r.valid) return;
+    json_kv_int(js, "bytes", (int64_t)r.bytes);
+    json_kv_int(js, "ms", r.duration_ms);
+    json_kv_int(js, "kbps", r.kbps);       /* 1000 bit/s, so Mbit/s = kbps / 1000 */
+    if (r.retransmits >= 0) {
+        json_kv_int(js, "retransmits", r.retransmits);
+    } else {
+        json_kv_null(js, "retransmits");
+    }
+    json_kv_int(js, "rssi", r.rssi);
+    if (mode == NET_BENCH_UDP_BLAST || mode == NET_BENCH_UDP_ECHO) {
+        json_kv_int(js, "packets", r.packets);
+        json_kv_int(js, "errors", r.errors);
+    }
+    if (mode == NET_BENCH_UDP_ECHO) {
+        json_kv_int(js, "rtt_avg_us", r.rtt_avg_us);
+        json_kv_int(js, "rtt_max_us", r.rtt_max_us);
+    }
+    json_kv_str(js, "result", r.err == ESP_OK ? "ok" : esp_err_to_name(r.err));
+}
+
+static esp_err_t bench_busy(httpd_req_t *req)
+{
+    httpd_resp_set_status(req, "409 Conflict");
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_sendstr(req, "{\"status\":\"error\",\"message\":\"Benchmark already running\"}");
+    return ESP_OK;
+}
+
+/* GET /bench — last result of every mode */
+static esp_err_t bench_get_handler(httpd_req_t *req)
+{
+    json_stream_t js;
+    httpd_resp_set_type(req, "application/json");
+    json_stream_init(&js, req);
+    json_arr_begin(&js, NULL);
+    for (int i = 0; i < NET_BENCH_COUNT; i++) {
+        json_obj_begin(&js, NULL);
+        bench_result_fields(&js, i);
+        json_obj_end(&js);
+    }
+    json_arr_end(&js);
+    return json_stream_finish(&js);
+}
+
+/* POST /bench — {"mode": "udp_blast"|"udp_echo"|"tcp_send"|"tcp_recv",
+   "host": "a.b.c.d", "port": n, "ms": n, "size": n}; all but mode are
+   optional. Runs in the background, GET /bench has the result. */
+static esp_err_t bench_post_handler(httpd_req_t *req)
+{
+    char body[128];
+    int len = httpd_req_recv(req, body, sizeof(body) - 1);
+    if (len <= 0) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "JSON body required");
+        return ESP_OK;
+    }
+    body[len] = '\0';
+
+    char name[16];
+    net_bench_req_t b = {0};
+    int64_t v;
+    if (!json_get_string(body, "mode", name, sizeof(name)) || !net_bench_parse_mode(name, &b.mode) ||
+        b.mode == NET_BENCH_HTTP_DOWNLOAD || b.mode == NET_BENCH_HTTP_UPLOAD) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "mode must be udp_blast, udp_echo, tcp_send or tcp_recv");
+        return ESP_OK;
+    }
+    if (!get_host(body, b.host, sizeof(b.host))) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "host must be an IPv4 address");
+        return ESP_OK;
+    }
+    if (json_get_int(body, "port", &v)) b.port = (v > 0 && v <= 65535) ? (uint16_t)v : 0;
+    if (json_get_int(body, "ms", &v) && v > 0) b.duration_ms = v < NET_BENCH_MAX_MS ? (uint32_t)v : NET_BENCH_MAX_MS;
+    if (json_get_int(body, "size", &v) && v > 0) b.size = v < NET_BENCH_DATAGRAM_MAX ? (uint16_t)v : NET_BENCH_DATAGRAM_MAX;
+
+    esp_err_t err = net_bench_start(&b);
+    if (err == ESP_ERR_INVALID_STATE) return bench_busy(req);
+    if (err == ESP_ERR_INVALID_ARG) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "host must be an IPv4 address");
+        return ESP_OK;
+    }
+    if (err != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to start benchmark");
+        return ESP_OK;
+    }
+
+    json_stream_t js;
+    httpd_resp_set_type(req, "application/json");
+    json_stream_init(&js, req);
+    json_obj_begin(&js, NULL);
+    json_kv_str(&js, "status", "started");
+    json_kv_str(&js, "mode", net_bench_mode_name(b.mode));
+    json_obj_end(&js);
+    return json_stream_finish(&js);
+}
+
+/* GET /bench/download?bytes=N — N bytes (default 1 MiB) of a fixed
+   pattern, chunked; the client times the transfer, the board keeps
+   its own figure under GET /bench */
+static esp_err_t bench_download_handler(httpd_req_t *req)
+{
+    uint64_t total = BENCH_DOWNLOAD_DEFAULT;
+    char query[32], val[16];
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK &&
+        httpd_query_key_value(query, "bytes", val, sizeof(val)) == ESP_OK) {
+        total = strtoull(val, NULL, 10);
+        if (total > BENCH_DOWNLOAD_MAX) total = BENCH_DOWNLOAD_MAX;
+    }
+
+    uint8_t *buf = malloc(BENCH_CHUNK);
+    if (!buf) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
+        return ESP_OK;
+    }
+    if (net_bench_begin(NET_BENCH_HTTP_DOWNLOAD) != ESP_OK) {
+        free(buf);
+        return bench_busy(req);
+    }
+    for (int i = 0; i < BENCH_CHUNK; i++) buf[i] = (uint8_t)i;
+
+    httpd_resp_set_type(req, "application/octet-stream");
+    uint64_t sent = 0;
+    esp_err_t err = ESP_OK;
+    while (sent < total && err == ESP_OK) {
+        size_t n = total - sent < BENCH_CHUNK ? (size_t)(total - sent) : BENCH_CHUNK;
+        err = httpd_resp_send_chunk(req, (const char *)buf, n);
+        if (err == ESP_OK) sent += n;
+    }
+    if (err == ESP_OK) err = httpd_resp_send_chunk(req, NULL, 0);
+    free(buf);
+
+    net_bench_end(NET_BENCH_HTTP_DOWNLOAD, sent, err);
+    return err;
+}
+
+/* POST /bench/upload — reads and discards the body, replies with the
+   board's view of the transfer */
+static esp_err_t bench_upload_handler(httpd_req_t *req)
+{
+    uint8_t *buf = malloc(BENCH_CHUNK);
+    if (!buf) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
+        return ESP_OK;
+    }
+    if (net_bench_begin(NET_BENCH_HTTP_UPLOAD) != ESP_OK) {
+        free(buf);
+        return bench_busy(req);
+    }
+
+    size_t remaining = req->content_len;
+    uint64_t received = 0;
+    esp_err_t err = ESP_OK;
+    while (remaining > 0) {
+        int n = httpd_req_recv(req, (char *)buf, remaining < BENCH_CHUNK ? remaining : BENCH_CHUNK);
+        if (n == HTTPD_SOCK_ERR_TIMEOUT) continue;
+        if (n <= 0) {
+            err = ESP_FAIL;
+            break;
+        }
+        remaining -= n;
+        received += n;
+    }
+    free(buf);
+    net_bench_end(NET_BENCH_HTTP_UPLOAD, received, err);
+    if (err != ESP_OK) return ESP_FAIL;     /* connection is gone */
+
+    json_stream_t js;
+    httpd_resp_set_type(req, "application/json");
+    json_stream_init(&js, req);
+    json_obj_begin(&js, NULL);
+    bench_result_fields(&js, NET_BENCH_HTTP_UPLOAD);
+    json_obj_end(&js);
+    return json_stream_finish(&js);
+}
+
+/* ── Event stream ────────────────────────────────────────────────── */
+
+#if CONFIG_HTTPD_WS_SUPPORT
+#define WS_MSG_MAX      160
+#define WS_RX_MAX       64
+#define WS_LOG_INFLIGHT 4       /* log frames queued to the httpd task */
+
+static httpd_handle_t s_server;
+
+static int32_t ws_count_clients(void *arg);
+
+static metric_t s_m_ws_clients = METRIC_GAUGE_FN_INIT("http_ws_clients", ws_count_clients, NULL);
+static metric_t s_m_ws_events = METRIC_COUNTER_INIT("http_ws_events_total");
+static metric_t s_m_ws_dropped = METRIC_COUNTER_INIT("http_ws_events_dropped_total");
+
+typedef struct {
+    httpd_ws_type_t type;
+    size_t len;
+    char text[];
+} ws_msg_t;
+
+static uint32_t s_ws_log_inflight;
+
+static uint32_t now_ms(void)
+{
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+static int ws_format_ota(char *buf, size_t size, const char *prefix, const wb_event_ota_t *o)
+{
+    int n = snprintf(buf, size, "%s\"state\":\"%s\",\"written\":%" PRIu32 ",\"total\":%" PRIu32
+                     ",\"resumes\":%" PRIu32, prefix, ota_update_state_name(o->state),
+                     o->written, o->total, o->resumes);
+    if (o->state == OTA_STATE_FAILED && n > 0 && (size_t)n < size) {
+        n += snprintf(buf + n, size - n, ",\"error\":\"%s\"", esp_err_to_name(o->err));
+    }
+    return n;
+}
+
+/* One compact JSON object per event, field names as in GET /status */
+static int ws_format(char *buf, size_t size, int32_t id, const void *data)
+{
+    int n;
+
+    switch (id) {
+    case WB_EVENT_WIFI: {
+        const wb_event_wifi_t *w = data;
+        n = w->connected
+            ? snprintf(buf, size, "{\"ev\":\"wifi\",\"connected\":true,\"rssi\":%d", w->rssi)
+            : snprintf(buf, size, "{\"ev\":\"wifi\",\"connected\":false,\"reason\":%u", w->reason);
+        break;
+    }
+    case WB_EVENT_BLE: {
+        const wb_event_ble_t *b = data;
+        n = snprintf(buf, size, "{\"ev\":\"ble\",\"connected\":%s,\"mtu\":%u",
+                     b->connected ? "true" : "false", b->mtu);
+        break;
+    }
+    case WB_EVENT_OTA:
+        n = ws_format_ota(buf, size, "{\"ev\":\"ota\",", data);
+        break;
+    default:
+        return -1;
+    }
+    if (n < 0 || (size_t)n >= size) return -1;
+    n += snprintf(buf + n, size - n, ",\"t\":%" PRIu32 "}", now_ms());
+    return (size_t)n < size ? n : -1;
+}
+
+static bool ws_is_client(int fd)
+{
+    return httpd_ws_get_fd_info(s_server, fd) == HTTPD_WS_CLIENT_WEBSOCKET;
+}
+
+static int32_t ws_count_clients(void *arg)
+{
+    int fds[CONFIG_LWIP_MAX_SOCKETS];
+    size_t n = sizeof(fds) / sizeof(fds[0]);
+    int32_t count = 0;
+
+    if (!s_server || httpd_get_client_list(s_server, &n, fds) != ESP_OK) return 0;
+    for (size_t i = 0; i < n; i++) {
+        if (ws_is_client(fds[i])) count++;
+    }
+    return count;
+}
+
+/* Runs on the httpd task, so sends never race with request handlers */
+static void ws_broadcast(void *arg)
+{
+    ws_msg_t *msg = arg;
+    int fds[CONFIG_LWIP_MAX_SOCKETS];
+    size_t n = sizeof(fds) / sizeof(fds[0]);
+
+    if (httpd_get_client_list(s_server, &n, fds) == ESP_OK) {
+        httpd_ws_frame_t frame = {
+            .type = msg->type,
+            .payload = (uint8_t *)msg->text,
+            .len = msg->len,
+        };
+        for (size_t i = 0; i < n; i++) {
+            if (ws_is_client(fds[i])) httpd_ws_send_frame_async(s_server, fds[i], &frame);
+        }
+    }
+    if (msg->type == HTTPD_WS_TYPE_BINARY) {
+        __atomic_sub_fetch(&s_ws_log_inflight, 1, __ATOMIC_RELAXED);
+    }
+    free(msg);
+}
+
+esp_err_t http_server_ws_send_log(const void *data, size_t len)
+{
+    if (!s_server) return ESP_ERR_INVALID_STATE;
+    if (ws_count_clients(NULL) == 0) return ESP_ERR_NOT_FOUND;
+    if (__atomic_load_n(&s_ws_log_inflight, __ATOMIC_RELAXED) >= WS_LOG_INFLIGHT) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    ws_msg_t *msg = malloc(sizeof(*msg) + len);
+    if (!msg) return ESP_ERR_NO_MEM;
+    msg->type = HTTPD_WS_TYPE_BINARY;
+    msg->len = len;
+    memcpy(msg->text, data, len);
+    __atomic_add_fetch(&s_ws_log_inflight, 1, __ATOMIC_RELAXED);
+    if (httpd_queue_work(s_server, ws_broadcast, msg) != ESP_OK) {
+        __atomic_sub_fetch(&s_ws_log_inflight, 1, __ATOMIC_RELAXED);
+        free(msg);
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+static void ws_event_handler(void *arg, esp_event_base_t base, int32_t id, void *data)
+{
+    char text[WS_MSG_MAX];
+    int len = ws_format(text, sizeof(text), id, data);
+    if (len < 0) return;
+
+    ws_msg_t *msg = malloc(sizeof(*msg) + len);
+    if (!msg) {
+        metric_inc(&s_m_ws_dropped);
+        return;
+    }
+    msg->type = HTTPD_WS_TYPE_TEXT;
+    msg->len = len;
+    memcpy(msg->text, text, len);
+    if (httpd_queue_work(s_server, ws_broadcast, msg) != ESP_OK) {
+        free(msg);
+        metric_inc(&s_m_ws_dropped);
+        return;
+    }
+    metric_inc(&s_m_ws_events);
+}
+
+/* GET /ws — WebSocket event stream. A "hello" snapshot of the current
+   state follows the handshake, then one text frame per WB_EVENT. With the
+   log target set to "ws", log batches arrive as binary frames in between.
+   Frames from the client are read and ignored. */
+static esp_err_t ws_handler(httpd_req_t *req)
+{
+    if (req->method == HTTP_GET) {
+        ota_progress_t ota;
+        ota_update_get_progress(&ota);
+        wb_event_ota_t o = {
+            .state = ota.state, .written = ota.written, .total = ota.total,
+            .resumes = ota.resumes, .err = ota.last_err,
+        };
+        ble_nus_link_t link = {0};
+        ble_nus_get_link(&link);
+
+        char text[WS_MSG_MAX + 64];
+        int n = snprintf(text, sizeof(text),
+                         "{\"ev\":\"hello\",\"wifi\":{\"connected\":%s},"
+                         "\"ble\":{\"connected\":%s,\"mtu\":%u},",
+                         wifi_prov_is_connected() ? "true" : "false",
+                         ble_nus_is_connected() ? "true" : "false", link.mtu);
+        n += ws_format_ota(text + n, sizeof(text) - n, "\"ota\":{", &o);
+        n += snprintf(text + n, sizeof(text) - n, "},\"t\":%" PRIu32 "}", now_ms());
+        if ((size_t)n >= sizeof(text)) return ESP_FAIL;
+
+        httpd_ws_frame_t frame = {
+            .type = HTTPD_WS_TYPE_TEXT, .payload = (uint8_t *)text, .len = n,
+        };
+        return httpd_ws_send_frame(req, &frame);
+    }
+
+    uint8_t buf[WS_RX_MAX];
+    httpd_ws_frame_t frame = { .payload = buf };
+    esp_err_t err = httpd_ws_recv_frame(req, &frame, 0);
+    if (err != ESP_OK || frame.len == 0) return err;
+    if (frame.len > sizeof(buf)) return ESP_ERR_INVALID_SIZE;     /* closes the socket */
+    return httpd_ws_recv_frame(req, &frame, frame.len);
+}
+
+static esp_err_t ws_start(httpd_handle_t server)
+{
+    static const httpd_uri_t ws_get = {
+        .uri = "/ws", .method = HTTP_GET, .handler = ws_handler, .is_websocket = true
+    };
+
+    s_server = server;
+    esp_err_t err = httpd_register_uri_handler(server, &ws_get);
+    if (err == ESP_OK) {
+        err = esp_event_handler_register(WB_EVENT, ESP_EVENT_ANY_ID, ws_event_handler, NULL);
+    }
+    if (err != ESP_OK) return err;
+
+    metrics_register(&s_m_ws_clients);
+    metrics_register(&s_m_ws_events);
+    metrics_register(&s_m_ws_dropped);
+    return ESP_OK;
+}
+#else
+esp_err_t http_server_ws_send_log(const void *data, size_t len)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+#endif
+
+typedef esp_err_t (*http_handler_t)(httpd_req_t *req);
+
+/* One row per URI. The entry wrappers below get their row as user_ctx:
+   ISO C has no conversion between function and object pointers */
+typedef struct {
+    const char *uri;
+    httpd_method_t method;
+    http_handler_t fn;
+    bool slow;              /* runs on the worker pool in the concurrent profile */
+} http_route_t;
+
+/* ── Power management ──────────────────────────────────────────── */
+
+#if CONFIG_PM_ENABLE
+/* Registered in place of a handler: full clock and no light sleep while
+   it runs, so the light profile costs no latency */
+static esp_err_t http_awake_entry(httpd_req_t *req)
+{
+    const http_route_t *route = req->user_ctx;
+    power_awake_begin(POWER_AWAKE_HTTP);
+    esp_err_t err = route->fn(req);
+    power_awake_end(POWER_AWAKE_HTTP);
+    return err;
+}
+#endif
+
+/* ── Worker pool for slow handlers ─────────────────────────────── */
+
+#if CONFIG_WB_HTTP_PROFILE_CONCURRENT
+#define HTTP_WORKERS    CONFIG_WB_HTTP_ASYNC_WORKERS
+
+typedef struct {
+    httpd_req_t *req;
+    http_handler_t handler;
+} http_work_t;
+
+static QueueHandle_t s_work_q;
+static SemaphoreHandle_t s_workers_idle;    /* counts workers waiting for a request */
+
+static metric_t s_m_async = METRIC_COUNTER_INIT("http_async_requests_total");
+static metric_t s_m_busy = METRIC_COUNTER_INIT("http_async_rejected_total");
+
+static void http_worker_task(void *arg)
+{
+    http_work_t work;
+    while (1) {
+        xSemaphoreGive(s_workers_idle);
+        if (xQueueReceive(s_work_q, &work, portMAX_DELAY) != pdTRUE) continue;
+        power_awake_begin(POWER_AWAKE_HTTP);
+        work.handler(work.req);
+        httpd_req_async_handler_complete(work.req);
+        power_awake_end(POWER_AWAKE_HTTP);
+    }
+}
+
+/* Registered in place of a slow handler: detach the request from the
+   httpd task and run it on an idle worker */
+static esp_err_t http_async_entry(httpd_req_t *req)
+{
+    if (xSemaphoreTake(s_workers_idle, 0) != pdTRUE) {
+        metric_inc(&s_m_busy);
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_set_type(req, "application/json");
+        httpd_resp_sendstr(req, "{\"status\":\"error\",\"message\":\"Server busy\"}");
+        return ESP_OK;
+    }
+
+    const http_route_t *route = req->user_ctx;
+    http_work_t work = { .handler = route->fn };
+    esp_err_t err = httpd_req_async_handler_begin(req, &work.req);
+    if (err != ESP_OK) {
+        xSemaphoreGive(s_workers_idle);
+        ESP_LOGE(TAG, "async_handler_begin failed: %s", esp_err_to_name(err));
+        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Async dispatch failed");
+    }
+    /* A worker is idle, so the queue has room */
+    xQueueSend(s_work_q, &work, portMAX_DELAY);
+    metric_inc(&s_m_async);
+    return ESP_OK;
+}
+
+static esp_err_t http_workers_start(void)
+{
+    s_work_q = xQueueCreate(HTTP_WORKERS, sizeof(http_work_t));
+    s_workers_idle = xSemaphoreCreateCounting(HTTP_WORKERS, 0);
+    if (!s_work_q || !s_workers_idle) return ESP_ERR_NO_MEM;
+
+    for (int i = 0; i < HTTP_WORKERS; i++) {
+        char name[16];
+        snprintf(name, sizeof(name), "http_worker%d", i);
+        if (xTaskCreate(http_worker_task, name, 4096, NULL, 5, NULL) != pdPASS) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    metrics_register(&s_m_async);
+    metrics_register(&s_m_busy);
+    return ESP_OK;
+}
+
+#endif
+
+static const http_route_t s_routes[] = {
+    { "/status",          HTTP_GET,  status_handler },
+    { "/metrics",         HTTP_GET,  metrics_handler },
+    { "/ota",             HTTP_POST, ota_handler, .slow = true },
+    { "/wifi-reset",      HTTP_POST, wifi_reset_handler, .slow = true },
+    { "/log-target",      HTTP_GET,  log_target_get_handler },
+    { "/log-target",      HTTP_POST, log_target_post_handler },
+    { "/power",           HTTP_GET,  power_get_handler },
+    { "/power",           HTTP_POST, power_post_handler },
+    { "/bench",           HTTP_GET,  bench_get_handler },
+    { "/bench",           HTTP_POST, bench_post_handler },
+    { "/bench/download",  HTTP_GET,  bench_download_handler, .slow = true },
+    { "/bench/upload",    HTTP_POST, bench_upload_handler, .slow = true },
+};
+
+static http_handler_t route_entry(const http_route_t *route)
+{
+#if CONFIG_WB_HTTP_PROFILE_CONCURRENT
+    if (route->slow) return http_async_entry;
+#endif
+#if CONFIG_PM_ENABLE
+    return http_awake_entry;
+#else
+    return route->fn;
+#endif
+}
+
+static esp_err_t start_own_server(httpd_handle_t *server)
 {
-    httpd_handle_t server = NULL;
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
-    config.server_port = 8080;
-    config.ctrl_port = 32769;   /* must differ from portal server's default 32768 */
+    config.server_port = HTTP_PORT;
+    config.ctrl_port = HTTP_CTRL_PORT;
+    config.max_uri_handlers = HTTP_SERVER_URI_HANDLERS;
+
+#if CONFIG_WB_HTTP_PROFILE_CONCURRENT
+    /* Pollers reuse their connections; when all sockets are taken the least
+       recently used one makes room, and keep-alive probes reap peers that
+       vanished without a FIN (e.g. a rebooted Pi) */
+    config.max_open_sockets = CONFIG_WB_HTTP_MAX_SOCKETS;
+    config.backlog_conn = CONFIG_WB_HTTP_MAX_SOCKETS;
+    config.lru_purge_enable = true;
+    config.keep_alive_enable = true;
+    config.keep_alive_idle = 5;
+    config.keep_alive_interval = 5;
+    config.keep_alive_count = 3;
+#endif
 
-    esp_err_t err = httpd_start(&server, &config);
+    esp_err_t err = httpd_start(server, &config);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "Failed to start HTTP server: %s", esp_err_to_name(err));
         return err;
     }
+    ESP_LOGI(TAG, "HTTP server started on port %d, %d sockets", HTTP_PORT, config.max_open_sockets);
+    return ESP_OK;
+}
 
-    static const httpd_uri_t status_get = {
-        .uri = "/status", .method = HTTP_GET, .handler = status_handler
-    };
-    static const httpd_uri_t ota_post = {
-        .uri = "/ota", .method = HTTP_POST, .handler = ota_handler
-    };
-    static const httpd_uri_t wifi_reset_post = {
-        .uri = "/wifi-reset", .method = HTTP_POST, .handler = wifi_reset_handler
-    };
+esp_err_t http_server_start(void)
+{
+    httpd_handle_t server = NULL;
+    esp_err_t err;
 
-    httpd_register_uri_handler(server, &status_get);
-    httpd_register_uri_handler(server, &ota_post);
-    httpd_register_uri_handler(server, &wifi_reset_post);
+#if CONFIG_WB_HTTP_PROFILE_CONCURRENT
+    err = http_workers_start();
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start HTTP workers: %s", esp_err_to_name(err));
+        return err;
+    }
+#endif
+
+#if CONFIG_WB_MEM_CONSOLIDATED
+    /* In AP mode the portal's server is already up: one httpd task and
+       control socket instead of two */
+    server = wifi_prov_portal_server();
+    if (server) ESP_LOGI(TAG, "Sharing the portal HTTP server on port 80");
+#endif
+    if (!server) {
+        err = start_own_server(&server);
+        if (err != ESP_OK) return err;
+    }
+
+    /* httpd copies the descriptor; the route row outlives it as user_ctx */
+    for (size_t i = 0; i < sizeof(s_routes) / sizeof(s_routes[0]); i++) {
+        const http_route_t *route = &s_routes[i];
+        httpd_uri_t uri = {
+            .uri = route->uri,
+            .method = route->method,
+            .handler = route_entry(route),
+            .user_ctx = (void *)route,
+        };
+        httpd_register_uri_handler(server, &uri);
+    }
+
+#if CONFIG_HTTPD_WS_SUPPORT
+    err = ws_start(server);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Event stream unavailable: %s", esp_err_to_name(err));
+    }
+#endif
 
-    ESP_LOGI(TAG, "HTTP server started on port 8080 (/status, /ota, /wifi-reset)");
+    ESP_LOGI(TAG, "Serving /status, /metrics, /ota, /wifi-reset, /log-target, /power, /bench, /ws");
+    boot_seq_mark(BOOT_MARK_HTTP);
     return ESP_OK;
 }
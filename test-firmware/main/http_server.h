@@ -1,5 +1,25 @@
 #pragma once
 
 #include "esp_err.h"
+#include <stddef.h>
 
+/* URI handlers http_server_start() registers, for a server it shares */
+#define HTTP_SERVER_URI_HANDLERS    13
+
+/**
+ * @brief Serve /status, /metrics, /ota, /wifi-reset, /log-target, /power, /bench and /ws
+ *
+ * On port 8080, or with CONFIG_WB_MEM_CONSOLIDATED in AP mode on the
+ * captive portal's server (port 80).
+ */
 esp_err_t http_server_start(void);
+
+/**
+ * @brief Queue a binary frame of log data to every /ws client
+ *
+ * Copies `data`; the frames go out from the httpd task.
+ *
+ * @return ESP_ERR_NOT_FOUND with no clients, ESP_ERR_NO_MEM while earlier
+ *         frames are still queued (retry later)
+ */
+esp_err_t http_server_ws_send_log(const void *data, size_t len);
@@ -0,0 +1,321 @@
+#include "json_stream.h"
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* ── Writer ────────────────────────────────────────────────────── */
+
+static void js_flush(json_stream_t *js)
+{
+    if (js->len == 0 || js->failed) return;
+    if (httpd_resp_send_chunk(js->req, js->buf, js->len) != ESP_OK) {
+        js->failed = true;
+    }
+    js->chunked = true;
+    js->len = 0;
+}
+
+void json_stream_init(json_stream_t *js, httpd_req_t *req)
+{
+    js->req = req;
+    js->len = 0;
+    js->chunked = false;
+    js->failed = false;
+    js->depth = 0;
+    js->has_items = 0;
+}
+
+esp_err_t json_stream_finish(json_stream_t *js)
+{
+    if (!js->chunked) {
+        /* Everything fit — plain response with Content-Length */
+        return httpd_resp_send(js->req, js->buf, js->len);
+    }
+    js_flush(js);
+    httpd_resp_send_chunk(js->req, NULL, 0);
+    return js->failed ? ESP_FAIL : ESP_OK;
+}
+
+void json_stream_write(json_stream_t *js, const char *data, size_t len)
+{
+    while (len > 0) {
+        size_t room = sizeof(js->buf) - js->len;
+        if (room == 0) {
+            js_flush(js);
+            room = sizeof(js->buf);
+        }
+        size_t n = len < room ? len : room;
+        memcpy(js->buf + js->len, data, n);
+        js->len += n;
+        data += n;
+        len -= n;
+    }
+}
+
+void json_stream_printf(json_stream_t *js, const char *fmt, ...)
+{
+    va_list ap;
+    for (int attempt = 0; attempt < 2; attempt++) {
+        va_start(ap, fmt);
+        int n = vsnprintf(js->buf + js->len, sizeof(js->buf) - js->len, fmt, ap);
+        va_end(ap);
+        if (n < 0) return;
+        if (js->len + n < sizeof(js->buf)) {
+            js->len += n;
+            return;
+        }
+        js_flush(js);       /* didn't fit — flush and retry once */
+    }
+}
+
+static void js_putc(json_stream_t *js, char c)
+{
+    if (js->len == sizeof(js->buf)) js_flush(js);
+    js->buf[js->len++] = c;
+}
+
+static void js_put_escaped(json_stream_t *js, const char *s)
+{
+    js_putc(js, '"');
+    for (; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') {
+            js_putc(js, '\\');
+            js_putc(js, c);
+        } else if (c < 0x20) {
+            json_stream_printf(js, "\\u%04x", c);
+        } else {
+            js_putc(js, c);
+        }
+    }
+    js_putc(js, '"');
+}
+
+/* Separator and "key": prefix for the next item in the current container */
+static void js_item(json_stream_t *js, const char *key)
+{
+    uint16_t bit = 1u << js->depth;
+    if (js->has_items & bit) js_putc(js, ',');
+    js->has_items |= bit;
+    if (key) {
+        js_put_escaped(js, key);
+        js_putc(js, ':');
+    }
+}
+
+static void js_open(json_stream_t *js, const char *key, char c)
+{
+    js_item(js, key);
+    js_putc(js, c);
+    if (js->depth < JSON_STREAM_MAX_DEPTH) js->depth++;
+    js->has_items &= ~(1u << js->depth);
+}
+
+static void js_close(json_stream_t *js, char c)
+{
+    js_putc(js, c);
+    if (js->depth > 0) js->depth--;
+}
+
+void json_obj_begin(json_stream_t *js, const char *key) { js_open(js, key, '{'); }
+void json_obj_end(json_stream_t *js)                    { js_close(js, '}'); }
+void json_arr_begin(json_stream_t *js, const char *key) { js_open(js, key, '['); }
+void json_arr_end(json_stream_t *js)                    { js_close(js, ']'); }
+
+void json_kv_str(json_stream_t *js, const char *key, const char *val)
+{
+    js_item(js, key);
+    if (val) js_put_escaped(js, val);
+    else json_stream_write(js, "null", 4);
+}
+
+void json_kv_int(json_stream_t *js, const char *key, int64_t val)
+{
+    js_item(js, key);
+    json_stream_printf(js, "%" PRId64, val);
+}
+
+void json_kv_bool(json_stream_t *js, const char *key, bool val)
+{
+    js_item(js, key);
+    json_stream_write(js, val ? "true" : "false", val ? 4 : 5);
+}
+
+void json_kv_null(json_stream_t *js, const char *key)
+{
+    js_item(js, key);
+    json_stream_write(js, "null", 4);
+}
+
+/* ── Parser ────────────────────────────────────────────────────── */
+
+static const char *skip_ws(const char *p)
+{
+    while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r') p++;
+    return p;
+}
+
+static int hex_val(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+/* Parse a string starting at the opening quote. Decodes into `out` if
+   non-NULL. Returns the char after the closing quote, or NULL. */
+static const char *parse_str(const char *p, char *out, size_t out_sz, size_t *out_len)
+{
+    size_t o = 0;
+    bool full = false;
+    if (*p++ != '"') return NULL;
+    while (*p && *p != '"') {
+        uint32_t cp = (unsigned char)*p++;
+        bool raw = true;        /* already UTF-8 in the body: copy as is */
+        if (cp == '\\') {
+            raw = false;
+            char e = *p++;
+            switch (e) {
+            case 'b': cp = '\b'; break;
+            case 'f': cp = '\f'; break;
+            case 'n': cp = '\n'; break;
+            case 'r': cp = '\r'; break;
+            case 't': cp = '\t'; break;
+            case 'u':
+                cp = 0;
+                for (int i = 0; i < 4; i++) {
+                    int h = hex_val(*p++);
+                    if (h < 0) return NULL;
+                    cp = (cp << 4) | h;
+                }
+                break;
+            case '\0':
+                return NULL;
+            default:
+                cp = (unsigned char)e;  /* \" \\ \/ */
+                break;
+            }
+        }
+        if (!out || full) continue;
+
+        if (raw) {
+            /* Already UTF-8: copy a lead byte with its continuation bytes,
+               so truncation never splits a character */
+            size_t n = 1;
+            if (cp >= 0xC0) {
+                while (n < 4 && ((unsigned char)p[n - 1] & 0xC0) == 0x80) n++;
+            }
+            if (o + n < out_sz) {
+                memcpy(out + o, p - 1, n);
+                o += n;
+            } else {
+                full = true;
+            }
+            p += n - 1;
+            continue;
+        }
+
+        /* UTF-8 encode \uXXXX (surrogate pairs are passed through as-is) */
+        char enc[3];
+        size_t n = 0;
+        if (cp < 0x80) {
+            enc[n++] = (char)cp;
+        } else if (cp < 0x800) {
+            enc[n++] = (char)(0xC0 | (cp >> 6));
+            enc[n++] = (char)(0x80 | (cp & 0x3F));
+        } else {
+            enc[n++] = (char)(0xE0 | (cp >> 12));
+            enc[n++] = (char)(0x80 | ((cp >> 6) & 0x3F));
+            enc[n++] = (char)(0x80 | (cp & 0x3F));
+        }
+        if (o + n < out_sz) {
+            memcpy(out + o, enc, n);
+            o += n;
+        } else {
+            full = true;    /* truncate at a character boundary */
+        }
+    }
+    if (*p != '"') return NULL;
+    if (out) out[o] = '\0';
+    if (out_len) *out_len = o;
+    return p + 1;
+}
+
+/* Skip any JSON value. Returns the char after it, or NULL. */
+static const char *skip_value(const char *p)
+{
+    p = skip_ws(p);
+    if (*p == '"') return parse_str(p, NULL, 0, NULL);
+    if (*p == '{' || *p == '[') {
+        int depth = 0;
+        do {
+            if (*p == '"') {
+                p = parse_str(p, NULL, 0, NULL);
+                if (!p) return NULL;
+                continue;
+            }
+            if (*p == '{' || *p == '[') depth++;
+            else if (*p == '}' || *p == ']') depth--;
+            else if (*p == '\0') return NULL;
+            p++;
+        } while (depth > 0);
+        return p;
+    }
+    /* number / true / false / null */
+    const char *start = p;
+    while (*p && *p != ',' && *p != '}' && *p != ']' &&
+           *p != ' ' && *p != '\t' && *p != '\n' && *p != '\r') p++;
+    return (p > start) ? p : NULL;
+}
+
+/* Value of top-level member `key` of a flat object, or NULL */
+static const char *find_member(const char *json, const char *key)
+{
+    if (!json) return NULL;
+
+    const char *p = skip_ws(json);
+    if (*p++ != '{') return NULL;
+
+    while (1) {
+        p = skip_ws(p);
+        if (*p == '}') return NULL;
+
+        char name[32];
+        size_t name_len;
+        p = parse_str(p, name, sizeof(name), &name_len);
+        if (!p) return NULL;
+        p = skip_ws(p);
+        if (*p++ != ':') return NULL;
+        p = skip_ws(p);
+
+        if (strcmp(name, key) == 0) return p;
+
+        p = skip_value(p);
+        if (!p) return NULL;
+        p = skip_ws(p);
+        if (*p == ',') p++;
+        else if (*p != '}') return NULL;
+    }
+}
+
+bool json_get_string(const char *json, const char *key, char *out, size_t out_sz)
+{
+    if (out_sz == 0) return false;
+    const char *p = find_member(json, key);
+    return p && *p == '"' && parse_str(p, out, out_sz, NULL) != NULL;
+}
+
+bool json_get_int(const char *json, const char *key, int64_t *out)
+{
+    const char *p = find_member(json, key);
+    if (!p || (*p != '-' && (*p < '0' || *p > '9'))) return false;
+
+    char *end;
+    long long v = strtoll(p, &end, 10);
+    if (*end == '.' || *end == 'e' || *end == 'E') return false;
+    *out = v;
+    return true;
+}
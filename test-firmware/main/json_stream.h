@@ -0,0 +1,73 @@
+#pragma once
+
+#include "esp_err.h"
+#include "esp_http_server.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Allocation-free streaming JSON / text response writer.
+ *
+ * Output accumulates in a fixed buffer inside the struct (keep it on the
+ * handler's stack) and goes out with httpd_resp_send_chunk() whenever it
+ * fills. A response that fits the buffer is sent in one piece with a
+ * Content-Length instead.
+ *
+ *   json_stream_t js;
+ *   json_stream_init(&js, req);
+ *   json_obj_begin(&js, NULL);
+ *   json_kv_str(&js, "project", app->project_name);
+ *   json_obj_end(&js);
+ *   return json_stream_finish(&js);
+ */
+
+#define JSON_STREAM_BUF_SIZE   512
+#define JSON_STREAM_MAX_DEPTH  8
+
+typedef struct {
+    httpd_req_t *req;
+    size_t len;
+    bool chunked;           /* at least one chunk already sent */
+    bool failed;            /* a send failed — drop further output */
+    uint8_t depth;
+    uint16_t has_items;     /* bit n: container at depth n already has an item */
+    char buf[JSON_STREAM_BUF_SIZE];
+} json_stream_t;
+
+void      json_stream_init(json_stream_t *js, httpd_req_t *req);
+esp_err_t json_stream_finish(json_stream_t *js);
+
+/* Raw text (used for non-JSON bodies such as /metrics) */
+void json_stream_write(json_stream_t *js, const char *data, size_t len);
+void json_stream_printf(json_stream_t *js, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+
+/* Containers — `key` is NULL for the top level and inside arrays */
+void json_obj_begin(json_stream_t *js, const char *key);
+void json_obj_end(json_stream_t *js);
+void json_arr_begin(json_stream_t *js, const char *key);
+void json_arr_end(json_stream_t *js);
+
+void json_kv_str(json_stream_t *js, const char *key, const char *val);
+void json_kv_int(json_stream_t *js, const char *key, int64_t val);
+void json_kv_bool(json_stream_t *js, const char *key, bool val);
+void json_kv_null(json_stream_t *js, const char *key);
+
+/**
+ * @brief Find a string member of a flat JSON object without allocating
+ *
+ * Only top-level members are matched; nested values are skipped. Escapes
+ * (including \uXXXX) are decoded into `out`, raw UTF-8 is copied unchanged,
+ * truncated to `out_sz - 1` at a character boundary.
+ *
+ * @return true if `key` exists and its value is a string
+ */
+bool json_get_string(const char *json, const char *key, char *out, size_t out_sz);
+
+/**
+ * @brief Find an integer member of a flat JSON object
+ *
+ * @return true if `key` exists and its value is a number without fraction
+ *         or exponent
+ */
+bool json_get_int(const char *json, const char *key, int64_t *out);
@@ -0,0 +1,239 @@
+#include "log_defer.h"
+#include "esp_memory_utils.h"
+#include <stdio.h>
+#include <string.h>
+
+typedef enum {
+    ARG_NONE,       /* "%%" */
+    ARG_INT,
+    ARG_INT64,
+    ARG_DOUBLE,
+    ARG_STR,
+    ARG_SKIP,       /* "%n" — consumes a pointer, never rendered */
+} arg_kind_t;
+
+#define PREC_NONE   -1
+#define PREC_STAR   -2      /* taken from the last '*' argument */
+
+/* Parse one conversion spec starting at the '%' in `p`.
+   Sets *len to the spec length, *stars to the number of '*'
+   width/precision arguments it consumes before its own value, and
+   *prec to its precision (or PREC_NONE / PREC_STAR). */
+static arg_kind_t parse_spec(const char *p, size_t *len, int *stars, int *prec)
+{
+    const char *s = p + 1;
+    int lng = 0;
+    *stars = 0;
+    *prec = PREC_NONE;
+
+    while (*s && strchr("-+ #0", *s)) s++;
+    if (*s == '*') { (*stars)++; s++; }
+    else while (*s >= '0' && *s <= '9') s++;
+    if (*s == '.') {
+        s++;
+        if (*s == '*') {
+            (*stars)++;
+            *prec = PREC_STAR;
+            s++;
+        } else {
+            *prec = 0;      /* "%.s" is precision 0 */
+            while (*s >= '0' && *s <= '9') *prec = *prec * 10 + (*s++ - '0');
+        }
+    }
+    while (*s && strchr("hlLjzt", *s)) {
+        if (*s == 'l') lng++;
+        if (*s == 'j' || *s == 'L') lng = 2;
+        s++;
+    }
+
+    char conv = *s;
+    *len = (size_t)(s - p) + (conv ? 1 : 0);
+    switch (conv) {
+    case '%':
+        return ARG_NONE;
+    case 'd': case 'i': case 'u': case 'x': case 'X': case 'o':
+        return (lng >= 2) ? ARG_INT64 : ARG_INT;
+    case 'c': case 'p':
+        return ARG_INT;
+    case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+        return ARG_DOUBLE;
+    case 's':
+        return ARG_STR;
+    case 'n':
+        return ARG_SKIP;
+    default:
+        return ARG_NONE;    /* malformed — render literally */
+    }
+}
+
+int log_defer_capture(uint8_t *rec, size_t cap, const char *fmt, va_list args)
+{
+    if (cap < 5 || !esp_ptr_in_drom(fmt)) return -1;
+
+    va_list ap;
+    va_copy(ap, args);
+
+    size_t o = 0;
+    rec[o++] = LOG_REC_DEFERRED;
+    uint32_t addr = (uint32_t)(uintptr_t)fmt;
+    memcpy(rec + o, &addr, 4);
+    o += 4;
+
+    for (const char *p = fmt; *p; p++) {
+        if (*p != '%') continue;
+
+        size_t spec_len;
+        int stars, prec;
+        arg_kind_t kind = parse_spec(p, &spec_len, &stars, &prec);
+        p += spec_len - 1;
+
+        for (int i = 0; i < stars; i++) {
+            if (o + 4 > cap) goto overflow;
+            int v = va_arg(ap, int);
+            memcpy(rec + o, &v, 4);
+            o += 4;
+            if (prec == PREC_STAR && i == stars - 1) prec = v < 0 ? PREC_NONE : v;
+        }
+
+        switch (kind) {
+        case ARG_INT: {
+            if (o + 4 > cap) goto overflow;
+            int v = va_arg(ap, int);
+            memcpy(rec + o, &v, 4);
+            o += 4;
+            break;
+        }
+        case ARG_INT64: {
+            if (o + 8 > cap) goto overflow;
+            long long v = va_arg(ap, long long);
+            memcpy(rec + o, &v, 8);
+            o += 8;
+            break;
+        }
+        case ARG_DOUBLE: {
+            if (o + 8 > cap) goto overflow;
+            double v = va_arg(ap, double);
+            memcpy(rec + o, &v, 8);
+            o += 8;
+            break;
+        }
+        case ARG_STR: {
+            const char *str = va_arg(ap, const char *);
+            if (!str) str = "(null)";
+            /* With a precision the argument need not be NUL-terminated */
+            size_t n = prec >= 0 ? strnlen(str, (size_t)prec) : strlen(str);
+            if (o + n + 1 > cap) goto overflow;
+            memcpy(rec + o, str, n);
+            rec[o + n] = '\0';
+            o += n + 1;
+            break;
+        }
+        case ARG_SKIP:
+            (void)va_arg(ap, void *);
+            break;
+        case ARG_NONE:
+            break;
+        }
+    }
+    va_end(ap);
+    return (int)o;
+
+overflow:
+    va_end(ap);
+    return -1;
+}
+
+int log_defer_format(const uint8_t *rec, size_t len, char *out, size_t cap)
+{
+    if (cap == 0) return 0;
+    if (len == 0) { out[0] = '\0'; return 0; }
+
+    if (rec[0] != LOG_REC_DEFERRED || len < 5) {
+        size_t n = len - 1;
+        if (n >= cap) n = cap - 1;
+        memcpy(out, rec + 1, n);
+        out[n] = '\0';
+        return (int)n;
+    }
+
+    uint32_t addr;
+    memcpy(&addr, rec + 1, 4);
+    const char *fmt = (const char *)(uintptr_t)addr;
+    const uint8_t *a = rec + 5;
+    const uint8_t *end = rec + len;
+    size_t o = 0;
+
+    for (const char *p = fmt; *p && o < cap - 1; p++) {
+        if (*p != '%') {
+            out[o++] = *p;
+            continue;
+        }
+
+        size_t spec_len;
+        int stars, prec;
+        arg_kind_t kind = parse_spec(p, &spec_len, &stars, &prec);
+
+        /* Copy the spec, replacing '*' with the captured value */
+        char spec[32];
+        size_t sl = 0;
+        for (size_t i = 0; i < spec_len && sl < sizeof(spec) - 12; i++) {
+            if (p[i] == '*' && a + 4 <= end) {
+                int v;
+                memcpy(&v, a, 4);
+                a += 4;
+                if (v < 0 && sl > 0 && spec[sl - 1] == '.') sl--;   /* as if omitted */
+                else sl += snprintf(spec + sl, sizeof(spec) - sl, "%d", v);
+            } else {
+                spec[sl++] = p[i];
+            }
+        }
+        spec[sl] = '\0';
+        p += spec_len - 1;
+
+        int n = 0;
+        switch (kind) {
+        case ARG_INT: {
+            if (a + 4 > end) goto done;
+            int v;
+            memcpy(&v, a, 4);
+            a += 4;
+            n = snprintf(out + o, cap - o, spec, v);
+            break;
+        }
+        case ARG_INT64: {
+            if (a + 8 > end) goto done;
+            long long v;
+            memcpy(&v, a, 8);
+            a += 8;
+            n = snprintf(out + o, cap - o, spec, v);
+            break;
+        }
+        case ARG_DOUBLE: {
+            if (a + 8 > end) goto done;
+            double v;
+            memcpy(&v, a, 8);
+            a += 8;
+            n = snprintf(out + o, cap - o, spec, v);
+            break;
+        }
+        case ARG_STR: {
+            const char *str = (const char *)a;
+            size_t sn = strnlen(str, end - a);
+            if (sn == (size_t)(end - a)) goto done;
+            a += sn + 1;
+            n = snprintf(out + o, cap - o, spec, str);
+            break;
+        }
+        case ARG_SKIP:
+            break;
+        case ARG_NONE:
+            n = (spec[1] == '%') ? snprintf(out + o, cap - o, "%%")
+                                 : snprintf(out + o, cap - o, "%s", spec);
+            break;
+        }
+        if (n > 0) o += ((size_t)n < cap - o) ? (size_t)n : cap - 1 - o;
+    }
+done:
+    out[o] = '\0';
+    return (int)o;
+}
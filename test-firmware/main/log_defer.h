@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Deferred log records — the caller stores the format-string address and
+ * the raw argument words; formatting happens later in the sender task or
+ * on the host (pi/log_decoder.py resolves the address against the ELF).
+ *
+ * Record layout (little-endian, no padding):
+ *   LOG_REC_TEXT:     [type] [text bytes ...]
+ *   LOG_REC_NET_TEXT: [type] [text bytes ...]   log target only, not serial
+ *   LOG_REC_DEFERRED: [type] [fmt address, 4 bytes] [args ...]
+ * Arguments follow the conversions in the format string, in order:
+ *   int-sized (incl. '*' width/precision, %c, %p)  4 bytes
+ *   %lld / %jd / floating point                    8 bytes
+ *   %s                                             NUL-terminated copy
+ */
+#define LOG_REC_TEXT      0x00
+#define LOG_REC_DEFERRED  0x01
+#define LOG_REC_NET_TEXT  0x02
+
+/**
+ * @brief Capture a log call as a deferred record
+ *
+ * @return Record length, or -1 if the format is not in flash or the
+ *         arguments don't fit in `cap` bytes (caller formats eagerly).
+ */
+int log_defer_capture(uint8_t *rec, size_t cap, const char *fmt, va_list args);
+
+/**
+ * @brief Render a record (text or deferred) into `out`
+ *
+ * @return Number of characters written (excluding the terminator).
+ */
+int log_defer_format(const uint8_t *rec, size_t len, char *out, size_t cap);
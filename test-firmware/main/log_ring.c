@@ -0,0 +1,151 @@
+#include "log_ring.h"
+#include "esp_cpu.h"
+#include "esp_timer.h"
+#include "freertos/task.h"
+#include <string.h>
+
+#define RING_SIZE   CONFIG_WB_UDP_LOG_RING_SIZE
+#define RING_MASK   (RING_SIZE - 1)
+
+_Static_assert((RING_SIZE & RING_MASK) == 0, "WB_UDP_LOG_RING_SIZE must be a power of two");
+
+/* Record header, stored in front of each record's bytes */
+typedef struct {
+    int64_t  ts_us;
+    uint16_t len;
+    uint16_t reserved;
+} rec_hdr_t;
+
+typedef struct {
+    uint32_t head;          /* written only by the owning core */
+    uint32_t tail;          /* written only by the consumer */
+    uint32_t drops;         /* written only by the owning core */
+    uint8_t  mem[RING_SIZE];
+} ring_t;
+
+static ring_t s_rings[portNUM_PROCESSORS];
+static TaskHandle_t s_consumer;
+
+static void ring_copy_in(ring_t *r, uint32_t pos, const void *src, size_t len)
+{
+    uint32_t off = pos & RING_MASK;
+    size_t first = RING_SIZE - off;
+    if (first >= len) {
+        memcpy(r->mem + off, src, len);
+    } else {
+        memcpy(r->mem + off, src, first);
+        memcpy(r->mem, (const uint8_t *)src + first, len - first);
+    }
+}
+
+static void ring_copy_out(const ring_t *r, uint32_t pos, void *dst, size_t len)
+{
+    uint32_t off = pos & RING_MASK;
+    size_t first = RING_SIZE - off;
+    if (first >= len) {
+        memcpy(dst, r->mem + off, len);
+    } else {
+        memcpy(dst, r->mem + off, first);
+        memcpy((uint8_t *)dst + first, r->mem, len - first);
+    }
+}
+
+esp_err_t log_ring_init(void)
+{
+    memset(s_rings, 0, sizeof(s_rings));
+    return ESP_OK;
+}
+
+bool log_ring_write(const void *data, size_t len)
+{
+    rec_hdr_t hdr = {
+        .ts_us = esp_timer_get_time(),
+        .len = (uint16_t)len,
+    };
+    size_t need = sizeof(hdr) + len;
+
+    /* Masking local interrupts makes this core the ring's only producer
+       until we're done — no task switch, no nested ISR writer. */
+    UBaseType_t irq = portSET_INTERRUPT_MASK_FROM_ISR();
+    ring_t *r = &s_rings[esp_cpu_get_core_id()];
+    uint32_t head = r->head;
+    uint32_t tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+
+    if (RING_SIZE - (head - tail) < need) {
+        r->drops++;
+        portCLEAR_INTERRUPT_MASK_FROM_ISR(irq);
+        return false;
+    }
+
+    ring_copy_in(r, head, &hdr, sizeof(hdr));
+    ring_copy_in(r, head + sizeof(hdr), data, len);
+    __atomic_store_n(&r->head, head + need, __ATOMIC_RELEASE);
+
+    /* Pairs with the fence in log_ring_read(): either we see the consumer
+       has drained up to our record (and wake it), or it sees our head. */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    bool wake = (__atomic_load_n(&r->tail, __ATOMIC_RELAXED) == head);
+    portCLEAR_INTERRUPT_MASK_FROM_ISR(irq);
+
+    /* Only the empty -> non-empty transition touches the scheduler */
+    if (wake && s_consumer) {
+        if (xPortInIsrContext()) {
+            BaseType_t woken = pdFALSE;
+            vTaskNotifyGiveFromISR(s_consumer, &woken);
+            portYIELD_FROM_ISR(woken);
+        } else {
+            xTaskNotifyGive(s_consumer);
+        }
+    }
+    return true;
+}
+
+void log_ring_set_consumer(void)
+{
+    s_consumer = xTaskGetCurrentTaskHandle();
+}
+
+size_t log_ring_read(void *dst, size_t cap, int64_t *ts_us)
+{
+    ring_t *oldest = NULL;
+    rec_hdr_t oldest_hdr;
+
+    for (int i = 0; i < portNUM_PROCESSORS; i++) {
+        ring_t *r = &s_rings[i];
+        uint32_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+        if (head == r->tail) continue;
+
+        rec_hdr_t hdr;
+        ring_copy_out(r, r->tail, &hdr, sizeof(hdr));
+        if (!oldest || hdr.ts_us < oldest_hdr.ts_us) {
+            oldest = r;
+            oldest_hdr = hdr;
+        }
+    }
+    if (!oldest) return 0;
+
+    size_t len = oldest_hdr.len;
+    ring_copy_out(oldest, oldest->tail + sizeof(rec_hdr_t), dst, len < cap ? len : cap);
+    __atomic_store_n(&oldest->tail, oldest->tail + sizeof(rec_hdr_t) + len, __ATOMIC_RELEASE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    if (ts_us) *ts_us = oldest_hdr.ts_us;
+    return len < cap ? len : cap;
+}
+
+void log_ring_wait(TickType_t timeout)
+{
+    ulTaskNotifyTake(pdTRUE, timeout);
+}
+
+uint32_t log_ring_drops(int core)
+{
+    return __atomic_load_n(&s_rings[core].drops, __ATOMIC_RELAXED);
+}
+
+size_t log_ring_used(int core)
+{
+    const ring_t *r = &s_rings[core];
+    uint32_t tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);   /* tail first: never passes head */
+    return __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) - tail;
+}
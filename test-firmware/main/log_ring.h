@@ -0,0 +1,44 @@
+#pragma once
+
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Per-core log ring — one single-producer/single-consumer ring per CPU.
+ *
+ * Writers only ever touch the ring of the core they run on, with that
+ * core's interrupts masked for the duration of the copy, so there is no
+ * lock and no cross-core contention; a write either fits or is dropped
+ * (and counted) in bounded time. Safe from tasks and ISRs.
+ *
+ * A single consumer task drains all rings, merging records in timestamp
+ * order.
+ */
+
+esp_err_t log_ring_init(void);
+
+/** Any context. Returns false (and counts a drop) if the ring is full. */
+bool      log_ring_write(const void *data, size_t len);
+
+/** Consumer only: must be called once from the draining task. */
+void      log_ring_set_consumer(void);
+
+/**
+ * @brief Consumer only: pop the oldest record across all cores
+ *
+ * @param ts_us  Optional: receives the esp_timer timestamp of the record
+ * @return Record length, 0 if all rings are empty. Records longer than
+ *         `cap` are truncated.
+ */
+size_t    log_ring_read(void *dst, size_t cap, int64_t *ts_us);
+
+/** Consumer only: block until a writer signals new data (or timeout). */
+void      log_ring_wait(TickType_t timeout);
+
+/** Records dropped on `core` since boot. */
+uint32_t  log_ring_drops(int core);
+
+/** Bytes currently queued on `core`. */
+size_t    log_ring_used(int core);
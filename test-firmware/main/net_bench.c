@@ -0,0 +1,342 @@
+#include "net_bench.h"
+#include "udp_log.h"
+#include "wifi_prov.h"
+#include "metrics.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "lwip/sockets.h"
+#if CONFIG_LWIP_STATS
+#include "lwip/stats.h"
+#endif
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+static const char *TAG = "net_bench";
+
+#define BENCH_STACK         4096
+#define BENCH_PRIO          4
+#define BENCH_DEFAULT_MS    5000
+#define TCP_BUF_SIZE        4096
+#define TCP_TIMEOUT_S       5
+#define ECHO_TIMEOUT_MS     200
+/* lwIP out of pbufs: yield one tick so the WiFi task can drain. Not
+   udp_log's SINK_RETRY_TICKS: its 50 ms suits a log batch that can wait,
+   but would cap the very throughput being measured */
+#define SEND_RETRY_TICKS    1
+
+static const char *const s_mode_names[NET_BENCH_COUNT] = {
+    [NET_BENCH_HTTP_DOWNLOAD] = "http_download",
+    [NET_BENCH_HTTP_UPLOAD]   = "http_upload",
+    [NET_BENCH_UDP_BLAST]     = "udp_blast",
+    [NET_BENCH_UDP_ECHO]      = "udp_echo",
+    [NET_BENCH_TCP_SEND]      = "tcp_send",
+    [NET_BENCH_TCP_RECV]      = "tcp_recv",
+};
+
+static bool s_busy;
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+static net_bench_result_t s_results[NET_BENCH_COUNT];
+static int64_t s_t0_us;
+static int32_t s_rexmit0;
+
+static metric_t s_m_runs = METRIC_COUNTER_INIT("net_bench_runs_total");
+static metric_t s_m_kbps = METRIC_GAUGE_INIT("net_bench_last_kbps");
+static bool s_metrics_registered;
+
+static int32_t read_rexmit(void)
+{
+#if CONFIG_LWIP_STATS && TCP_STATS
+    return (int32_t)lwip_stats.tcp.rexmit;
+#else
+    return -1;
+#endif
+}
+
+static void put_be32(uint8_t *p, uint32_t v)
+{
+    p[0] = v >> 24; p[1] = v >> 16; p[2] = v >> 8; p[3] = v;
+}
+
+static uint32_t get_be32(const uint8_t *p)
+{
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+/* ── Run bookkeeping ───────────────────────────────────────────── */
+
+static esp_err_t run_claim(net_bench_mode_t mode)
+{
+    bool idle = false;
+    if (!__atomic_compare_exchange_n(&s_busy, &idle, true, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (!s_metrics_registered) {
+        s_metrics_registered = true;
+        metrics_register(&s_m_runs);
+        metrics_register(&s_m_kbps);
+    }
+
+    s_t0_us = esp_timer_get_time();
+    s_rexmit0 = read_rexmit();
+    taskENTER_CRITICAL(&s_lock);
+    s_results[mode].running = true;
+    taskEXIT_CRITICAL(&s_lock);
+    return ESP_OK;
+}
+
+/* Fill in time, rate, retransmits and RSSI, publish, release the slot */
+static void run_finish(net_bench_mode_t mode, net_bench_result_t *r)
+{
+    int64_t us = esp_timer_get_time() - s_t0_us;
+    int32_t rexmit = read_rexmit();
+
+    r->valid = true;
+    r->running = false;
+    r->duration_ms = (uint32_t)(us / 1000);
+    r->kbps = us > 0 ? (uint32_t)(r->bytes * 8000 / (uint64_t)us) : 0;
+    r->retransmits = (rexmit >= 0 && s_rexmit0 >= 0) ? rexmit - s_rexmit0 : -1;
+    r->rssi = wifi_prov_rssi();
+
+    taskENTER_CRITICAL(&s_lock);
+    s_results[mode] = *r;
+    taskEXIT_CRITICAL(&s_lock);
+
+    metric_inc(&s_m_runs);
+    metric_set(&s_m_kbps, r->kbps);
+    ESP_LOGI(TAG, "%s: %llu bytes in %lu ms, %lu.%03lu Mbit/s, rssi %d%s%s",
+             s_mode_names[mode], (unsigned long long)r->bytes, (unsigned long)r->duration_ms,
+             (unsigned long)(r->kbps / 1000), (unsigned long)(r->kbps % 1000), r->rssi,
+             r->err != ESP_OK ? ", error " : "", r->err != ESP_OK ? esp_err_to_name(r->err) : "");
+    __atomic_store_n(&s_busy, false, __ATOMIC_RELEASE);
+}
+
+/* ── Socket modes ──────────────────────────────────────────────── */
+
+static void udp_blast(int sock, uint16_t size, int64_t deadline, net_bench_result_t *r)
+{
+    uint8_t *buf = calloc(1, size);
+    if (!buf) {
+        r->err = ESP_ERR_NO_MEM;
+        return;
+    }
+    buf[0] = 'B';
+    for (uint32_t seq = 0; esp_timer_get_time() < deadline; ) {
+        put_be32(buf + 1, seq);
+        if (send(sock, buf, size, 0) == size) {
+            seq++;
+            r->packets++;
+            r->bytes += size;
+        } else {
+            r->errors++;
+            if (errno == ENOMEM) vTaskDelay(SEND_RETRY_TICKS);
+        }
+    }
+    free(buf);
+}
+
+static void udp_echo(int sock, uint16_t size, int64_t deadline, net_bench_result_t *r)
+{
+    uint8_t *tx = calloc(1, size), *rx = malloc(size);
+    if (!tx || !rx) {
+        free(tx);
+        free(rx);
+        r->err = ESP_ERR_NO_MEM;
+        return;
+    }
+    struct timeval tv = { .tv_sec = 0, .tv_usec = ECHO_TIMEOUT_MS * 1000 };
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    uint64_t rtt_sum = 0;
+    tx[0] = 'E';
+    for (uint32_t seq = 0; esp_timer_get_time() < deadline; seq++) {
+        put_be32(tx + 1, seq);
+        int64_t sent = esp_timer_get_time();
+        if (send(sock, tx, size, 0) != size) {
+            r->errors++;
+            vTaskDelay(SEND_RETRY_TICKS);
+            continue;
+        }
+        /* Late replies to earlier sequence numbers are skipped */
+        bool echoed = false;
+        int n;
+        while ((n = recv(sock, rx, size, 0)) >= 5) {
+            if (rx[0] == 'E' && get_be32(rx + 1) == seq) {
+                echoed = true;
+                break;
+            }
+        }
+        if (!echoed) {
+            r->errors++;
+            continue;
+        }
+        uint32_t rtt = (uint32_t)(esp_timer_get_time() - sent);
+        rtt_sum += rtt;
+        if (rtt > r->rtt_max_us) r->rtt_max_us = rtt;
+        r->packets++;
+        r->bytes += n;
+    }
+    if (r->packets) r->rtt_avg_us = (uint32_t)(rtt_sum / r->packets);
+    free(tx);
+    free(rx);
+}
+
+static void tcp_stream(int sock, bool board_sends, int64_t deadline, net_bench_result_t *r)
+{
+    uint8_t *buf = malloc(TCP_BUF_SIZE);
+    if (!buf) {
+        r->err = ESP_ERR_NO_MEM;
+        return;
+    }
+    memset(buf, 0xA5, TCP_BUF_SIZE);
+
+    const char hello[5] = { 'W', 'B', 'B', '1', board_sends ? 'S' : 'R' };
+    if (send(sock, hello, sizeof(hello), 0) != sizeof(hello)) {
+        r->err = ESP_FAIL;
+        free(buf);
+        return;
+    }
+    while (esp_timer_get_time() < deadline) {
+        int n = board_sends ? send(sock, buf, TCP_BUF_SIZE, 0) : recv(sock, buf, TCP_BUF_SIZE, 0);
+        if (n > 0) {
+            r->bytes += n;
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) continue;   /* timeout slice */
+        r->err = n == 0 ? ESP_ERR_INVALID_RESPONSE : ESP_FAIL;  /* peer closed early / reset */
+        break;
+    }
+    free(buf);
+}
+
+static void bench_task(void *arg)
+{
+    net_bench_req_t req = *(net_bench_req_t *)arg;
+    free(arg);
+
+    net_bench_result_t r = { .err = ESP_OK };
+    bool udp = req.mode == NET_BENCH_UDP_BLAST || req.mode == NET_BENCH_UDP_ECHO;
+    struct sockaddr_in to = {
+        .sin_family = AF_INET,
+        .sin_port = htons(req.port),
+    };
+    inet_pton(AF_INET, req.host, &to.sin_addr);
+
+    int sock = socket(AF_INET, udp ? SOCK_DGRAM : SOCK_STREAM, udp ? IPPROTO_UDP : IPPROTO_TCP);
+    if (sock < 0) {
+        r.err = ESP_ERR_NO_MEM;
+        goto done;
+    }
+    if (!udp) {
+        struct timeval tv = { .tv_sec = TCP_TIMEOUT_S };
+        setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+        setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    }
+    /* UDP connect() only fixes the peer, so send() can skip the address */
+    if (connect(sock, (struct sockaddr *)&to, sizeof(to)) != 0) {
+        ESP_LOGW(TAG, "connect %s:%u: errno %d", req.host, req.port, errno);
+        r.err = ESP_ERR_NOT_FOUND;
+        goto done;
+    }
+
+    /* The clock starts once the peer is reachable */
+    s_t0_us = esp_timer_get_time();
+    int64_t deadline = s_t0_us + (int64_t)req.duration_ms * 1000;
+    switch (req.mode) {
+    case NET_BENCH_UDP_BLAST: udp_blast(sock, req.size, deadline, &r); break;
+    case NET_BENCH_UDP_ECHO:  udp_echo(sock, req.size, deadline, &r); break;
+    case NET_BENCH_TCP_SEND:  tcp_stream(sock, true, deadline, &r); break;
+    case NET_BENCH_TCP_RECV:  tcp_stream(sock, false, deadline, &r); break;
+    default: break;
+    }
+
+done:
+    if (sock >= 0) close(sock);
+    run_finish(req.mode, &r);
+    vTaskDelete(NULL);
+}
+
+/* ── API ───────────────────────────────────────────────────────── */
+
+esp_err_t net_bench_start(const net_bench_req_t *req)
+{
+    if (req->mode != NET_BENCH_UDP_BLAST && req->mode != NET_BENCH_UDP_ECHO &&
+        req->mode != NET_BENCH_TCP_SEND && req->mode != NET_BENCH_TCP_RECV) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    net_bench_req_t *job = malloc(sizeof(*job));
+    if (!job) return ESP_ERR_NO_MEM;
+    *job = *req;
+    if (!job->host[0]) {
+        nvs_log_target_t t;
+        udp_log_get_target(&t);
+        memcpy(job->host, t.host, sizeof(job->host));
+    }
+    if (!job->port) job->port = NET_BENCH_PORT;
+    if (!job->duration_ms) job->duration_ms = BENCH_DEFAULT_MS;
+    if (job->duration_ms > NET_BENCH_MAX_MS) job->duration_ms = NET_BENCH_MAX_MS;
+    if (!job->size || job->size > NET_BENCH_DATAGRAM_MAX) job->size = NET_BENCH_DATAGRAM_MAX;
+    if (job->size < 5) job->size = 5;       /* tag + sequence */
+
+    struct in_addr addr;
+    if (inet_pton(AF_INET, job->host, &addr) != 1) {
+        free(job);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    esp_err_t err = run_claim(job->mode);
+    if (err != ESP_OK) {
+        free(job);
+        return err;
+    }
+    if (xTaskCreate(bench_task, "net_bench", BENCH_STACK, job, BENCH_PRIO, NULL) != pdPASS) {
+        net_bench_result_t r = { .err = ESP_ERR_NO_MEM };
+        run_finish(job->mode, &r);
+        free(job);
+        return ESP_ERR_NO_MEM;
+    }
+    ESP_LOGI(TAG, "%s to %s:%u for %lu ms", s_mode_names[job->mode], job->host, job->port,
+             (unsigned long)job->duration_ms);
+    return ESP_OK;
+}
+
+esp_err_t net_bench_begin(net_bench_mode_t mode)
+{
+    if (mode != NET_BENCH_HTTP_DOWNLOAD && mode != NET_BENCH_HTTP_UPLOAD) return ESP_ERR_INVALID_ARG;
+    return run_claim(mode);
+}
+
+void net_bench_end(net_bench_mode_t mode, uint64_t bytes, esp_err_t err)
+{
+    net_bench_result_t r = { .bytes = bytes, .err = err };
+    run_finish(mode, &r);
+}
+
+void net_bench_get(net_bench_mode_t mode, net_bench_result_t *out)
+{
+    *out = (net_bench_result_t){ 0 };
+    if (mode >= NET_BENCH_COUNT) return;
+    taskENTER_CRITICAL(&s_lock);
+    *out = s_results[mode];
+    taskEXIT_CRITICAL(&s_lock);
+}
+
+const char *net_bench_mode_name(net_bench_mode_t mode)
+{
+    return mode < NET_BENCH_COUNT ? s_mode_names[mode] : "?";
+}
+
+bool net_bench_parse_mode(const char *name, net_bench_mode_t *out)
+{
+    for (int i = 0; i < NET_BENCH_COUNT; i++) {
+        if (strcasecmp(name, s_mode_names[i]) == 0) {
+            *out = i;
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "esp_err.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Network throughput benchmarks. One runs at a time.
+ *
+ *   http_download  GET /bench/download?bytes=N streams N pattern bytes
+ *   http_upload    POST /bench/upload discards the body
+ *   udp_blast      datagrams to host:port as fast as lwIP takes them
+ *   udp_echo       one datagram in flight, the peer sends it back (RTT, loss)
+ *   tcp_send       iperf-style stream from the board to the peer
+ *   tcp_recv       the same stream, peer to board
+ *
+ * The socket modes dial a bench peer (pi/portal.py, BENCH_PORT 5201) at
+ * the log target's host unless told otherwise. TCP connections open with
+ * "WBB1" and 'S' (board sends) or 'R' (peer sends); UDP datagrams start
+ * with 'B' (count only) or 'E' (echo back) and a big-endian sequence.
+ */
+typedef enum {
+    NET_BENCH_HTTP_DOWNLOAD,
+    NET_BENCH_HTTP_UPLOAD,
+    NET_BENCH_UDP_BLAST,
+    NET_BENCH_UDP_ECHO,
+    NET_BENCH_TCP_SEND,
+    NET_BENCH_TCP_RECV,
+    NET_BENCH_COUNT,
+} net_bench_mode_t;
+
+#define NET_BENCH_PORT          5201
+#define NET_BENCH_MAX_MS        60000
+#define NET_BENCH_DATAGRAM_MAX  1472
+
+typedef struct {
+    net_bench_mode_t mode;
+    char host[16];              /* dotted IPv4; empty = log target host */
+    uint16_t port;              /* 0 = NET_BENCH_PORT */
+    uint32_t duration_ms;       /* 0 = 5 s */
+    uint16_t size;              /* UDP payload, 0 = NET_BENCH_DATAGRAM_MAX */
+} net_bench_req_t;
+
+typedef struct {
+    bool valid;                 /* this mode has run since boot */
+    bool running;
+    uint64_t bytes;
+    uint32_t packets;           /* datagrams sent / echoed */
+    uint32_t errors;            /* send failures, or echoes that never came back */
+    uint32_t duration_ms;
+    uint32_t kbps;              /* payload, 1000 bit/s units */
+    int32_t retransmits;        /* TCP segments, all connections; -1 without CONFIG_LWIP_STATS */
+    uint32_t rtt_avg_us;        /* udp_echo only */
+    uint32_t rtt_max_us;
+    int8_t rssi;
+    esp_err_t err;
+} net_bench_result_t;
+
+/**
+ * @brief Start a socket benchmark in the background
+ *
+ * @return ESP_ERR_INVALID_STATE while another benchmark runs,
+ *         ESP_ERR_INVALID_ARG for an HTTP mode or a bad host
+ */
+esp_err_t net_bench_start(const net_bench_req_t *req);
+
+/**
+ * @brief Claim the benchmark slot for an HTTP transfer run by a handler
+ *
+ * @return ESP_ERR_INVALID_STATE while another benchmark runs
+ */
+esp_err_t net_bench_begin(net_bench_mode_t mode);
+
+/**
+ * @brief Record an HTTP transfer started with net_bench_begin()
+ */
+void net_bench_end(net_bench_mode_t mode, uint64_t bytes, esp_err_t err);
+
+void        net_bench_get(net_bench_mode_t mode, net_bench_result_t *out);
+const char *net_bench_mode_name(net_bench_mode_t mode);
+bool        net_bench_parse_mode(const char *name, net_bench_mode_t *out);
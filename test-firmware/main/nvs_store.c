@@ -1,12 +1,149 @@
 #include "nvs_store.h"
+#include "metrics.h"
 #include "nvs_flash.h"
 #include "nvs.h"
+#include "esp_bit_defs.h"
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
 #include <string.h>
 
 static const char *TAG = "nvs_store";
 static const char *NVS_NAMESPACE = "wb_test";
 
+/* Everything the firmware keeps in NVS, loaded once by nvs_store_init().
+   Getters read this copy; setters change it and mark the keys dirty, and
+   one commit writes all dirty keys COMMIT_DELAY_MS after the first change. */
+#define COMMIT_DELAY_MS     CONFIG_WB_NVS_COMMIT_DELAY_MS
+
+enum {
+    DIRTY_WIFI       = BIT(0),     /* wifi_ssid + wifi_pass */
+    DIRTY_WIFI_FAST  = BIT(1),
+    DIRTY_LOG_TARGET = BIT(2),
+    DIRTY_BOOT_COUNT = BIT(3),
+    DIRTY_POWER      = BIT(4),
+};
+
+static struct {
+    bool has_wifi;
+    char ssid[33];
+    char pass[65];
+    bool has_fast;
+    nvs_wifi_fast_t fast;
+    bool has_log_target;
+    nvs_log_target_t log_target;
+    bool has_power;
+    nvs_power_t power;
+    uint32_t boot_count;
+} s_cache;
+
+static uint32_t s_dirty;
+static esp_err_t s_commit_err;          /* last commit attempt, returned by deferred setters */
+static SemaphoreHandle_t s_lock;
+static esp_timer_handle_t s_commit_timer;
+
+static metric_t s_m_writes = METRIC_COUNTER_INIT("nvs_writes_total");
+static metric_t s_m_commits = METRIC_COUNTER_INIT("nvs_commits_total");
+static metric_t s_m_errors = METRIC_COUNTER_INIT("nvs_commit_errors_total");
+
+/* ── Flash side ────────────────────────────────────────────────── */
+
+static void cache_load(void)
+{
+    nvs_handle_t h;
+    if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &h) != ESP_OK) return;   /* nothing stored yet */
+
+    size_t ssid_len = sizeof(s_cache.ssid), pass_len = sizeof(s_cache.pass);
+    s_cache.has_wifi = nvs_get_str(h, "wifi_ssid", s_cache.ssid, &ssid_len) == ESP_OK &&
+                       nvs_get_str(h, "wifi_pass", s_cache.pass, &pass_len) == ESP_OK;
+
+    size_t len = sizeof(s_cache.fast);
+    s_cache.has_fast = nvs_get_blob(h, "wifi_fast", &s_cache.fast, &len) == ESP_OK &&
+                       len == sizeof(s_cache.fast) && s_cache.fast.channel != 0;
+
+    len = sizeof(s_cache.log_target);
+    s_cache.has_log_target = nvs_get_blob(h, "log_target", &s_cache.log_target, &len) == ESP_OK &&
+                             len == sizeof(s_cache.log_target) &&
+                             s_cache.log_target.host[sizeof(s_cache.log_target.host) - 1] == '\0';
+
+    len = sizeof(s_cache.power);
+    s_cache.has_power = nvs_get_blob(h, "power", &s_cache.power, &len) == ESP_OK &&
+                        len == sizeof(s_cache.power);
+
+    nvs_get_u32(h, "boot_count", &s_cache.boot_count);
+    nvs_close(h);
+}
+
+/* Write every dirty key with one commit. Caller holds s_lock. */
+static esp_err_t commit_locked(void)
+{
+    if (!s_dirty) return ESP_OK;
+
+    nvs_handle_t h;
+    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &h);
+    if (err != ESP_OK) goto out;
+
+    if (s_dirty & DIRTY_WIFI) {
+        if (s_cache.has_wifi) {
+            err = nvs_set_str(h, "wifi_ssid", s_cache.ssid);
+            if (err == ESP_OK) err = nvs_set_str(h, "wifi_pass", s_cache.pass);
+        } else {
+            nvs_erase_key(h, "wifi_ssid");
+            nvs_erase_key(h, "wifi_pass");
+        }
+    }
+    if (err == ESP_OK && (s_dirty & DIRTY_WIFI_FAST)) {
+        if (s_cache.has_fast) {
+            err = nvs_set_blob(h, "wifi_fast", &s_cache.fast, sizeof(s_cache.fast));
+        } else {
+            nvs_erase_key(h, "wifi_fast");
+        }
+    }
+    if (err == ESP_OK && (s_dirty & DIRTY_LOG_TARGET)) {
+        err = nvs_set_blob(h, "log_target", &s_cache.log_target, sizeof(s_cache.log_target));
+    }
+    if (err == ESP_OK && (s_dirty & DIRTY_POWER)) {
+        err = nvs_set_blob(h, "power", &s_cache.power, sizeof(s_cache.power));
+    }
+    if (err == ESP_OK && (s_dirty & DIRTY_BOOT_COUNT)) {
+        err = nvs_set_u32(h, "boot_count", s_cache.boot_count);
+    }
+    if (err == ESP_OK) err = nvs_commit(h);
+    nvs_close(h);
+
+out:
+    s_commit_err = err;
+    if (err == ESP_OK) {
+        s_dirty = 0;
+        metric_inc(&s_m_commits);
+    } else {
+        /* Keys stay dirty; the next change or flush retries */
+        metric_inc(&s_m_errors);
+        ESP_LOGE(TAG, "Commit failed: %s", esp_err_to_name(err));
+    }
+    return err;
+}
+
+static void commit_timer_cb(void *arg)
+{
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    commit_locked();
+    xSemaphoreGive(s_lock);
+}
+
+/* Caller holds s_lock. The first change arms the timer; later ones ride along. */
+static void mark_dirty_locked(uint32_t keys)
+{
+    metric_inc(&s_m_writes);
+    s_dirty |= keys;
+    if (!esp_timer_is_active(s_commit_timer)) {
+        esp_timer_start_once(s_commit_timer, COMMIT_DELAY_MS * 1000ULL);
+    }
+}
+
+/* ── API ───────────────────────────────────────────────────────── */
+
 esp_err_t nvs_store_init(void)
 {
     esp_err_t err = nvs_flash_init();
@@ -16,51 +153,152 @@ esp_err_t nvs_store_init(void)
         err = nvs_flash_init();
     }
     ESP_ERROR_CHECK(err);
-    ESP_LOGI(TAG, "NVS initialized");
+
+    s_lock = xSemaphoreCreateMutex();
+    if (!s_lock) return ESP_ERR_NO_MEM;
+    static const esp_timer_create_args_t timer_args = {
+        .callback = commit_timer_cb, .name = "nvs_commit"
+    };
+    err = esp_timer_create(&timer_args, &s_commit_timer);
+    if (err != ESP_OK) return err;
+
+    cache_load();
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    s_cache.boot_count++;
+    s_dirty |= DIRTY_BOOT_COUNT;
+    commit_locked();                    /* now, so boot loops are counted too */
+    xSemaphoreGive(s_lock);
+
+    metrics_register(&s_m_writes);
+    metrics_register(&s_m_commits);
+    metrics_register(&s_m_errors);
+    ESP_LOGI(TAG, "NVS initialized, boot #%lu", (unsigned long)s_cache.boot_count);
     return ESP_OK;
 }
 
-esp_err_t nvs_store_set_wifi(const char *ssid, const char *password)
+esp_err_t nvs_store_flush(void)
 {
-    nvs_handle_t h;
-    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &h);
-    if (err != ESP_OK) return err;
+    if (!s_lock) return ESP_ERR_INVALID_STATE;
 
-    err = nvs_set_str(h, "wifi_ssid", ssid);
-    if (err == ESP_OK) {
-        err = nvs_set_str(h, "wifi_pass", password);
-    }
-    if (err == ESP_OK) {
-        err = nvs_commit(h);
+    esp_timer_stop(s_commit_timer);     /* fails harmlessly when not armed */
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    esp_err_t err = commit_locked();
+    xSemaphoreGive(s_lock);
+    return err;
+}
+
+esp_err_t nvs_store_set_wifi(const char *ssid, const char *password)
+{
+    if (strlen(ssid) >= sizeof(s_cache.ssid) || strlen(password) >= sizeof(s_cache.pass)) {
+        return ESP_ERR_INVALID_ARG;
     }
-    nvs_close(h);
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    s_cache.has_wifi = true;
+    strcpy(s_cache.ssid, ssid);
+    strcpy(s_cache.pass, password);
+    s_cache.has_fast = false;           /* cached BSSID/PMK belong to the old network */
+    mark_dirty_locked(DIRTY_WIFI | DIRTY_WIFI_FAST);
+    xSemaphoreGive(s_lock);
+
     ESP_LOGI(TAG, "WiFi credentials saved (SSID: %s)", ssid);
-    return err;
+    return nvs_store_flush();           /* callers reboot right after */
 }
 
 bool nvs_store_get_wifi(char *ssid, size_t ssid_len, char *password, size_t pass_len)
 {
-    nvs_handle_t h;
-    if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &h) != ESP_OK) return false;
-
-    esp_err_t err = nvs_get_str(h, "wifi_ssid", ssid, &ssid_len);
-    if (err == ESP_OK) {
-        err = nvs_get_str(h, "wifi_pass", password, &pass_len);
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    bool ok = s_cache.has_wifi && strlen(s_cache.ssid) < ssid_len && strlen(s_cache.pass) < pass_len;
+    if (ok) {
+        strcpy(ssid, s_cache.ssid);
+        strcpy(password, s_cache.pass);
     }
-    nvs_close(h);
-    return (err == ESP_OK);
+    xSemaphoreGive(s_lock);
+    return ok;
 }
 
 esp_err_t nvs_store_erase_wifi(void)
 {
-    nvs_handle_t h;
-    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &h);
-    if (err != ESP_OK) return err;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    s_cache.has_wifi = false;
+    s_cache.has_fast = false;
+    memset(s_cache.ssid, 0, sizeof(s_cache.ssid));
+    memset(s_cache.pass, 0, sizeof(s_cache.pass));
+    mark_dirty_locked(DIRTY_WIFI | DIRTY_WIFI_FAST);
+    xSemaphoreGive(s_lock);
 
-    nvs_erase_key(h, "wifi_ssid");
-    nvs_erase_key(h, "wifi_pass");
-    err = nvs_commit(h);
-    nvs_close(h);
     ESP_LOGI(TAG, "WiFi credentials erased");
+    return nvs_store_flush();
+}
+
+esp_err_t nvs_store_set_wifi_fast(const nvs_wifi_fast_t *fast)
+{
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (!s_cache.has_fast || memcmp(&s_cache.fast, fast, sizeof(*fast)) != 0) {
+        s_cache.fast = *fast;
+        s_cache.has_fast = true;
+        mark_dirty_locked(DIRTY_WIFI_FAST);
+    }
+    esp_err_t err = s_commit_err;
+    xSemaphoreGive(s_lock);
+    return err;
+}
+
+bool nvs_store_get_wifi_fast(nvs_wifi_fast_t *fast)
+{
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    bool ok = s_cache.has_fast;
+    if (ok) *fast = s_cache.fast;
+    xSemaphoreGive(s_lock);
+    return ok;
+}
+
+esp_err_t nvs_store_set_log_target(const nvs_log_target_t *target)
+{
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (!s_cache.has_log_target || memcmp(&s_cache.log_target, target, sizeof(*target)) != 0) {
+        s_cache.log_target = *target;
+        s_cache.has_log_target = true;
+        mark_dirty_locked(DIRTY_LOG_TARGET);
+    }
+    esp_err_t err = s_commit_err;
+    xSemaphoreGive(s_lock);
+    return err;
+}
+
+bool nvs_store_get_log_target(nvs_log_target_t *target)
+{
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    bool ok = s_cache.has_log_target;
+    if (ok) *target = s_cache.log_target;
+    xSemaphoreGive(s_lock);
+    return ok;
+}
+
+esp_err_t nvs_store_set_power(const nvs_power_t *power)
+{
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (!s_cache.has_power || memcmp(&s_cache.power, power, sizeof(*power)) != 0) {
+        s_cache.power = *power;
+        s_cache.has_power = true;
+        mark_dirty_locked(DIRTY_POWER);
+    }
+    esp_err_t err = s_commit_err;
+    xSemaphoreGive(s_lock);
     return err;
 }
+
+bool nvs_store_get_power(nvs_power_t *power)
+{
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    bool ok = s_cache.has_power;
+    if (ok) *power = s_cache.power;
+    xSemaphoreGive(s_lock);
+    return ok;
+}
+
+uint32_t nvs_store_boot_count(void)
+{
+    return s_cache.boot_count;      /* only written by nvs_store_init() */
+}
@@ -2,8 +2,57 @@
 
 #include "esp_err.h"
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
+/* Association parameters from the last successful STA connect, so the next
+   boot can join without scanning. Cleared whenever the credentials change. */
+typedef struct {
+    uint8_t bssid[6];
+    uint8_t channel;
+    uint8_t has_pmk;        /* WPA/WPA2-PSK only */
+    uint8_t pmk[32];
+} nvs_wifi_fast_t;
+
+/* Where udp_log sends the log stream (transport is a log_transport_t) */
+typedef struct {
+    uint8_t transport;
+    uint16_t port;
+    char host[16];          /* dotted IPv4 */
+} nvs_log_target_t;
+
+/* Power profile (profile is a power_profile_t) */
+typedef struct {
+    uint8_t profile;
+    uint8_t listen_interval;    /* beacon intervals, modem/light profiles */
+} nvs_power_t;
+
+/**
+ * @brief Mount NVS, load every setting into RAM and count this boot
+ *
+ * Getters below read the RAM copy. Setters update it and commit all
+ * changed keys together CONFIG_WB_NVS_COMMIT_DELAY_MS after the first
+ * change; storing an unchanged value does not touch flash. Credential
+ * changes are committed before returning, since a reboot follows.
+ *
+ * The other setters return the result of the last commit attempt: an
+ * error means flash writes are failing and the value is held in RAM
+ * only, to be retried with the next change or flush.
+ */
 esp_err_t nvs_store_init(void);
+
+/**
+ * @brief Commit pending changes now (call before esp_restart())
+ */
+esp_err_t nvs_store_flush(void);
+
 esp_err_t nvs_store_set_wifi(const char *ssid, const char *password);
 bool      nvs_store_get_wifi(char *ssid, size_t ssid_len, char *password, size_t pass_len);
 esp_err_t nvs_store_erase_wifi(void);
+esp_err_t nvs_store_set_wifi_fast(const nvs_wifi_fast_t *fast);
+bool      nvs_store_get_wifi_fast(nvs_wifi_fast_t *fast);
+esp_err_t nvs_store_set_log_target(const nvs_log_target_t *target);
+bool      nvs_store_get_log_target(nvs_log_target_t *target);
+esp_err_t nvs_store_set_power(const nvs_power_t *power);
+bool      nvs_store_get_power(nvs_power_t *power);
+uint32_t  nvs_store_boot_count(void);    /* 1 on the first boot after an erase */
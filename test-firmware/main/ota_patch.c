@@ -0,0 +1,284 @@
+#include "ota_patch.h"
+#include "esp_log.h"
+#include "esp_partition.h"
+#include "mbedtls/sha256.h"
+#include "rom/miniz.h"
+#include <stdlib.h>
+#include <string.h>
+
+static const char *TAG = "ota_patch";
+
+#define OP_END      0x00
+#define OP_COPY     0x01
+#define OP_INSERT   0x02
+
+#define DICT_SIZE   TINFL_LZ_DICT_SIZE     /* 32 KB inflate window, power of two */
+
+struct ota_patch {
+    esp_ota_handle_t handle;
+    const esp_partition_t *base;
+    ota_patch_hdr_t hdr;
+    size_t hdr_len;
+    uint32_t written;
+    mbedtls_sha256_context sha;
+
+    /* Delta op decoder */
+    uint8_t op[9];
+    size_t op_len;
+    uint32_t insert_left;
+    bool ops_done;
+
+    /* Inflate, only allocated for OTA_PATCH_F_DEFLATE */
+    tinfl_decompressor *inf;
+    uint8_t *dict;
+    size_t dict_ofs;
+    bool inflate_done;
+
+    uint8_t scratch[1024];      /* base partition reads for COPY */
+};
+
+static uint32_t rd32(const uint8_t *b)
+{
+    return b[0] | (b[1] << 8) | (b[2] << 16) | ((uint32_t)b[3] << 24);
+}
+
+/* Append rebuilt image bytes to the update partition */
+static esp_err_t emit(ota_patch_t *p, const void *data, size_t len)
+{
+    if (p->written + len > p->hdr.target_size) {
+        ESP_LOGE(TAG, "Image exceeds announced size %lu", (unsigned long)p->hdr.target_size);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    mbedtls_sha256_update(&p->sha, data, len);
+    esp_err_t err = esp_ota_write(p->handle, data, len);
+    if (err == ESP_OK) p->written += len;
+    return err;
+}
+
+static esp_err_t copy_from_base(ota_patch_t *p, uint32_t src, uint32_t len)
+{
+    if (src > p->hdr.base_size || len > p->hdr.base_size - src) {
+        ESP_LOGE(TAG, "COPY %lu+%lu outside base image", (unsigned long)src, (unsigned long)len);
+        return ESP_ERR_INVALID_ARG;
+    }
+    while (len > 0) {
+        size_t n = len < sizeof(p->scratch) ? len : sizeof(p->scratch);
+        esp_err_t err = esp_partition_read(p->base, src, p->scratch, n);
+        if (err == ESP_OK) err = emit(p, p->scratch, n);
+        if (err != ESP_OK) return err;
+        src += n;
+        len -= n;
+    }
+    return ESP_OK;
+}
+
+/* Decompressed body bytes: either the image itself or delta ops */
+static esp_err_t body_feed(ota_patch_t *p, const uint8_t *data, size_t len)
+{
+    if (!(p->hdr.flags & OTA_PATCH_F_DELTA)) {
+        return emit(p, data, len);
+    }
+
+    while (len > 0) {
+        if (p->ops_done) {
+            ESP_LOGE(TAG, "Data after END op");
+            return ESP_ERR_INVALID_SIZE;
+        }
+        if (p->insert_left > 0) {
+            size_t n = len < p->insert_left ? len : p->insert_left;
+            esp_err_t err = emit(p, data, n);
+            if (err != ESP_OK) return err;
+            p->insert_left -= n;
+            data += n;
+            len -= n;
+            continue;
+        }
+
+        /* Op header may straddle chunk boundaries — collect it bytewise */
+        p->op[p->op_len++] = *data++;
+        len--;
+        size_t need;
+        switch (p->op[0]) {
+        case OP_END:    need = 1; break;
+        case OP_COPY:   need = 9; break;
+        case OP_INSERT: need = 5; break;
+        default:
+            ESP_LOGE(TAG, "Unknown op 0x%02x", p->op[0]);
+            return ESP_ERR_INVALID_ARG;
+        }
+        if (p->op_len < need) continue;
+        p->op_len = 0;
+
+        if (p->op[0] == OP_END) {
+            p->ops_done = true;
+        } else if (p->op[0] == OP_COPY) {
+            esp_err_t err = copy_from_base(p, rd32(p->op + 1), rd32(p->op + 5));
+            if (err != ESP_OK) return err;
+        } else {
+            p->insert_left = rd32(p->op + 1);
+        }
+    }
+    return ESP_OK;
+}
+
+static esp_err_t inflate_feed(ota_patch_t *p, const uint8_t *in, size_t len)
+{
+    while (1) {
+        if (p->inflate_done) {
+            return len ? ESP_ERR_INVALID_SIZE : ESP_OK;
+        }
+        size_t in_n = len;
+        size_t out_n = DICT_SIZE - p->dict_ofs;
+        tinfl_status st = tinfl_decompress(p->inf, in, &in_n, p->dict, p->dict + p->dict_ofs,
+                                           &out_n, TINFL_FLAG_PARSE_ZLIB_HEADER |
+                                                   TINFL_FLAG_HAS_MORE_INPUT);
+        in += in_n;
+        len -= in_n;
+        if (out_n > 0) {
+            esp_err_t err = body_feed(p, p->dict + p->dict_ofs, out_n);
+            if (err != ESP_OK) return err;
+            p->dict_ofs = (p->dict_ofs + out_n) & (DICT_SIZE - 1);
+        }
+        if (st < TINFL_STATUS_DONE) {
+            ESP_LOGE(TAG, "Inflate failed (%d)", st);
+            return ESP_ERR_INVALID_RESPONSE;
+        }
+        if (st == TINFL_STATUS_DONE) {
+            p->inflate_done = true;
+        } else if (st == TINFL_STATUS_NEEDS_MORE_INPUT && len == 0) {
+            return ESP_OK;
+        }
+    }
+}
+
+static esp_err_t base_matches(ota_patch_t *p)
+{
+    if (p->hdr.base_size > p->base->size) return ESP_ERR_INVALID_VERSION;
+
+    mbedtls_sha256_context sha;
+    uint8_t digest[32];
+    esp_err_t err = ESP_OK;
+
+    mbedtls_sha256_init(&sha);
+    mbedtls_sha256_starts(&sha, 0);
+    for (uint32_t off = 0; off < p->hdr.base_size && err == ESP_OK; ) {
+        size_t n = p->hdr.base_size - off;
+        if (n > sizeof(p->scratch)) n = sizeof(p->scratch);
+        err = esp_partition_read(p->base, off, p->scratch, n);
+        mbedtls_sha256_update(&sha, p->scratch, n);
+        off += n;
+    }
+    mbedtls_sha256_finish(&sha, digest);
+    mbedtls_sha256_free(&sha);
+
+    if (err != ESP_OK) return err;
+    return memcmp(digest, p->hdr.base_sha256, 32) == 0 ? ESP_OK : ESP_ERR_INVALID_VERSION;
+}
+
+static esp_err_t header_done(ota_patch_t *p)
+{
+    const ota_patch_hdr_t *h = &p->hdr;
+    if (memcmp(h->magic, OTA_PATCH_MAGIC, 4) != 0 || h->version != OTA_PATCH_VERSION) {
+        ESP_LOGE(TAG, "Not a v%d patch container", OTA_PATCH_VERSION);
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (h->flags & OTA_PATCH_F_DELTA) {
+        esp_err_t err = base_matches(p);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Patch was built against a different running image");
+            return err;
+        }
+    }
+    if (h->flags & OTA_PATCH_F_DEFLATE) {
+        p->inf = malloc(sizeof(tinfl_decompressor));
+        p->dict = malloc(DICT_SIZE);
+        if (!p->inf || !p->dict) return ESP_ERR_NO_MEM;
+        tinfl_init(p->inf);
+    }
+    ESP_LOGI(TAG, "%s image, %lu bytes", ota_patch_format(p), (unsigned long)h->target_size);
+    return ESP_OK;
+}
+
+esp_err_t ota_patch_begin(esp_ota_handle_t handle, ota_patch_t **out)
+{
+    ota_patch_t *p = calloc(1, sizeof(*p));
+    if (!p) return ESP_ERR_NO_MEM;
+
+    p->handle = handle;
+    p->base = esp_ota_get_running_partition();
+    mbedtls_sha256_init(&p->sha);
+    mbedtls_sha256_starts(&p->sha, 0);
+    *out = p;
+    return ESP_OK;
+}
+
+esp_err_t ota_patch_write(ota_patch_t *p, const void *data, size_t len)
+{
+    const uint8_t *in = data;
+
+    if (p->hdr_len < sizeof(p->hdr)) {
+        size_t n = sizeof(p->hdr) - p->hdr_len;
+        if (n > len) n = len;
+        memcpy((uint8_t *)&p->hdr + p->hdr_len, in, n);
+        p->hdr_len += n;
+        in += n;
+        len -= n;
+        if (p->hdr_len < sizeof(p->hdr)) return ESP_OK;
+
+        esp_err_t err = header_done(p);
+        if (err != ESP_OK) return err;
+    }
+    if (len == 0) return ESP_OK;
+
+    return p->inf ? inflate_feed(p, in, len) : body_feed(p, in, len);
+}
+
+esp_err_t ota_patch_finish(ota_patch_t *p)
+{
+    bool complete = p->hdr_len == sizeof(p->hdr) &&
+                    p->written == p->hdr.target_size &&
+                    (!p->inf || p->inflate_done) &&
+                    (!(p->hdr.flags & OTA_PATCH_F_DELTA) || p->ops_done);
+    if (!complete) {
+        ESP_LOGE(TAG, "Truncated patch (%lu of %lu bytes rebuilt)",
+                 (unsigned long)p->written, (unsigned long)p->hdr.target_size);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    uint8_t digest[32];
+    mbedtls_sha256_finish(&p->sha, digest);
+    if (memcmp(digest, p->hdr.target_sha256, 32) != 0) {
+        ESP_LOGE(TAG, "Rebuilt image SHA-256 mismatch");
+        return ESP_ERR_INVALID_CRC;
+    }
+    return ESP_OK;
+}
+
+void ota_patch_free(ota_patch_t *p)
+{
+    if (!p) return;
+    mbedtls_sha256_free(&p->sha);
+    free(p->inf);
+    free(p->dict);
+    free(p);
+}
+
+uint32_t ota_patch_written(const ota_patch_t *p)
+{
+    return p->written;
+}
+
+uint32_t ota_patch_target_size(const ota_patch_t *p)
+{
+    return p->hdr_len == sizeof(p->hdr) ? p->hdr.target_size : 0;
+}
+
+const char *ota_patch_format(const ota_patch_t *p)
+{
+    switch (p->hdr.flags & (OTA_PATCH_F_DEFLATE | OTA_PATCH_F_DELTA)) {
+    case OTA_PATCH_F_DEFLATE:                     return "compressed";
+    case OTA_PATCH_F_DELTA:                       return "delta";
+    case OTA_PATCH_F_DEFLATE | OTA_PATCH_F_DELTA: return "compressed delta";
+    }
+    return "packed";
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "esp_err.h"
+#include "esp_ota_ops.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/* Compressed / delta OTA container, produced by pi/ota_patch.py.
+ *
+ *   header (ota_patch_hdr_t, 80 bytes, little-endian)
+ *   body   — zlib stream if OTA_PATCH_F_DEFLATE, else raw
+ *
+ * Without OTA_PATCH_F_DELTA the (decompressed) body is the app image itself.
+ * With it, the body is a list of ops rebuilding the image from the running
+ * partition:
+ *
+ *   0x00                          END
+ *   0x01 <u32 src> <u32 len>      COPY len bytes from the running image at src
+ *   0x02 <u32 len> <bytes>        INSERT len literal bytes
+ *
+ * The rebuilt image is checked against target_sha256 before esp_ota_end().
+ */
+
+#define OTA_PATCH_MAGIC      "WBOT"
+#define OTA_PATCH_VERSION    1
+
+#define OTA_PATCH_F_DEFLATE  0x01
+#define OTA_PATCH_F_DELTA    0x02
+
+typedef struct __attribute__((packed)) {
+    char     magic[4];
+    uint8_t  version;
+    uint8_t  flags;
+    uint16_t reserved;
+    uint32_t target_size;       /* rebuilt image size */
+    uint32_t base_size;         /* delta: running image bytes the patch was built from */
+    uint8_t  base_sha256[32];   /* delta: SHA-256 of those bytes */
+    uint8_t  target_sha256[32];
+} ota_patch_hdr_t;
+
+_Static_assert(sizeof(ota_patch_hdr_t) == 80, "ota_patch_hdr_t layout");
+
+typedef struct ota_patch ota_patch_t;
+
+/**
+ * @brief Allocate a decoder that writes the rebuilt image to `handle`
+ */
+esp_err_t ota_patch_begin(esp_ota_handle_t handle, ota_patch_t **out);
+
+/**
+ * @brief Feed the next bytes of the container, starting with the header
+ *
+ * @return ESP_ERR_INVALID_VERSION if a delta was built against a different
+ *         running image, other errors for a malformed container
+ */
+esp_err_t ota_patch_write(ota_patch_t *p, const void *data, size_t len);
+
+/**
+ * @brief Check the container was complete and the image hash matches
+ *
+ * @return ESP_ERR_INVALID_SIZE if truncated, ESP_ERR_INVALID_CRC on hash mismatch
+ */
+esp_err_t ota_patch_finish(ota_patch_t *p);
+
+void        ota_patch_free(ota_patch_t *p);
+uint32_t    ota_patch_written(const ota_patch_t *p);
+uint32_t    ota_patch_target_size(const ota_patch_t *p);   /* 0 until the header is in */
+const char *ota_patch_format(const ota_patch_t *p);
@@ -1,13 +1,48 @@
 #include "ota_update.h"
+#include "ota_patch.h"
+#include "nvs_store.h"
+#include "metrics.h"
+#include "wb_event.h"
 #include "esp_log.h"
 #include "esp_ota_ops.h"
 #include "esp_http_client.h"
-#include "esp_https_ota.h"
+#if CONFIG_MBEDTLS_CERTIFICATE_BUNDLE
+#include "esp_crt_bundle.h"
+#endif
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
 
 static const char *TAG = "ota_update";
 
+#define OTA_BUF_SIZE    CONFIG_WB_OTA_RX_BUF_SIZE
+#define OTA_TIMEOUT_MS  10000
+
+static char s_url[OTA_URL_MAX];
+static ota_progress_t s_prog = { .format = "image" };
+static bool s_busy;
+static ota_patch_t *s_patch;    /* set once the download turns out to be a patch */
+
+/* Content-Range of the current response, captured from the header event */
+static int64_t s_range_start;
+static uint32_t s_range_total;
+
+static int32_t read_written(void *arg) { return (int32_t)s_prog.written; }
+static int32_t read_total(void *arg)   { return (int32_t)s_prog.total; }
+static int32_t read_busy(void *arg)    { return __atomic_load_n(&s_busy, __ATOMIC_RELAXED); }
+
+static metric_t s_m_attempts = METRIC_COUNTER_INIT("ota_attempts_total");
+static metric_t s_m_failures = METRIC_COUNTER_INIT("ota_failures_total");
+static metric_t s_m_resumes = METRIC_COUNTER_INIT("ota_resumes_total");
+static metric_t s_m_rx_bytes = METRIC_COUNTER_INIT("ota_rx_bytes_total");
+static metric_t s_m_written = METRIC_GAUGE_FN_INIT("ota_written_bytes", read_written, NULL);
+static metric_t s_m_total = METRIC_GAUGE_FN_INIT("ota_image_bytes", read_total, NULL);
+static metric_t s_m_busy = METRIC_GAUGE_FN_INIT("ota_in_progress", read_busy, NULL);
+
 static esp_err_t ota_http_event(esp_http_client_event_t *evt)
 {
     switch (evt->event_id) {
@@ -17,39 +52,299 @@ static esp_err_t ota_http_event(esp_http_client_event_t *evt)
     case HTTP_EVENT_ERROR:
         ESP_LOGE(TAG, "HTTP error");
         break;
+    case HTTP_EVENT_ON_HEADER: {
+        unsigned long start, end, total;
+        if (strcasecmp(evt->header_key, "Content-Range") == 0 &&
+            sscanf(evt->header_value, "bytes %lu-%lu/%lu", &start, &end, &total) == 3) {
+            s_range_start = start;
+            s_range_total = total;
+        }
+        break;
+    }
     default:
         break;
     }
     return ESP_OK;
 }
 
-static void ota_task(void *arg)
+static void post_progress(void)
 {
-    ESP_LOGI(TAG, "Starting OTA from %s", OTA_DEFAULT_URL);
+    wb_event_ota_t ev = {
+        .state = s_prog.state,
+        .written = s_prog.written,
+        .total = s_prog.total,
+        .resumes = s_prog.resumes,
+        .err = s_prog.last_err,
+    };
+    wb_event_post(WB_EVENT_OTA, &ev, sizeof(ev));
+}
+
+static void log_progress(uint32_t *last_pct)
+{
+    if (s_prog.total == 0) return;
+    uint32_t pct = (uint32_t)((uint64_t)s_prog.written * 100 / s_prog.total);
+    if (pct / 10 != *last_pct / 10) {
+        ESP_LOGI(TAG, "%" PRIu32 "%% (%" PRIu32 "/%" PRIu32 " bytes)",
+                 pct, s_prog.written, s_prog.total);
+        *last_pct = pct;
+        post_progress();
+    }
+}
+
+/* Hand downloaded bytes to the patch decoder or straight to flash */
+static esp_err_t ota_consume(esp_ota_handle_t handle, const char *data, size_t len)
+{
+    esp_err_t err;
 
+    if (s_prog.downloaded == 0 && data[0] == OTA_PATCH_MAGIC[0]) {
+        err = ota_patch_begin(handle, &s_patch);
+        if (err != ESP_OK) return err;
+    }
+    if (s_patch) {
+        err = ota_patch_write(s_patch, data, len);
+        s_prog.written = ota_patch_written(s_patch);
+        s_prog.total = ota_patch_target_size(s_patch);
+        if (s_prog.total) s_prog.format = ota_patch_format(s_patch);
+        return err;
+    }
+
+    err = esp_ota_write(handle, data, len);
+    if (err == ESP_OK) s_prog.written += len;
+    return err;
+}
+
+/* One HTTP request from s_prog.downloaded to the end of the image. Returns
+   ESP_OK once the whole image is in flash; *fatal is set for errors a
+   retry can't fix (bad status, flash write or patch failure, mismatched
+   range). */
+static esp_err_t ota_fetch(esp_ota_handle_t handle, char *buf, bool *fatal)
+{
     esp_http_client_config_t http_cfg = {
-        .url = OTA_DEFAULT_URL,
+        .url = s_url,
         .event_handler = ota_http_event,
+        .buffer_size = OTA_BUF_SIZE,
+        .timeout_ms = OTA_TIMEOUT_MS,
         .keep_alive_enable = true,
+#if CONFIG_MBEDTLS_CERTIFICATE_BUNDLE
+        .crt_bundle_attach = esp_crt_bundle_attach,     /* https:// verifies the server */
+#endif
     };
+    esp_http_client_handle_t client = esp_http_client_init(&http_cfg);
+    if (!client) {
+        *fatal = true;
+        return ESP_ERR_NO_MEM;
+    }
 
-    esp_https_ota_config_t ota_cfg = {
-        .http_config = &http_cfg,
-    };
+    uint32_t offset = s_prog.downloaded;
+    if (offset > 0) {
+        char range[24];
+        snprintf(range, sizeof(range), "bytes=%" PRIu32 "-", offset);
+        esp_http_client_set_header(client, "Range", range);
+    }
+    s_range_start = -1;
 
-    esp_err_t ret = esp_https_ota(&ota_cfg);
-    if (ret == ESP_OK) {
-        ESP_LOGI(TAG, "OTA succeeded, rebooting...");
-        esp_restart();
+    esp_err_t err = esp_http_client_open(client, 0);
+    if (err != ESP_OK) {
+        goto out;
+    }
+    int64_t len = esp_http_client_fetch_headers(client);
+    int status = esp_http_client_get_status_code(client);
+
+    uint32_t skip = 0;
+    uint32_t size = 0;
+    if (status == 206) {
+        if (s_range_start != offset) {
+            ESP_LOGE(TAG, "Server resumed at %" PRId64 ", expected %" PRIu32,
+                     s_range_start, offset);
+            err = ESP_ERR_INVALID_RESPONSE;
+            *fatal = true;
+            goto out;
+        }
+        size = s_range_total ? s_range_total : offset + (uint32_t)len;
+    } else if (status == 200) {
+        /* Full body — either a fresh start or a server that ignores Range */
+        skip = offset;
+        if (len > 0) size = (uint32_t)len;
     } else {
-        ESP_LOGE(TAG, "OTA failed: %s", esp_err_to_name(ret));
+        ESP_LOGE(TAG, "HTTP status %d from %s", status, s_url);
+        err = ESP_ERR_INVALID_RESPONSE;
+        *fatal = true;
+        goto out;
+    }
+    if (!s_patch) s_prog.total = size;
+
+    uint32_t last_pct = 0;
+    while (1) {
+        int n = esp_http_client_read(client, buf, OTA_BUF_SIZE);
+        if (n < 0) {
+            err = ESP_FAIL;
+            break;
+        }
+        if (n == 0) {
+            err = esp_http_client_is_complete_data_received(client) ? ESP_OK : ESP_FAIL;
+            break;
+        }
+        metric_add(&s_m_rx_bytes, n);
+
+        char *data = buf;
+        if (skip > 0) {
+            uint32_t d = (uint32_t)n < skip ? (uint32_t)n : skip;
+            skip -= d;
+            data += d;
+            n -= d;
+            if (n == 0) continue;
+        }
+        if (size && s_prog.downloaded + n > size) {
+            ESP_LOGE(TAG, "Server sent more than the announced %" PRIu32 " bytes", size);
+            err = ESP_ERR_INVALID_SIZE;
+            *fatal = true;
+            break;
+        }
+
+        err = ota_consume(handle, data, n);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Write failed: %s", esp_err_to_name(err));
+            *fatal = true;
+            break;
+        }
+        s_prog.downloaded += n;
+        log_progress(&last_pct);
+    }
+
+out:
+    esp_http_client_close(client);
+    esp_http_client_cleanup(client);
+    return err;
+}
+
+static void ota_task(void *arg)
+{
+    ESP_LOGI(TAG, "Starting OTA from %s", s_url);
+    metric_inc(&s_m_attempts);
+    s_prog = (ota_progress_t){ .state = OTA_STATE_DOWNLOADING, .format = "image" };
+    s_patch = NULL;
+    post_progress();
+
+    esp_err_t err;
+    esp_ota_handle_t handle = 0;
+    bool fatal = false;
+    const esp_partition_t *part = esp_ota_get_next_update_partition(NULL);
+    char *buf = malloc(OTA_BUF_SIZE);
+
+    if (!part) {
+        err = ESP_ERR_NOT_FOUND;
+        goto fail;
+    }
+    if (!buf) {
+        err = ESP_ERR_NO_MEM;
+        goto fail;
+    }
+
+    /* Sequential writes erase sector by sector as data arrives, so the
+       handle stays valid across reconnects and a resume just continues. */
+    err = esp_ota_begin(part, OTA_WITH_SEQUENTIAL_WRITES, &handle);
+    if (err != ESP_OK) {
+        goto fail;
     }
 
+    for (int attempt = 0; ; attempt++) {
+        err = ota_fetch(handle, buf, &fatal);
+        if (err == ESP_OK || fatal || attempt >= CONFIG_WB_OTA_MAX_RETRIES) {
+            break;
+        }
+        s_prog.resumes++;
+        metric_inc(&s_m_resumes);
+        ESP_LOGW(TAG, "Download interrupted at %" PRIu32 "/%" PRIu32 " bytes, resuming in %d s",
+                 s_prog.written, s_prog.total, attempt + 1);
+        vTaskDelay(pdMS_TO_TICKS(1000 * (attempt + 1)));
+    }
+    if (err == ESP_OK && s_patch) {
+        err = ota_patch_finish(s_patch);
+    }
+    if (err != ESP_OK) {
+        esp_ota_abort(handle);
+        goto fail;
+    }
+
+    /* esp_ota_end() validates the image header and its SHA-256 digest */
+    s_prog.state = OTA_STATE_VERIFYING;
+    post_progress();
+    err = esp_ota_end(handle);
+    if (err == ESP_OK) {
+        err = esp_ota_set_boot_partition(part);
+    }
+    if (err != ESP_OK) {
+        goto fail;
+    }
+
+    free(buf);
+    ota_patch_free(s_patch);
+    ESP_LOGI(TAG, "OTA succeeded, rebooting...");
+    nvs_store_flush();
+    esp_restart();
+
+fail:
+    ESP_LOGE(TAG, "OTA failed: %s", esp_err_to_name(err));
+    metric_inc(&s_m_failures);
+    s_prog.last_err = err;
+    s_prog.state = OTA_STATE_FAILED;
+    post_progress();
+    free(buf);
+    ota_patch_free(s_patch);
+    s_patch = NULL;
+    __atomic_store_n(&s_busy, false, __ATOMIC_RELEASE);
     vTaskDelete(NULL);
 }
 
-esp_err_t ota_update_start(void)
+void ota_update_init(void)
 {
+    metrics_register(&s_m_attempts);
+    metrics_register(&s_m_failures);
+    metrics_register(&s_m_resumes);
+    metrics_register(&s_m_rx_bytes);
+    metrics_register(&s_m_written);
+    metrics_register(&s_m_total);
+    metrics_register(&s_m_busy);
+}
+
+esp_err_t ota_update_start(const char *url)
+{
+    if (!url) url = OTA_DEFAULT_URL;
+    if (strlen(url) >= sizeof(s_url)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+#if !CONFIG_MBEDTLS_CERTIFICATE_BUNDLE
+    /* Nothing to verify the server against; never flash an image from an
+       unauthenticated TLS peer */
+    if (strncmp(url, "https://", 8) == 0) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+#endif
+    if (__atomic_exchange_n(&s_busy, true, __ATOMIC_ACQUIRE)) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    strcpy(s_url, url);
+
     BaseType_t ret = xTaskCreate(ota_task, "ota_task", 8192, NULL, 5, NULL);
-    return (ret == pdPASS) ? ESP_OK : ESP_ERR_NO_MEM;
+    if (ret != pdPASS) {
+        __atomic_store_n(&s_busy, false, __ATOMIC_RELEASE);
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+void ota_update_get_progress(ota_progress_t *out)
+{
+    *out = s_prog;
+}
+
+const char *ota_update_state_name(ota_state_t state)
+{
+    switch (state) {
+    case OTA_STATE_IDLE:        return "idle";
+    case OTA_STATE_DOWNLOADING: return "downloading";
+    case OTA_STATE_VERIFYING:   return "verifying";
+    case OTA_STATE_FAILED:      return "failed";
+    }
+    return "unknown";
 }
@@ -1,7 +1,45 @@
 #pragma once
 
 #include "esp_err.h"
+#include "sdkconfig.h"
+#include <stdint.h>
 
-#define OTA_DEFAULT_URL "http://192.168.0.87:8080/firmware/test-firmware/wb-test-firmware.bin"
+#define OTA_DEFAULT_URL CONFIG_WB_OTA_DEFAULT_URL
+#define OTA_URL_MAX     256
 
-esp_err_t ota_update_start(void);
+typedef enum {
+    OTA_STATE_IDLE,
+    OTA_STATE_DOWNLOADING,
+    OTA_STATE_VERIFYING,
+    OTA_STATE_FAILED,
+} ota_state_t;
+
+typedef struct {
+    ota_state_t state;
+    const char *format;     /* "image", or the patch container format */
+    uint32_t downloaded;    /* bytes of the download consumed so far */
+    uint32_t written;       /* bytes written to the update partition */
+    uint32_t total;         /* image size, 0 until known */
+    uint32_t resumes;       /* Range reconnects during this update */
+    esp_err_t last_err;
+} ota_progress_t;
+
+void      ota_update_init(void);
+
+/**
+ * @brief Start an OTA update in the background
+ *
+ * The URL may point at a plain app image or at a compressed / delta
+ * container from pi/ota_patch.py (see ota_patch.h); the format is detected
+ * from the first bytes of the download. https:// servers are verified
+ * against the ESP-IDF certificate bundle.
+ *
+ * @param url  Image URL, or NULL for OTA_DEFAULT_URL
+ * @return ESP_ERR_INVALID_STATE if an update is already running,
+ *         ESP_ERR_INVALID_ARG if the URL is too long,
+ *         ESP_ERR_NOT_SUPPORTED for https:// without CONFIG_MBEDTLS_CERTIFICATE_BUNDLE
+ */
+esp_err_t ota_update_start(const char *url);
+
+void        ota_update_get_progress(ota_progress_t *out);
+const char *ota_update_state_name(ota_state_t state);
@@ -0,0 +1,239 @@
+#include "power_profile.h"
+#include "nvs_store.h"
+#include "wifi_prov.h"
+#include "metrics.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+#include "freertos/FreeRTOS.h"
+#include <string.h>
+#include <strings.h>
+
+#if CONFIG_PM_ENABLE
+#include "esp_pm.h"
+#endif
+
+static const char *TAG = "power";
+
+#define LISTEN_INTERVAL_DEFAULT 3       /* IDF's own default */
+#define HEARTBEAT_MS            10000
+#define HEARTBEAT_LIGHT_MS      60000
+
+#ifdef CONFIG_XTAL_FREQ
+#define PM_MIN_FREQ_MHZ         CONFIG_XTAL_FREQ
+#else
+#define PM_MIN_FREQ_MHZ         40
+#endif
+
+typedef struct {
+    const char *name;
+    wifi_ps_type_t ps;
+    bool light_sleep;
+    uint32_t est_ma;        /* STA associated, radio idle, BLE off: datasheet ballpark */
+} profile_desc_t;
+
+static const profile_desc_t s_profiles[POWER_PROFILE_COUNT] = {
+    [POWER_PROFILE_DEFAULT]     = { "default",     WIFI_PS_MIN_MODEM, false, 30 },
+    [POWER_PROFILE_PERFORMANCE] = { "performance", WIFI_PS_NONE,      false, 90 },
+    [POWER_PROFILE_MODEM]       = { "modem",       WIFI_PS_MAX_MODEM, false, 20 },
+    [POWER_PROFILE_LIGHT]       = { "light",       WIFI_PS_MAX_MODEM, true,  3 },
+};
+
+static power_profile_t s_profile = POWER_PROFILE_DEFAULT;
+static uint8_t s_listen_interval = LISTEN_INTERVAL_DEFAULT;
+
+/* Charge integral: mA·µs up to s_since_us, plus the active profile since then */
+static portMUX_TYPE s_charge_lock = portMUX_INITIALIZER_UNLOCKED;
+static uint64_t s_charge_maus;
+static int64_t s_since_us;
+
+#if CONFIG_PM_ENABLE
+static esp_pm_lock_handle_t s_locks[POWER_AWAKE_COUNT];
+#endif
+
+static int32_t read_current(void *arg)
+{
+    return (int32_t)power_profile_current_ma();
+}
+
+static int32_t read_charge(void *arg)
+{
+    return (int32_t)power_profile_charge_mas();
+}
+
+static metric_t s_m_profile = METRIC_GAUGE_INIT("power_profile");
+static metric_t s_m_current = METRIC_GAUGE_FN_INIT("power_current_estimate_ma", read_current, NULL);
+static metric_t s_m_charge = METRIC_COUNTER_FN_INIT("power_charge_estimate_mas_total", read_charge, NULL);
+static metric_t s_m_wake = METRIC_HISTOGRAM_INIT("power_wake_latency_us");
+static metric_t s_m_switches = METRIC_COUNTER_INIT("power_profile_switches_total");
+
+static uint64_t charge_now(int64_t now)
+{
+    return s_charge_maus + (uint64_t)(now - s_since_us) * s_profiles[s_profile].est_ma;
+}
+
+/* ── Drivers ───────────────────────────────────────────────────── */
+
+static esp_err_t pm_apply(const profile_desc_t *p)
+{
+#if CONFIG_PM_ENABLE
+    esp_pm_config_t pm = {
+        .max_freq_mhz = CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ,
+        .min_freq_mhz = p->light_sleep ? PM_MIN_FREQ_MHZ : CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ,
+        .light_sleep_enable = p->light_sleep,
+    };
+    return esp_pm_configure(&pm);
+#else
+    return p->light_sleep ? ESP_ERR_NOT_SUPPORTED : ESP_OK;
+#endif
+}
+
+static esp_err_t profile_apply(power_profile_t profile, uint8_t listen_interval)
+{
+    const profile_desc_t *p = &s_profiles[profile];
+
+    esp_err_t err = esp_wifi_set_ps(p->ps);
+    if (err != ESP_OK) return err;
+    err = pm_apply(p);
+    if (err != ESP_OK) {
+        esp_wifi_set_ps(s_profiles[s_profile].ps);      /* back to what was running */
+        return err;
+    }
+    if (p->ps == WIFI_PS_MAX_MODEM) wifi_prov_set_listen_interval(listen_interval);
+
+    int64_t now = esp_timer_get_time();
+    taskENTER_CRITICAL(&s_charge_lock);
+    s_charge_maus = charge_now(now);
+    s_since_us = now;
+    s_profile = profile;
+    s_listen_interval = listen_interval;
+    taskEXIT_CRITICAL(&s_charge_lock);
+
+    metric_set(&s_m_profile, profile);
+    ESP_LOGI(TAG, "Profile %s (listen interval %u), ~%lu mA", p->name, listen_interval,
+             (unsigned long)p->est_ma);
+    return ESP_OK;
+}
+
+/* ── API ───────────────────────────────────────────────────────── */
+
+esp_err_t power_profile_init(void)
+{
+    nvs_power_t stored;
+    if (nvs_store_get_power(&stored) && stored.profile < POWER_PROFILE_COUNT) {
+        s_profile = stored.profile;
+        if (stored.listen_interval) s_listen_interval = stored.listen_interval;
+    }
+
+#if CONFIG_PM_ENABLE
+    esp_err_t err = esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "httpd", &s_locks[POWER_AWAKE_HTTP]);
+    if (err == ESP_OK) err = esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "ble_nus", &s_locks[POWER_AWAKE_BLE]);
+    if (err != ESP_OK) return err;
+#endif
+
+    metrics_register(&s_m_profile);
+    metrics_register(&s_m_current);
+    metrics_register(&s_m_charge);
+    metrics_register(&s_m_wake);
+    metrics_register(&s_m_switches);
+    return ESP_OK;
+}
+
+esp_err_t power_profile_start(void)
+{
+    power_profile_t want = s_profile;
+
+    /* s_profile describes what runs until profile_apply() succeeds */
+    s_profile = POWER_PROFILE_DEFAULT;
+    s_since_us = esp_timer_get_time();
+    if (want == POWER_PROFILE_DEFAULT) {
+        metric_set(&s_m_profile, want);
+        return ESP_OK;
+    }
+    if (wifi_prov_is_ap_mode()) {
+        ESP_LOGI(TAG, "Stored profile %s not used in AP mode", s_profiles[want].name);
+        return ESP_OK;
+    }
+    esp_err_t err = profile_apply(want, s_listen_interval);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Stored profile %s failed (%s), staying on default",
+                 s_profiles[want].name, esp_err_to_name(err));
+    }
+    return ESP_OK;      /* the board works either way */
+}
+
+esp_err_t power_profile_set(power_profile_t profile, uint8_t listen_interval)
+{
+    if (profile >= POWER_PROFILE_COUNT) return ESP_ERR_INVALID_ARG;
+    if (wifi_prov_is_ap_mode() && profile != POWER_PROFILE_DEFAULT) return ESP_ERR_INVALID_STATE;
+    if (!listen_interval) listen_interval = s_listen_interval;
+
+    esp_err_t err = profile_apply(profile, listen_interval);
+    if (err != ESP_OK) return err;
+    metric_inc(&s_m_switches);
+
+    nvs_power_t stored = { .profile = profile, .listen_interval = listen_interval };
+    return nvs_store_set_power(&stored);
+}
+
+power_profile_t power_profile_get(void)
+{
+    return s_profile;
+}
+
+uint8_t power_profile_listen_interval(void)
+{
+    return s_listen_interval;
+}
+
+const char *power_profile_name(power_profile_t profile)
+{
+    return profile < POWER_PROFILE_COUNT ? s_profiles[profile].name : "?";
+}
+
+bool power_profile_parse(const char *name, power_profile_t *out)
+{
+    for (int i = 0; i < POWER_PROFILE_COUNT; i++) {
+        if (strcasecmp(name, s_profiles[i].name) == 0) {
+            *out = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+uint32_t power_profile_current_ma(void)
+{
+    return s_profiles[s_profile].est_ma;
+}
+
+uint32_t power_profile_charge_mas(void)
+{
+    int64_t now = esp_timer_get_time();
+    taskENTER_CRITICAL(&s_charge_lock);
+    uint64_t maus = charge_now(now);
+    taskEXIT_CRITICAL(&s_charge_lock);
+    return (uint32_t)(maus / 1000000);
+}
+
+uint32_t power_profile_heartbeat_ms(void)
+{
+    return s_profile == POWER_PROFILE_LIGHT ? HEARTBEAT_LIGHT_MS : HEARTBEAT_MS;
+}
+
+void power_profile_observe_wake(uint32_t late_us)
+{
+    metric_observe(&s_m_wake, late_us);
+}
+
+#if CONFIG_PM_ENABLE
+void power_awake_begin(power_awake_t who)
+{
+    if (who < POWER_AWAKE_COUNT && s_locks[who]) esp_pm_lock_acquire(s_locks[who]);
+}
+
+void power_awake_end(power_awake_t who)
+{
+    if (who < POWER_AWAKE_COUNT && s_locks[who]) esp_pm_lock_release(s_locks[who]);
+}
+#endif
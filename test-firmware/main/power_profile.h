@@ -0,0 +1,82 @@
+#pragma once
+
+#include "esp_err.h"
+#include "sdkconfig.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Runtime power/latency profiles, stored in NVS, switched by POST /power.
+ *
+ *   default      IDF default: WIFI_PS_MIN_MODEM, fixed CPU clock
+ *   performance  WIFI_PS_NONE for minimum latency (refused by the WiFi
+ *                driver while BLE shares the radio)
+ *   modem        WIFI_PS_MAX_MODEM, waking every listen_interval beacons
+ *   light        modem sleep plus automatic light sleep between DTIMs;
+ *                httpd and ble_nus hold PM locks while they work, and the
+ *                heartbeat slows to once a minute
+ *
+ * Profiles other than default only take effect in STA mode. A changed
+ * listen interval applies from the next association.
+ */
+typedef enum {
+    POWER_PROFILE_DEFAULT,
+    POWER_PROFILE_PERFORMANCE,
+    POWER_PROFILE_MODEM,
+    POWER_PROFILE_LIGHT,
+    POWER_PROFILE_COUNT,
+} power_profile_t;
+
+/* Who is keeping the chip awake */
+typedef enum {
+    POWER_AWAKE_HTTP,       /* inside a request handler: full clock, no light sleep */
+    POWER_AWAKE_BLE,        /* BLE connected: no light sleep */
+    POWER_AWAKE_COUNT,
+} power_awake_t;
+
+/**
+ * @brief Load the stored profile and create the PM locks (before WiFi starts)
+ */
+esp_err_t power_profile_init(void);
+
+/**
+ * @brief Apply the stored profile once WiFi is running
+ */
+esp_err_t power_profile_start(void);
+
+/**
+ * @brief Switch profile and store it in NVS
+ *
+ * @param listen_interval  beacons between wake-ups in modem/light, 0 keeps
+ *                         the current value
+ * @return ESP_ERR_INVALID_ARG for an unknown profile, ESP_ERR_INVALID_STATE
+ *         in AP mode, or the WiFi/PM driver's error (the previous profile
+ *         stays active)
+ */
+esp_err_t power_profile_set(power_profile_t profile, uint8_t listen_interval);
+
+power_profile_t power_profile_get(void);
+uint8_t     power_profile_listen_interval(void);
+const char *power_profile_name(power_profile_t profile);
+bool        power_profile_parse(const char *name, power_profile_t *out);
+
+/* Rough average current of the active profile, and its integral since boot */
+uint32_t    power_profile_current_ma(void);
+uint32_t    power_profile_charge_mas(void);
+
+/**
+ * @brief Heartbeat period for the active profile
+ */
+uint32_t    power_profile_heartbeat_ms(void);
+
+/**
+ * @brief Record how late a timed wake-up ran (heartbeat), in µs
+ */
+void        power_profile_observe_wake(uint32_t late_us);
+
+#if CONFIG_PM_ENABLE
+void power_awake_begin(power_awake_t who);
+void power_awake_end(power_awake_t who);
+#else
+static inline void power_awake_begin(power_awake_t who) { }
+static inline void power_awake_end(power_awake_t who) { }
+#endif
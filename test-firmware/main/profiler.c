@@ -0,0 +1,222 @@
+#include "profiler.h"
+
+#if CONFIG_WB_PROFILER
+
+#include "udp_log.h"
+#include "metrics.h"
+#include "driver/gptimer.h"
+#include "esp_attr.h"
+#include "esp_cpu.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if CONFIG_IDF_TARGET_ARCH_XTENSA
+#include "xtensa_context.h"
+typedef XtExcFrame frame_t;
+#define FRAME_PC(f)         ((uint32_t)(f)->pc)
+/* Windowed ABI: the top two bits of a0 hold the caller's window size */
+#define FRAME_CALLER(f)     (((uint32_t)(f)->a0 & 0x3FFFFFFF) | 0x40000000)
+#else
+#include "riscv/rvruntime-frames.h"
+typedef RvExcFrame frame_t;
+#define FRAME_PC(f)         ((uint32_t)(f)->mepc)
+#define FRAME_CALLER(f)     ((uint32_t)(f)->ra)     /* stale once a non-leaf has called out */
+#endif
+
+static const char *TAG = "profiler";
+
+#define SAMPLE_HZ           CONFIG_WB_PROFILER_HZ
+#define RING_LEN            128             /* samples per core, power of two */
+#define LINE_SAMPLES        8               /* 24 hex digits each, within one log line */
+#define DRAIN_PERIOD        pdMS_TO_TICKS(50)
+#define TASK_TABLE_US       (10 * 1000000LL)
+#define SEEN_MAX            48
+#define DRAIN_STACK         3072
+#define DRAIN_PRIO          2
+
+typedef struct {
+    uint32_t pc;
+    uint32_t caller;
+    uint32_t task;
+} sample_t;
+
+/* Single producer (the core's timer ISR), single consumer (its drain task) */
+typedef struct {
+    sample_t ring[RING_LEN];
+    uint32_t head;
+    uint32_t tail;
+    uint32_t drops;
+    gptimer_handle_t timer;
+} core_buf_t;
+
+static core_buf_t s_buf[portNUM_PROCESSORS];
+
+static int32_t read_samples(void *arg)
+{
+    uint32_t n = 0;
+    for (int i = 0; i < portNUM_PROCESSORS; i++) {
+        n += __atomic_load_n(&s_buf[i].head, __ATOMIC_RELAXED);
+    }
+    return (int32_t)n;
+}
+
+static int32_t read_drops(void *arg)
+{
+    uint32_t n = 0;
+    for (int i = 0; i < portNUM_PROCESSORS; i++) {
+        n += __atomic_load_n(&s_buf[i].drops, __ATOMIC_RELAXED);
+    }
+    return (int32_t)n;
+}
+
+static metric_t s_m_samples = METRIC_COUNTER_FN_INIT("prof_samples_total", read_samples, NULL);
+static metric_t s_m_drops = METRIC_COUNTER_FN_INIT("prof_samples_dropped_total", read_drops, NULL);
+static metric_t s_m_lines_lost = METRIC_COUNTER_INIT("prof_lines_dropped_total");
+
+static bool IRAM_ATTR on_alarm(gptimer_handle_t timer, const gptimer_alarm_event_data_t *ev, void *arg)
+{
+    core_buf_t *b = arg;
+    uint32_t head = b->head;
+
+    if (head - __atomic_load_n(&b->tail, __ATOMIC_ACQUIRE) >= RING_LEN) {
+        b->drops++;
+        return false;
+    }
+    /* Interrupt entry saved the task's registers on its stack and left the
+       frame address in the TCB's first word (pxTopOfStack) */
+    TaskHandle_t task = xTaskGetCurrentTaskHandleForCore(esp_cpu_get_core_id());
+    const frame_t *f = *(frame_t *const *)task;
+    sample_t *s = &b->ring[head % RING_LEN];
+    s->pc = FRAME_PC(f);
+    s->caller = FRAME_CALLER(f);
+    s->task = (uint32_t)(uintptr_t)task;
+    __atomic_store_n(&b->head, head + 1, __ATOMIC_RELEASE);
+    return false;
+}
+
+static void emit(const char *line, int len)
+{
+    if (!udp_log_write_line(line, len)) metric_inc(&s_m_lines_lost);
+}
+
+/* Header plus one line per live task, so the host can name task handles */
+static void emit_task_table(void)
+{
+    char line[64];
+    UBaseType_t n = uxTaskGetNumberOfTasks() + 2;
+    TaskStatus_t *tasks = malloc(n * sizeof(*tasks));
+    if (!tasks) return;
+
+    n = uxTaskGetSystemState(tasks, n, NULL);
+    emit(line, snprintf(line, sizeof(line), "WBPROF H %d %d\n", SAMPLE_HZ, portNUM_PROCESSORS));
+    for (UBaseType_t i = 0; i < n; i++) {
+        emit(line, snprintf(line, sizeof(line), "WBPROF T %08lx %s\n",
+                            (unsigned long)(uintptr_t)tasks[i].xHandle, tasks[i].pcTaskName));
+    }
+    free(tasks);
+}
+
+/* Remember task handles already named; true for one not seen before */
+static bool task_is_new(uint32_t *seen, int *n_seen, uint32_t task)
+{
+    for (int i = 0; i < *n_seen; i++) {
+        if (seen[i] == task) return false;
+    }
+    if (*n_seen < SEEN_MAX) seen[(*n_seen)++] = task;
+    return true;
+}
+
+static esp_err_t timer_setup(core_buf_t *b)
+{
+    gptimer_config_t cfg = {
+        .clk_src = GPTIMER_CLK_SRC_DEFAULT,
+        .direction = GPTIMER_COUNT_UP,
+        .resolution_hz = 1000000,
+        .intr_priority = 1,         /* level 1 never nests over another ISR */
+    };
+    gptimer_alarm_config_t alarm = {
+        .alarm_count = 1000000 / SAMPLE_HZ,
+        .flags.auto_reload_on_alarm = true,
+    };
+    gptimer_event_callbacks_t cbs = { .on_alarm = on_alarm };
+
+    esp_err_t err = gptimer_new_timer(&cfg, &b->timer);
+    if (err == ESP_OK) err = gptimer_register_event_callbacks(b->timer, &cbs, b);
+    if (err == ESP_OK) err = gptimer_set_alarm_action(b->timer, &alarm);
+    if (err == ESP_OK) err = gptimer_enable(b->timer);
+    if (err == ESP_OK) err = gptimer_start(b->timer);
+    return err;
+}
+
+/* One per core: the timer interrupt is allocated on the core that sets it
+   up, and this task then drains that core's samples */
+static void drain_task(void *arg)
+{
+    TaskHandle_t starter = arg;
+    int core = esp_cpu_get_core_id();
+    core_buf_t *b = &s_buf[core];
+    uint32_t seen[SEEN_MAX];
+    int n_seen = 0;
+    int64_t table_due = 0;
+    char line[16 + LINE_SAMPLES * 24 + 2];
+
+    esp_err_t err = timer_setup(b);
+    xTaskNotify(starter, (uint32_t)err, eSetValueWithOverwrite);
+    if (err != ESP_OK) vTaskDelete(NULL);
+
+    while (1) {
+        vTaskDelay(DRAIN_PERIOD);
+
+        uint32_t head = __atomic_load_n(&b->head, __ATOMIC_ACQUIRE);
+        uint32_t tail = b->tail;
+        bool need_table = esp_timer_get_time() >= table_due;
+        for (uint32_t i = tail; i != head && !need_table; i++) {
+            need_table = task_is_new(seen, &n_seen, b->ring[i % RING_LEN].task);
+        }
+        if (need_table) {
+            emit_task_table();
+            table_due = esp_timer_get_time() + TASK_TABLE_US;
+        }
+
+        while (tail != head) {
+            int len = snprintf(line, sizeof(line), "WBPROF S %d ", core);
+            for (int k = 0; k < LINE_SAMPLES && tail != head; k++, tail++) {
+                const sample_t *s = &b->ring[tail % RING_LEN];
+                len += snprintf(line + len, sizeof(line) - len, "%08lx%08lx%08lx",
+                                (unsigned long)s->pc, (unsigned long)s->caller,
+                                (unsigned long)s->task);
+            }
+            line[len++] = '\n';
+            __atomic_store_n(&b->tail, tail, __ATOMIC_RELEASE);
+            emit(line, len);
+        }
+    }
+}
+
+esp_err_t profiler_start(void)
+{
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        char name[12];
+        snprintf(name, sizeof(name), "prof%d", core);
+        if (xTaskCreatePinnedToCore(drain_task, name, DRAIN_STACK, xTaskGetCurrentTaskHandle(),
+                                    DRAIN_PRIO, NULL, core) != pdPASS) {
+            return ESP_ERR_NO_MEM;
+        }
+        uint32_t err;
+        xTaskNotifyWait(0, 0, &err, portMAX_DELAY);
+        if (err != ESP_OK) return (esp_err_t)err;
+    }
+
+    metrics_register(&s_m_samples);
+    metrics_register(&s_m_drops);
+    metrics_register(&s_m_lines_lost);
+    ESP_LOGI(TAG, "Sampling %d Hz on %d core(s)", SAMPLE_HZ, portNUM_PROCESSORS);
+    return ESP_OK;
+}
+
+#endif /* CONFIG_WB_PROFILER */
@@ -0,0 +1,23 @@
+#pragma once
+
+#include "esp_err.h"
+#include "sdkconfig.h"
+
+/* PC-sampling profiler for the profiling build (sdkconfig.defaults.profiling).
+ *
+ * A hardware timer on each core interrupts it CONFIG_WB_PROFILER_HZ times a
+ * second and records the interrupted task, PC and return address. A drain
+ * task per core streams them as text lines to the log target (never to the
+ * serial console); pi/prof_fold.py folds them against the ELF:
+ *   WBPROF H <hz> <cores>                     header, with every task table
+ *   WBPROF T <task handle> <name>             one per live task
+ *   WBPROF S <core> <pc><caller><task>...     8 hex digits each, per sample
+ *
+ * Samples only land where interrupts are enabled: time spent in critical
+ * sections and ISRs is charged to the code that re-enables interrupts.
+ */
+#if CONFIG_WB_PROFILER
+esp_err_t profiler_start(void);
+#else
+static inline esp_err_t profiler_start(void) { return ESP_OK; }
+#endif
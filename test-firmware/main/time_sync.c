@@ -0,0 +1,106 @@
+#include "time_sync.h"
+
+#if CONFIG_WB_TIME_SYNC
+
+#include "boot_seq.h"
+#include "udp_log.h"
+#include "wifi_prov.h"
+#include "metrics.h"
+#include "esp_log.h"
+#include "esp_netif_sntp.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+static const char *TAG = "time_sync";
+
+#define SYNC_INTERVAL_MS    (CONFIG_WB_TIME_SYNC_INTERVAL_S * 1000)
+
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+static int64_t s_offset_us;         /* Unix µs minus esp_timer µs */
+static int64_t s_synced_at_us;      /* esp_timer µs of the last sync, 0 before */
+static char s_server[64];
+
+static int32_t read_age(void *arg)
+{
+    return time_sync_age_ms();
+}
+
+static metric_t s_m_syncs = METRIC_COUNTER_INIT("time_sync_total");
+static metric_t s_m_step = METRIC_HISTOGRAM_INIT("time_sync_step_us");
+static metric_t s_m_age = METRIC_GAUGE_FN_INIT("time_sync_age_ms", read_age, NULL);
+
+/* Runs in the lwIP task right after SNTP set the system clock */
+static void on_sync(struct timeval *tv)
+{
+    int64_t now = esp_timer_get_time();
+    int64_t offset = (int64_t)tv->tv_sec * 1000000 + tv->tv_usec - now;
+
+    taskENTER_CRITICAL(&s_lock);
+    bool first = s_synced_at_us == 0;
+    int64_t step = offset - s_offset_us;
+    s_offset_us = offset;
+    s_synced_at_us = now;
+    taskEXIT_CRITICAL(&s_lock);
+
+    metric_inc(&s_m_syncs);
+    if (first) {
+        boot_seq_mark(BOOT_MARK_TIME);
+        ESP_LOGI(TAG, "Synced to %s", s_server);
+    } else {
+        /* Local oscillator drift (plus path jitter) since the last sync */
+        metric_observe(&s_m_step, (uint32_t)llabs(step));
+    }
+}
+
+esp_err_t time_sync_start(void)
+{
+    if (wifi_prov_is_ap_mode()) return ESP_OK;      /* no route to the Pi */
+
+    strncpy(s_server, CONFIG_WB_TIME_SYNC_SERVER, sizeof(s_server) - 1);
+    if (!s_server[0]) {
+        nvs_log_target_t t;
+        udp_log_get_target(&t);
+        strncpy(s_server, t.host, sizeof(s_server) - 1);
+    }
+    if (!s_server[0]) {
+        /* WebSocket log target and no server configured: boot-relative stamps only */
+        ESP_LOGW(TAG, "No SNTP server, log timestamps stay relative to boot");
+        return ESP_OK;
+    }
+
+    esp_sntp_config_t cfg = ESP_NETIF_SNTP_DEFAULT_CONFIG(s_server);
+    cfg.sync_cb = on_sync;
+    esp_sntp_set_sync_interval(SYNC_INTERVAL_MS);
+    esp_err_t err = esp_netif_sntp_init(&cfg);
+    if (err != ESP_OK) return err;
+
+    metrics_register(&s_m_syncs);
+    metrics_register(&s_m_step);
+    metrics_register(&s_m_age);
+    ESP_LOGI(TAG, "SNTP against %s every %d s", s_server, CONFIG_WB_TIME_SYNC_INTERVAL_S);
+    return ESP_OK;
+}
+
+bool time_sync_to_unix_us(int64_t timer_us, int64_t *unix_us)
+{
+    taskENTER_CRITICAL(&s_lock);
+    bool synced = s_synced_at_us != 0;
+    int64_t offset = s_offset_us;
+    taskEXIT_CRITICAL(&s_lock);
+
+    if (synced) *unix_us = timer_us + offset;
+    return synced;
+}
+
+int32_t time_sync_age_ms(void)
+{
+    taskENTER_CRITICAL(&s_lock);
+    int64_t at = s_synced_at_us;
+    taskEXIT_CRITICAL(&s_lock);
+    return at ? (int32_t)((esp_timer_get_time() - at) / 1000) : -1;
+}
+
+#endif /* CONFIG_WB_TIME_SYNC */
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "esp_err.h"
+#include "sdkconfig.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Wall-clock time for log records and /metrics, from SNTP against the
+ * workbench Pi (the log target host unless CONFIG_WB_TIME_SYNC_SERVER
+ * names another server).
+ *
+ * Timestamps stay esp_timer microseconds on the hot paths; they are
+ * mapped to Unix time with the offset measured at the last sync, so a
+ * record keeps the time it was logged, not the time it was sent.
+ */
+#if CONFIG_WB_TIME_SYNC
+esp_err_t time_sync_start(void);
+
+/**
+ * @brief Map an esp_timer_get_time() value to Unix microseconds
+ *
+ * @return false until the first sync; `unix_us` is left alone then
+ */
+bool      time_sync_to_unix_us(int64_t timer_us, int64_t *unix_us);
+
+/** Milliseconds since the last sync, -1 before the first one */
+int32_t   time_sync_age_ms(void);
+#else
+static inline esp_err_t time_sync_start(void) { return ESP_OK; }
+static inline bool time_sync_to_unix_us(int64_t timer_us, int64_t *unix_us) { return false; }
+static inline int32_t time_sync_age_ms(void) { return -1; }
+#endif
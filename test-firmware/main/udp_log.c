@@ -1,73 +1,692 @@
 #include "udp_log.h"
+#include "http_server.h"
+#include "log_defer.h"
+#include "log_ring.h"
+#include "metrics.h"
+#include "time_sync.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
-#include "freertos/message_buffer.h"
 #include "lwip/sockets.h"
+#include <errno.h>
 #include <string.h>
 #include <stdarg.h>
 #include <stdio.h>
 
 static const char *TAG = "udp_log";
 
-#define MSG_BUF_SIZE  4096
 #define MAX_LOG_LINE  256
+#define DROP_REPORT_INTERVAL_US  (1000 * 1000)
 
-static MessageBufferHandle_t s_msg_buf;
-static struct sockaddr_in s_dest_addr;
+#define SINK_HEADROOM       2       /* TCP length prefix, written in front of the payload */
+#define TCP_RETRY_US        (1000 * 1000)
+#define TCP_SEND_TIMEOUT_S  5
+#define TCP_CONNECT_TIMEOUT_S 3
+#define SINK_RETRY_TICKS    pdMS_TO_TICKS(50)
+
+#if CONFIG_WB_UDP_LOG_DEFERRED
+#define SENDER_STACK  4096      /* records are formatted in the sender task */
+#define MODE_SUFFIX   ", deferred"
+#else
+#define SENDER_STACK  3072
+#define MODE_SUFFIX   ""
+#endif
+
+#if CONFIG_WB_UDP_LOG_BATCH
+/* Batch datagram: 8-byte header followed by the queued entries.
+ *   [0..1] 'W' 'B'   magic
+ *   [2]    version   (UDP_LOG_BATCH_VERSION)
+ *   [3]    flags     (UDP_LOG_FLAG_*)
+ *   [4..7] sequence  (big-endian, +1 per datagram, wraps)
+ * Entries are newline-terminated text lines, or with UDP_LOG_FLAG_BINARY
+ * a sequence of [u16 big-endian length][log_defer record].
+ * With UDP_LOG_FLAG_TIMESTAMPS every entry is [u64 big-endian µs]
+ * [u16 big-endian length][text line or log_defer record]: the record's
+ * esp_timer time, mapped to Unix time when UDP_LOG_FLAG_UNIX_TIME is set.
+ */
+#define UDP_LOG_BATCH_VERSION  1
+#define UDP_LOG_HDR_LEN        8
+#define UDP_LOG_FLAG_BINARY    0x01
+#define UDP_LOG_FLAG_TIMESTAMPS 0x02
+#define UDP_LOG_FLAG_UNIX_TIME 0x04
+#define BATCH_MTU              CONFIG_WB_UDP_LOG_BATCH_MTU
+#define BATCH_LINGER           pdMS_TO_TICKS(CONFIG_WB_UDP_LOG_LINGER_MS)
+
+#if CONFIG_WB_UDP_LOG_DEFERRED_HOST
+#define BATCH_BINARY_FLAG      UDP_LOG_FLAG_BINARY
+#define BATCH_ENTRY_LEN_MAX    (MAX_LOG_LINE + 2)
+#define ENTRY_LEN_PREFIX       0       /* deferred records bring their own */
+#else
+#define BATCH_BINARY_FLAG      0
+#define BATCH_ENTRY_LEN_MAX    MAX_LOG_LINE
+#define ENTRY_LEN_PREFIX       2
+#endif
+
+#if CONFIG_WB_TIME_SYNC
+#define BATCH_TIMESTAMPS       1
+#define ENTRY_TS_LEN           8
+#define ENTRY_PREFIX_LEN       (ENTRY_TS_LEN + ENTRY_LEN_PREFIX)
+#define BATCH_FLAGS            (BATCH_BINARY_FLAG | UDP_LOG_FLAG_TIMESTAMPS)
+#else
+#define BATCH_TIMESTAMPS       0
+#define ENTRY_PREFIX_LEN       0
+#define BATCH_FLAGS            BATCH_BINARY_FLAG
+#endif
+#define BATCH_ENTRY_MAX        (ENTRY_PREFIX_LEN + BATCH_ENTRY_LEN_MAX)
+
+static uint8_t s_frame[SINK_HEADROOM + UDP_LOG_HDR_LEN + BATCH_MTU];
+static uint8_t *const s_batch = s_frame + SINK_HEADROOM;
+static uint32_t s_batch_seq;
+#endif
+
+static int32_t read_ring_drops(void *arg)
+{
+    return (int32_t)log_ring_drops((int)(intptr_t)arg);
+}
+
+static int32_t read_ring_used(void *arg)
+{
+    return (int32_t)log_ring_used((int)(intptr_t)arg);
+}
+
+static metric_t s_m_lines = METRIC_COUNTER_INIT("udp_log_lines_total");
+static metric_t s_m_datagrams = METRIC_COUNTER_INIT("udp_log_datagrams_total");
+static metric_t s_m_send_errors = METRIC_COUNTER_INIT("udp_log_send_errors_total");
+static metric_t s_m_dgram_bytes = METRIC_HISTOGRAM_INIT("udp_log_datagram_bytes");
+static metric_t s_m_retries = METRIC_COUNTER_INIT("udp_log_send_retries_total");
+static metric_t s_m_connects = METRIC_COUNTER_INIT("udp_log_tcp_connects_total");
+static metric_t s_m_drops[portNUM_PROCESSORS] = {
+    METRIC_COUNTER_FN_INIT("udp_log_dropped_total{core=\"0\"}", read_ring_drops, (void *)0),
+#if portNUM_PROCESSORS > 1
+    METRIC_COUNTER_FN_INIT("udp_log_dropped_total{core=\"1\"}", read_ring_drops, (void *)1),
+#endif
+};
+static metric_t s_m_used[portNUM_PROCESSORS] = {
+    METRIC_GAUGE_FN_INIT("udp_log_ring_used_bytes{core=\"0\"}", read_ring_used, (void *)0),
+#if portNUM_PROCESSORS > 1
+    METRIC_GAUGE_FN_INIT("udp_log_ring_used_bytes{core=\"1\"}", read_ring_used, (void *)1),
+#endif
+};
+
+static bool s_ring_ready;
 static vprintf_like_t s_orig_vprintf;
 
+static const char *const s_transport_names[] = {
+    [LOG_TRANSPORT_UDP] = "udp",
+    [LOG_TRANSPORT_TCP] = "tcp",
+    [LOG_TRANSPORT_WS]  = "ws",
+};
+
+static portMUX_TYPE s_target_lock = portMUX_INITIALIZER_UNLOCKED;
+static nvs_log_target_t s_target;
+static uint32_t s_target_gen;       /* bumped by udp_log_set_target() */
+static bool s_connected;
+
+#if CONFIG_WB_UART_LOG_FRAMED
+/* Serial record, see WB_UART_LOG_FRAMED in Kconfig.projbuild:
+ *   [0..1] 0x1F 'L'  marker
+ *   [2]    level     (esp_log_level_t, ESP_LOG_NONE for untagged text)
+ *   [3..6] timestamp (big-endian ms, esp_log_timestamp())
+ *   [7..8] length    (big-endian payload bytes)
+ * The payload is the line without colour codes and "X (ms) " prefix.
+ */
+#define UART_FRAME_HDR_LEN  9
+
+static esp_log_level_t level_of(char c)
+{
+    switch (c) {
+    case 'E': return ESP_LOG_ERROR;
+    case 'W': return ESP_LOG_WARN;
+    case 'I': return ESP_LOG_INFO;
+    case 'D': return ESP_LOG_DEBUG;
+    case 'V': return ESP_LOG_VERBOSE;
+    default:  return ESP_LOG_NONE;
+    }
+}
+
+/* Frame one formatted line (at most MAX_LOG_LINE bytes) and write it with
+   a single fwrite(), which holds stdout's lock, so records from different
+   tasks never interleave */
+static int serial_write(const char *line, size_t len)
+{
+    uint8_t frame[UART_FRAME_HDR_LEN + MAX_LOG_LINE];
+    uint8_t *payload = frame + UART_FRAME_HDR_LEN;
+    const char *p = line, *end = line + len;
+    esp_log_level_t level = ESP_LOG_NONE;
+
+    /* "\033[0;31mE (1234) tag: msg\033[0m\n", or without the colour codes */
+    if (end - p > 2 && p[0] == '\033' && p[1] == '[') {
+        const char *m = memchr(p, 'm', end - p);
+        if (m) p = m + 1;
+    }
+    const char *close = (end - p > 4 && p[1] == ' ' && p[2] == '(') ? memchr(p, ')', end - p) : NULL;
+    if (close && close + 1 < end && close[1] == ' ') level = level_of(p[0]);
+    p = level != ESP_LOG_NONE ? close + 2 : line;
+
+    size_t n = end - p;
+    memcpy(payload, p, n);
+    if (level != ESP_LOG_NONE && n >= 5 && memcmp(payload + n - 5, "\033[0m\n", 5) == 0) {
+        n -= 4;
+        payload[n - 1] = '\n';
+    }
+
+    uint32_t ts = esp_log_timestamp();
+    frame[0] = 0x1F;
+    frame[1] = 'L';
+    frame[2] = level;
+    frame[3] = ts >> 24;
+    frame[4] = ts >> 16;
+    frame[5] = ts >> 8;
+    frame[6] = ts;
+    frame[7] = n >> 8;
+    frame[8] = n;
+    return fwrite(frame, 1, UART_FRAME_HDR_LEN + n, stdout);
+}
+
+static int serial_vprintf(const char *fmt, va_list args)
+{
+    char line[MAX_LOG_LINE];
+    int len = vsnprintf(line, sizeof(line), fmt, args);
+    if (len <= 0) return len;
+    if (len >= (int)sizeof(line)) {
+        len = sizeof(line) - 1;
+        line[len - 1] = '\n';
+    }
+    return serial_write(line, len);
+}
+
+#else
+
+/* printf through the original (serial) vprintf — never recurses into our hook */
+static int orig_printf(const char *fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    int ret = s_orig_vprintf(fmt, ap);
+    va_end(ap);
+    return ret;
+}
+
+static inline int serial_write(const char *line, size_t len)
+{
+    return orig_printf("%.*s", (int)len, line);
+}
+
+static inline int serial_vprintf(const char *fmt, va_list args)
+{
+    return s_orig_vprintf(fmt, args);
+}
+
+#endif /* CONFIG_WB_UART_LOG_FRAMED */
+
+#if CONFIG_WB_UDP_LOG_DEFERRED
+
+static int udp_log_vprintf(const char *fmt, va_list args)
+{
+    if (s_ring_ready) {
+        uint8_t rec[MAX_LOG_LINE];
+        int len = log_defer_capture(rec, sizeof(rec), fmt, args);
+        if (len < 0) {
+            /* Format not in flash or too many/long arguments — format now */
+            rec[0] = LOG_REC_TEXT;
+            len = vsnprintf((char *)rec + 1, sizeof(rec) - 1, fmt, args);
+            if (len < 0) len = 0;
+            if (len >= (int)sizeof(rec) - 1) {
+                len = sizeof(rec) - 2;
+                rec[len] = '\n';
+            }
+            len += 1;
+        }
+        /* Sender task prints it to serial; if the ring is full, print
+           here instead so the serial console never loses a line */
+        if (log_ring_write(rec, len)) {
+            return len;
+        }
+    }
+    /* stdout takes a lock — never from an ISR */
+    return xPortInIsrContext() ? 0 : serial_vprintf(fmt, args);
+}
+
+#else
+
 static int udp_log_vprintf(const char *fmt, va_list args)
 {
-    /* Always print to serial */
-    int ret = s_orig_vprintf(fmt, args);
+#if CONFIG_WB_UART_LOG_FRAMED
+    /* Format once for both serial and the ring */
+    char buf[MAX_LOG_LINE];
+    int len = vsnprintf(buf, sizeof(buf), fmt, args);
+    if (len <= 0) return len;
+    if (len >= (int)sizeof(buf)) {
+        len = sizeof(buf) - 1;
+        buf[len - 1] = '\n';
+    }
+    if (!xPortInIsrContext()) serial_write(buf, len);
+    if (s_ring_ready) log_ring_write(buf, len);
+    return len;
+#else
+    /* Always print to serial (stdout takes a lock — never from an ISR) */
+    int ret = xPortInIsrContext() ? 0 : s_orig_vprintf(fmt, args);
 
-    if (s_msg_buf) {
+    if (s_ring_ready) {
         char buf[MAX_LOG_LINE];
         int len = vsnprintf(buf, sizeof(buf), fmt, args);
         if (len > 0) {
-            if (len >= (int)sizeof(buf)) len = sizeof(buf) - 1;
-            /* Non-blocking send — drop if buffer full */
-            xMessageBufferSendFromISR(s_msg_buf, buf, len, NULL);
+            if (len >= (int)sizeof(buf)) {
+                /* Truncated — keep the line terminator so batched lines
+                   don't run together on the receiver */
+                len = sizeof(buf) - 1;
+                buf[len - 1] = '\n';
+            }
+            /* Wait-free — dropped (and counted) if this core's ring is full */
+            log_ring_write(buf, len);
         }
     }
     return ret;
+#endif
 }
 
-static void udp_sender_task(void *arg)
+#endif /* CONFIG_WB_UDP_LOG_DEFERRED */
+
+/* Emit a warning when any core's ring dropped records since the last report */
+static void report_drops(void)
 {
-    int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
-    if (sock < 0) {
-        /* Can't use ESP_LOGE here — would recurse through our hook.
-           Fall back to original vprintf. */
-        s_orig_vprintf("udp_log: failed to create socket\n", (va_list){0});
-        vTaskDelete(NULL);
-        return;
+    static uint32_t s_reported[portNUM_PROCESSORS];
+    static int64_t s_last_us;
+
+    int64_t now = esp_timer_get_time();
+    if (now - s_last_us < DROP_REPORT_INTERVAL_US) return;
+    s_last_us = now;
+
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        uint32_t drops = log_ring_drops(core);
+        if (drops != s_reported[core]) {
+            ESP_LOGW(TAG, "core %d dropped %"PRIu32" log lines (%"PRIu32" total)",
+                     core, drops - s_reported[core], drops);
+            s_reported[core] = drops;
+        }
     }
+}
+
+/* Pop the next queued record (merged across cores) into `rec`, blocking
+   up to `wait` if all rings are empty. `ts_us` gets its esp_timer time. */
+static size_t ring_pull(uint8_t *rec, TickType_t wait, int64_t *ts_us)
+{
+    size_t len = log_ring_read(rec, MAX_LOG_LINE, ts_us);
+    if (len == 0 && wait > 0) {
+        report_drops();
+        log_ring_wait(wait);
+        len = log_ring_read(rec, MAX_LOG_LINE, ts_us);
+    }
+    return len;
+}
+
+/* Move the next queued entry into `dst` (at least MAX_LOG_LINE bytes, or
+   BATCH_ENTRY_LEN_MAX when batching). Returns 0 if nothing arrived in `wait`. */
+static size_t entry_pull(uint8_t *dst, TickType_t wait, int64_t *ts_us)
+{
+#if CONFIG_WB_UDP_LOG_DEFERRED
+    static uint8_t rec[MAX_LOG_LINE];
+    static char line[MAX_LOG_LINE];
+
+    size_t len = ring_pull(rec, wait, ts_us);
+    if (len == 0) return 0;
+
+    int n = log_defer_format(rec, len, line, sizeof(line));
+    if (n == (int)sizeof(line) - 1) line[n - 1] = '\n';   /* truncated */
+    if (rec[0] != LOG_REC_NET_TEXT) serial_write(line, n);
+#if CONFIG_WB_UDP_LOG_DEFERRED_HOST
+    (void)n;
+    dst[0] = (uint8_t)(len >> 8);
+    dst[1] = (uint8_t)len;
+    memcpy(dst + 2, rec, len);
+    return len + 2;
+#else
+    memcpy(dst, line, n);
+    return n;
+#endif
+#else
+    /* Copy straight from the ring into the destination */
+    return ring_pull(dst, wait, ts_us);
+#endif
+}
+
+/* ── Transports ────────────────────────────────────────────────── */
+
+typedef struct {
+    nvs_log_target_t target;
+    uint32_t gen;
+    int sock;
+    struct sockaddr_in addr;
+    int64_t retry_at_us;
+} sink_t;
+
+static void sink_close(sink_t *k)
+{
+    if (k->sock >= 0) close(k->sock);
+    k->sock = -1;
+    s_connected = false;
+}
+
+static int sink_connect_tcp(const sink_t *k)
+{
+    int sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (sock < 0) return -1;
+
+    /* A blocking connect to a silent host waits out lwIP's whole SYN retry
+       schedule, with every log line piling up in the ring behind it */
+    int flags = fcntl(sock, F_GETFL, 0);
+    fcntl(sock, F_SETFL, flags | O_NONBLOCK);
+    int rc = connect(sock, (const struct sockaddr *)&k->addr, sizeof(k->addr));
+    if (rc != 0 && errno == EINPROGRESS) {
+        fd_set wr;
+        FD_ZERO(&wr);
+        FD_SET(sock, &wr);
+        struct timeval ct = { .tv_sec = TCP_CONNECT_TIMEOUT_S };
+        int so_err = -1;
+        socklen_t so_len = sizeof(so_err);
+        if (select(sock + 1, NULL, &wr, NULL, &ct) == 1) {
+            getsockopt(sock, SOL_SOCKET, SO_ERROR, &so_err, &so_len);
+        }
+        rc = so_err;
+    }
+    if (rc != 0) {
+        close(sock);
+        return -1;
+    }
+    fcntl(sock, F_SETFL, flags);
+
+    /* Batches are already coalesced; a dead collector must not stall the
+       sender for longer than the send timeout */
+    int one = 1;
+    struct timeval tv = { .tv_sec = TCP_SEND_TIMEOUT_S };
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    setsockopt(sock, SOL_SOCKET, SO_KEEPALIVE, &one, sizeof(one));
+    setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    return sock;
+}
+
+/* Pick up a target change and (re)open the socket. False while there is
+   nothing to send on yet. */
+static bool sink_ready(sink_t *k)
+{
+    if (k->gen != __atomic_load_n(&s_target_gen, __ATOMIC_ACQUIRE)) {
+        sink_close(k);
+        taskENTER_CRITICAL(&s_target_lock);
+        k->target = s_target;
+        k->gen = s_target_gen;
+        taskEXIT_CRITICAL(&s_target_lock);
+
+        memset(&k->addr, 0, sizeof(k->addr));
+        k->addr.sin_family = AF_INET;
+        k->addr.sin_port = htons(k->target.port);
+        inet_aton(k->target.host, &k->addr.sin_addr);
+        k->retry_at_us = 0;
+    }
+    if (k->target.transport == LOG_TRANSPORT_WS || k->sock >= 0) return true;
+
+    int64_t now = esp_timer_get_time();
+    if (now < k->retry_at_us) return false;
+
+    if (k->target.transport == LOG_TRANSPORT_TCP) {
+        k->sock = sink_connect_tcp(k);
+        if (k->sock >= 0) {
+            metric_inc(&s_m_connects);
+            ESP_LOGI(TAG, "Log stream connected to %s:%u", k->target.host, k->target.port);
+        }
+    } else {
+        k->sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
+    }
+    if (k->sock < 0) {
+        k->retry_at_us = now + TCP_RETRY_US;
+        return false;
+    }
+    s_connected = true;
+    return true;
+}
+
+/* Send one payload. `buf` has SINK_HEADROOM writable bytes in front of it
+   for the TCP length prefix, so nothing is copied. Returns false if the
+   same payload must be offered again (TCP down, WS clients behind). */
+static bool sink_send(sink_t *k, uint8_t *buf, size_t len)
+{
+    if (!sink_ready(k)) return false;
+
+    switch (k->target.transport) {
+    case LOG_TRANSPORT_TCP: {
+        uint8_t *frame = buf - SINK_HEADROOM;
+        size_t total = len + SINK_HEADROOM;
+        frame[0] = (uint8_t)(len >> 8);
+        frame[1] = (uint8_t)len;
+        for (size_t sent = 0; sent < total; ) {
+            int n = send(k->sock, frame + sent, total - sent, 0);
+            if (n <= 0) {
+                /* The collector drops the partial frame with the connection;
+                   the whole frame goes out again on the next one */
+                metric_inc(&s_m_send_errors);
+                ESP_LOGW(TAG, "Log stream to %s:%u lost (errno %d)",
+                         k->target.host, k->target.port, errno);
+                sink_close(k);
+                return false;
+            }
+            sent += n;
+        }
+        return true;
+    }
+    case LOG_TRANSPORT_WS: {
+        esp_err_t err = http_server_ws_send_log(buf, len);
+        if (err == ESP_ERR_NO_MEM) return false;
+        s_connected = (err == ESP_OK);
+        if (err != ESP_OK) metric_inc(&s_m_send_errors);   /* no client: dropped */
+        return true;
+    }
+    default:
+        if (sendto(k->sock, buf, len, 0, (struct sockaddr *)&k->addr, sizeof(k->addr)) < 0) {
+            metric_inc(&s_m_send_errors);
+        }
+        return true;
+    }
+}
+
+static void sink_send_all(sink_t *k, uint8_t *buf, size_t len)
+{
+    while (!sink_send(k, buf, len)) {
+        metric_inc(&s_m_retries);
+        vTaskDelay(SINK_RETRY_TICKS);
+    }
+    metric_inc(&s_m_datagrams);
+    metric_observe(&s_m_dgram_bytes, len);
+}
+
+static void udp_sender_task(void *arg)
+{
+    sink_t sink = { .sock = -1 };
+
+    log_ring_set_consumer();
+
+#if CONFIG_WB_UDP_LOG_BATCH
+    size_t fill = 0;            /* payload bytes queued in s_batch */
+    TickType_t opened = 0;      /* tick at which the first queued entry arrived */
+    bool unix_time = false;     /* this batch's timestamps are Unix time */
 
-    char buf[MAX_LOG_LINE];
     while (1) {
-        size_t len = xMessageBufferReceive(s_msg_buf, buf, sizeof(buf), portMAX_DELAY);
+        TickType_t wait = portMAX_DELAY;
+        if (fill > 0) {
+            TickType_t age = xTaskGetTickCount() - opened;
+            wait = (age < BATCH_LINGER) ? BATCH_LINGER - age : 0;
+        }
+
+        /* Invariant: at least BATCH_ENTRY_MAX bytes free, so any entry fits */
+        uint8_t *entry = s_batch + UDP_LOG_HDR_LEN + fill;
+        int64_t ts = 0;
+        size_t len = entry_pull(entry + ENTRY_PREFIX_LEN, wait, &ts);
         if (len > 0) {
-            sendto(sock, buf, len, 0,
-                   (struct sockaddr *)&s_dest_addr, sizeof(s_dest_addr));
+            if (fill == 0) opened = xTaskGetTickCount();
+#if BATCH_TIMESTAMPS
+            /* One time base per batch: a sync landing mid-batch applies
+               from the next one */
+            if (fill == 0) {
+                unix_time = time_sync_to_unix_us(ts, &ts);
+            } else if (unix_time) {
+                time_sync_to_unix_us(ts, &ts);
+            }
+            for (int i = 0; i < ENTRY_TS_LEN; i++) {
+                entry[i] = (uint8_t)((uint64_t)ts >> (56 - 8 * i));
+            }
+#if !CONFIG_WB_UDP_LOG_DEFERRED_HOST
+            entry[ENTRY_TS_LEN] = (uint8_t)(len >> 8);
+            entry[ENTRY_TS_LEN + 1] = (uint8_t)len;
+#endif
+            len += ENTRY_PREFIX_LEN;
+#endif
+            fill += len;
+            metric_inc(&s_m_lines);
+            if (BATCH_MTU - fill >= BATCH_ENTRY_MAX) continue;
+        } else if (fill == 0 || xTaskGetTickCount() - opened < BATCH_LINGER) {
+            continue;
         }
+        /* Full, or linger deadline reached */
+
+        s_batch[0] = 'W';
+        s_batch[1] = 'B';
+        s_batch[2] = UDP_LOG_BATCH_VERSION;
+        s_batch[3] = BATCH_FLAGS | (unix_time ? UDP_LOG_FLAG_UNIX_TIME : 0);
+        s_batch[4] = (uint8_t)(s_batch_seq >> 24);
+        s_batch[5] = (uint8_t)(s_batch_seq >> 16);
+        s_batch[6] = (uint8_t)(s_batch_seq >> 8);
+        s_batch[7] = (uint8_t)s_batch_seq;
+        s_batch_seq++;
+
+        sink_send_all(&sink, s_batch, UDP_LOG_HDR_LEN + fill);
+        fill = 0;
+        report_drops();
     }
+#else
+    static uint8_t buf[SINK_HEADROOM + MAX_LOG_LINE];
+    while (1) {
+        size_t len = entry_pull(buf + SINK_HEADROOM, portMAX_DELAY, NULL);
+        if (len > 0) {
+            metric_inc(&s_m_lines);
+            sink_send_all(&sink, buf + SINK_HEADROOM, len);
+        }
+    }
+#endif
+}
+
+static bool target_valid(const nvs_log_target_t *t)
+{
+    struct in_addr addr;
+
+    if (t->transport > LOG_TRANSPORT_WS) return false;
+    if (t->transport == LOG_TRANSPORT_WS) return true;
+    return t->port != 0 && memchr(t->host, '\0', sizeof(t->host)) &&
+           inet_aton(t->host, &addr);
+}
+
+const char *udp_log_transport_name(log_transport_t transport)
+{
+    return transport <= LOG_TRANSPORT_WS ? s_transport_names[transport] : "unknown";
+}
+
+bool udp_log_parse_transport(const char *name, log_transport_t *out)
+{
+    for (int i = 0; i <= LOG_TRANSPORT_WS; i++) {
+        if (strcmp(name, s_transport_names[i]) == 0) {
+            *out = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+void udp_log_get_target(nvs_log_target_t *out)
+{
+    taskENTER_CRITICAL(&s_target_lock);
+    *out = s_target;
+    taskEXIT_CRITICAL(&s_target_lock);
+}
+
+bool udp_log_is_connected(void)
+{
+    return s_connected;
+}
+
+bool udp_log_write_line(const char *line, size_t len)
+{
+    if (!s_ring_ready || len == 0 || len >= MAX_LOG_LINE) return false;
+#if CONFIG_WB_UDP_LOG_DEFERRED
+    uint8_t rec[MAX_LOG_LINE];
+    rec[0] = LOG_REC_NET_TEXT;
+    memcpy(rec + 1, line, len);
+    return log_ring_write(rec, len + 1);
+#else
+    return log_ring_write(line, len);
+#endif
+}
+
+uint32_t udp_log_dropped(void)
+{
+    uint32_t drops = 0;
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        drops += log_ring_drops(core);
+    }
+    return drops;
+}
+
+static void target_apply(const nvs_log_target_t *t)
+{
+    taskENTER_CRITICAL(&s_target_lock);
+    s_target = *t;
+    taskEXIT_CRITICAL(&s_target_lock);
+    __atomic_add_fetch(&s_target_gen, 1, __ATOMIC_RELEASE);
+}
+
+esp_err_t udp_log_set_target(const nvs_log_target_t *target)
+{
+    if (!target_valid(target)) return ESP_ERR_INVALID_ARG;
+
+    target_apply(target);
+    ESP_LOGI(TAG, "Log stream -> %s %s:%u", udp_log_transport_name(target->transport),
+             target->host, target->port);
+    return nvs_store_set_log_target(target);
 }
 
 esp_err_t udp_log_init(const char *host, uint16_t port)
 {
-    s_msg_buf = xMessageBufferCreate(MSG_BUF_SIZE);
-    if (!s_msg_buf) return ESP_ERR_NO_MEM;
+    esp_err_t err = log_ring_init();
+    if (err != ESP_OK) return err;
 
-    memset(&s_dest_addr, 0, sizeof(s_dest_addr));
-    s_dest_addr.sin_family = AF_INET;
-    s_dest_addr.sin_port = htons(port);
-    inet_aton(host, &s_dest_addr.sin_addr);
+    metrics_register(&s_m_lines);
+    metrics_register(&s_m_datagrams);
+    metrics_register(&s_m_send_errors);
+    metrics_register(&s_m_dgram_bytes);
+    metrics_register(&s_m_retries);
+    metrics_register(&s_m_connects);
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        metrics_register(&s_m_drops[core]);
+        metrics_register(&s_m_used[core]);
+    }
 
-    xTaskCreate(udp_sender_task, "udp_log", 3072, NULL, 1, NULL);
+    nvs_log_target_t target = { .transport = LOG_TRANSPORT_UDP, .port = port };
+    strncpy(target.host, host, sizeof(target.host) - 1);
+    nvs_log_target_t stored;
+    if (nvs_store_get_log_target(&stored) && target_valid(&stored)) {
+        target = stored;
+    }
+    target_apply(&target);
 
+    /* Hook first: the sender task prints through s_orig_vprintf */
     s_orig_vprintf = esp_log_set_vprintf(udp_log_vprintf);
-    ESP_LOGI(TAG, "UDP logging -> %s:%d", host, port);
+    s_ring_ready = true;
+    xTaskCreate(udp_sender_task, "udp_log", SENDER_STACK, NULL, 1, NULL);
+
+#if CONFIG_WB_UDP_LOG_BATCH
+    ESP_LOGI(TAG, "Log stream -> %s %s:%u (batched, %d B / %d ms%s)",
+             udp_log_transport_name(target.transport), target.host, target.port,
+             BATCH_MTU, CONFIG_WB_UDP_LOG_LINGER_MS, MODE_SUFFIX);
+#else
+    ESP_LOGI(TAG, "Log stream -> %s %s:%u", udp_log_transport_name(target.transport),
+             target.host, target.port);
+#endif
     return ESP_OK;
 }
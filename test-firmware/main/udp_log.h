@@ -1,5 +1,57 @@
 #pragma once
 
 #include "esp_err.h"
+#include "nvs_store.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
+/* How the log stream leaves the device. All three drain the same per-core
+   rings and carry the same payload: a batch datagram (or a single line
+   without CONFIG_WB_UDP_LOG_BATCH).
+ *   UDP  one datagram per batch, fire and forget
+ *   TCP  client connection to host:port, each batch framed as
+ *        [u16 big-endian length][batch]; a batch that fails to send is
+ *        resent on the next connection, so nothing queued is lost
+ *   WS   binary frames to the WebSocket clients on /ws (host/port unused)
+ */
+typedef enum {
+    LOG_TRANSPORT_UDP,
+    LOG_TRANSPORT_TCP,
+    LOG_TRANSPORT_WS,
+} log_transport_t;
+
+/**
+ * @brief Hook ESP_LOGx and start the sender task
+ *
+ * Sends to the target stored in NVS, or to UDP host:port if none is.
+ */
 esp_err_t udp_log_init(const char *host, uint16_t port);
+
+/**
+ * @brief Switch the log stream to a new target and store it in NVS
+ *
+ * The sender task reconnects before its next batch.
+ *
+ * @return ESP_ERR_INVALID_ARG for an unknown transport, or a host that is
+ *         not a dotted IPv4 address (UDP/TCP)
+ */
+esp_err_t udp_log_set_target(const nvs_log_target_t *target);
+
+/**
+ * @brief Queue one complete line for the log target, bypassing the serial
+ *        console
+ *
+ * For bulk machine-readable streams (profiler samples). Any context,
+ * including ISRs; `len` includes the trailing newline.
+ *
+ * @return false if the line was dropped (ring full, or logging not up yet)
+ */
+bool        udp_log_write_line(const char *line, size_t len);
+
+void        udp_log_get_target(nvs_log_target_t *out);
+bool        udp_log_is_connected(void);
+uint32_t    udp_log_dropped(void);      /* ring drops, all cores */
+
+const char *udp_log_transport_name(log_transport_t transport);
+bool        udp_log_parse_transport(const char *name, log_transport_t *out);
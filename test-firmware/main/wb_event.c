@@ -0,0 +1,8 @@
+#include "wb_event.h"
+
+ESP_EVENT_DEFINE_BASE(WB_EVENT);
+
+void wb_event_post(int32_t id, const void *data, size_t len)
+{
+    esp_event_post(WB_EVENT, id, data, len, 0);
+}
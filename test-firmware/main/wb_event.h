@@ -0,0 +1,40 @@
+#pragma once
+
+#include "esp_event.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/* State-change events on the default event loop. http_server pushes them
+   to WebSocket clients on /ws; anything else may subscribe too. */
+ESP_EVENT_DECLARE_BASE(WB_EVENT);
+
+enum {
+    WB_EVENT_WIFI,      /* wb_event_wifi_t */
+    WB_EVENT_BLE,       /* wb_event_ble_t */
+    WB_EVENT_OTA,       /* wb_event_ota_t */
+};
+
+typedef struct {
+    bool connected;
+    uint8_t reason;     /* disconnect reason, 0 when connected */
+    int8_t rssi;
+} wb_event_wifi_t;
+
+typedef struct {
+    bool connected;
+    uint16_t mtu;
+} wb_event_ble_t;
+
+typedef struct {
+    int state;          /* ota_state_t */
+    uint32_t written;
+    uint32_t total;
+    uint32_t resumes;
+    esp_err_t err;
+} wb_event_ota_t;
+
+/**
+ * @brief Post an event without blocking; dropped if the loop is full or
+ *        not created yet
+ */
+void wb_event_post(int32_t id, const void *data, size_t len);
@@ -1,4 +1,5 @@
 #include "wifi_prov.h"
+#include "boot_seq.h"
 #include "nvs_store.h"
 #include "esp_wifi.h"
 #include "esp_log.h"
@@ -6,24 +7,255 @@
 #include "esp_http_server.h"
 #include "esp_netif.h"
 #include "esp_event.h"
+#include "esp_random.h"
+#include "esp_rom_crc.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 #include "lwip/inet.h"
+#include "mbedtls/pkcs5.h"
 #include "dns_server.h"
-#include "cJSON.h"
+#include "metrics.h"
+#include "wb_event.h"
+#include "json_stream.h"
+#include "http_server.h"
+#include "power_profile.h"
+#include <inttypes.h>
+#include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 
 static const char *TAG = "wifi_prov";
 
 #define AP_SSID        "WB-Test-Setup"
-#define STA_MAX_RETRY  20
+#define PORTAL_URL     "http://192.168.4.1/"
+#define STA_READY_AFTER_FAILS 5     /* boot stops waiting for WiFi after this many */
 
 extern const char portal_html_start[] asm("_binary_portal_html_start");
 extern const char portal_html_end[]   asm("_binary_portal_html_end");
-
-static int s_retry_count = 0;
+extern const char portal_gz_start[]   asm("_binary_portal_html_gz_start");
+extern const char portal_gz_end[]     asm("_binary_portal_html_gz_end");
+
+/* OS connectivity probes. Anything but the expected answer means "captive",
+   so each gets an empty redirect straight to the portal instead of a 404
+   round trip through the error handler. */
+static const char *const s_probe_paths[] = {
+    "/generate_204", "/gen_204",                            /* Android, ChromeOS */
+    "/hotspot-detect.html", "/library/test/success.html",   /* Apple */
+    "/connecttest.txt", "/ncsi.txt", "/redirect",           /* Windows */
+    "/canonical.html", "/success.txt",                      /* Firefox */
+};
+
+/* STA reconnect state machine, exported as the wifi_sta_state gauge */
+typedef enum {
+    STA_IDLE,
+    STA_CONNECTING,
+    STA_CONNECTED,
+    STA_BACKOFF,
+} sta_state_t;
+
+static sta_state_t s_sta_state = STA_IDLE;
+static uint32_t s_attempt;          /* failed attempts since the last IP */
+static esp_timer_handle_t s_retry_timer;
 static bool s_sta_connected = false;
 static bool s_ap_mode = false;
 static httpd_handle_t s_server = NULL;
+static dns_server_handle_t s_dns = NULL;
+
+/* STA config with a normal scan; the fast-connect config is derived from it */
+static wifi_config_t s_sta_cfg;
+static nvs_wifi_fast_t s_fast;
+static bool s_fast_valid;           /* s_fast matches what is stored in NVS */
+static bool s_using_fast;           /* the driver currently holds the fast config */
+static bool s_fast_pending;         /* first association, made with the fast config */
+static int64_t s_connect_start_us;
+
+static int32_t read_sta_connected(void *arg)
+{
+    return s_sta_connected;
+}
+
+static int32_t read_sta_rssi(void *arg)
+{
+    wifi_ap_record_t ap;
+    if (!s_sta_connected || esp_wifi_sta_get_ap_info(&ap) != ESP_OK) return 0;
+    return ap.rssi;
+}
+
+static metric_t s_m_retries = METRIC_COUNTER_INIT("wifi_sta_retries_total");
+static metric_t s_m_disconnects = METRIC_COUNTER_INIT("wifi_sta_disconnects_total");
+static metric_t s_m_got_ip = METRIC_COUNTER_INIT("wifi_sta_got_ip_total");
+static metric_t s_m_ap_joins = METRIC_COUNTER_INIT("wifi_ap_station_joins_total");
+static metric_t s_m_connected = METRIC_GAUGE_FN_INIT("wifi_sta_connected", read_sta_connected, NULL);
+static metric_t s_m_rssi = METRIC_GAUGE_FN_INIT("wifi_sta_rssi_dbm", read_sta_rssi, NULL);
+static metric_t s_m_fast = METRIC_COUNTER_INIT("wifi_sta_fast_connects_total");
+static metric_t s_m_fast_fallbacks = METRIC_COUNTER_INIT("wifi_sta_fast_fallbacks_total");
+static metric_t s_m_connect_ms = METRIC_GAUGE_INIT("wifi_sta_connect_ms");
+static metric_t s_m_auth_fails = METRIC_COUNTER_INIT("wifi_sta_auth_failures_total");
+static metric_t s_m_backoff = METRIC_GAUGE_INIT("wifi_sta_backoff_ms");
+static metric_t s_m_reason = METRIC_GAUGE_INIT("wifi_sta_last_disconnect_reason");
+static metric_t s_m_portal = METRIC_COUNTER_INIT("wifi_portal_pages_total");
+static metric_t s_m_portal_304 = METRIC_COUNTER_INIT("wifi_portal_not_modified_total");
+static metric_t s_m_probes = METRIC_COUNTER_INIT("wifi_portal_probes_total");
+
+static int32_t read_sta_state(void *arg)
+{
+    return s_sta_state;
+}
+
+static metric_t s_m_state = METRIC_GAUGE_FN_INIT("wifi_sta_state", read_sta_state, NULL);
+
+/* ── Reconnect with backoff ────────────────────────────────────── */
+
+static void sta_connect(void)
+{
+    s_sta_state = STA_CONNECTING;
+    esp_wifi_connect();
+}
+
+static void sta_retry_timer_cb(void *arg)
+{
+    if (s_sta_state == STA_BACKOFF) sta_connect();
+}
+
+/* The AP is up but rejecting us: wrong credentials, or it is still coming
+   up after a reboot. Back off faster than for a plain missing AP. */
+static bool reason_is_auth(uint8_t reason)
+{
+    switch (reason) {
+    case WIFI_REASON_AUTH_EXPIRE:
+    case WIFI_REASON_AUTH_FAIL:
+    case WIFI_REASON_MIC_FAILURE:
+    case WIFI_REASON_4WAY_HANDSHAKE_TIMEOUT:
+    case WIFI_REASON_HANDSHAKE_TIMEOUT:
+        return true;
+    default:
+        return false;
+    }
+}
+
+/* Exponential backoff with equal jitter: half the step fixed, half random */
+static uint32_t backoff_ms(uint32_t attempt)
+{
+    uint32_t step = CONFIG_WB_WIFI_BACKOFF_MAX_MS;
+    if (attempt < 16) {
+        step = (uint32_t)CONFIG_WB_WIFI_BACKOFF_MIN_MS << attempt;
+        if (step > CONFIG_WB_WIFI_BACKOFF_MAX_MS) step = CONFIG_WB_WIFI_BACKOFF_MAX_MS;
+    }
+    return step / 2 + esp_random() % (step / 2 + 1);
+}
+
+static void sta_schedule_retry(uint8_t reason, bool was_connected)
+{
+    bool auth = reason_is_auth(reason);
+    if (was_connected) {
+        s_attempt = 0;      /* a blip on a working link: first retry comes quickly */
+    }
+    uint32_t ms = backoff_ms(s_attempt);
+    s_attempt += auth ? 2 : 1;
+
+    if (auth) metric_inc(&s_m_auth_fails);
+    metric_inc(&s_m_retries);
+    metric_set(&s_m_backoff, ms);
+    ESP_LOGW(TAG, "STA disconnect (reason=%d%s), attempt %lu, retry in %lu ms",
+             reason, auth ? ", auth" : "", (unsigned long)s_attempt, (unsigned long)ms);
+
+    s_sta_state = STA_BACKOFF;
+    esp_timer_start_once(s_retry_timer, (uint64_t)ms * 1000);
+
+    if (s_attempt >= STA_READY_AFTER_FAILS) {
+        boot_seq_signal(BOOT_WIFI_READY);   /* don't hold up BLE any longer */
+    }
+}
+
+/* ── Fast reconnect ────────────────────────────────────────────── */
+
+#if CONFIG_WB_WIFI_FAST_CONNECT
+/* Pin the stored BSSID and channel; a 64-digit hex password is taken as
+   the PSK itself, so the driver skips PBKDF2. */
+static void fast_apply(wifi_config_t *cfg, const nvs_wifi_fast_t *fast)
+{
+    static const char hex[] = "0123456789abcdef";
+
+    cfg->sta.bssid_set = true;
+    memcpy(cfg->sta.bssid, fast->bssid, sizeof(fast->bssid));
+    cfg->sta.channel = fast->channel;
+    cfg->sta.scan_method = WIFI_FAST_SCAN;
+    if (fast->has_pmk) {
+        for (int i = 0; i < 32; i++) {
+            cfg->sta.password[2 * i] = hex[fast->pmk[i] >> 4];
+            cfg->sta.password[2 * i + 1] = hex[fast->pmk[i] & 0xf];
+        }
+    }
+}
+
+typedef struct {
+    nvs_wifi_fast_t fast;
+    bool derive_pmk;
+} fast_save_t;
+
+static void fast_save_task(void *arg)
+{
+    fast_save_t *job = arg;
+    nvs_wifi_fast_t *fast = &job->fast;
+    const char *ssid = (const char *)s_sta_cfg.sta.ssid;
+    const char *pass = (const char *)s_sta_cfg.sta.password;
+
+    if (job->derive_pmk) {
+        /* PMK = PBKDF2-SHA1(passphrase, SSID, 4096, 32), as the supplicant derives it */
+        int rc = mbedtls_pkcs5_pbkdf2_hmac_ext(MBEDTLS_MD_SHA1,
+                                               (const unsigned char *)pass, strlen(pass),
+                                               (const unsigned char *)ssid, strlen(ssid),
+                                               4096, sizeof(fast->pmk), fast->pmk);
+        if (rc != 0) {
+            ESP_LOGW(TAG, "PMK derivation failed (%d), caching BSSID only", rc);
+            fast->has_pmk = false;
+        }
+    }
+    esp_err_t err = nvs_store_set_wifi_fast(fast);
+    s_fast = *fast;
+    s_fast_valid = true;
+    ESP_LOGI(TAG, "Cached BSSID " MACSTR " channel %d%s for fast reconnect",
+             MAC2STR(fast->bssid), fast->channel, fast->has_pmk ? " + PMK" : "");
+    if (err != ESP_OK) ESP_LOGW(TAG, "Fast reconnect info not saved: %s", esp_err_to_name(err));
+    free(job);
+    vTaskDelete(NULL);
+}
+
+/* Store the current AP's parameters if they differ from what is cached */
+static void fast_remember(void)
+{
+    wifi_ap_record_t ap;
+    if (esp_wifi_sta_get_ap_info(&ap) != ESP_OK) return;
+
+    /* A 64-digit password already is the PSK; WPA3-SAE has no reusable PMK */
+    size_t pass_len = strnlen((const char *)s_sta_cfg.sta.password, sizeof(s_sta_cfg.sta.password));
+    bool psk = (ap.authmode == WIFI_AUTH_WPA_PSK || ap.authmode == WIFI_AUTH_WPA2_PSK ||
+                ap.authmode == WIFI_AUTH_WPA_WPA2_PSK) &&
+               pass_len > 0 && pass_len < 64;
+    if (s_fast_valid && memcmp(s_fast.bssid, ap.bssid, 6) == 0 &&
+        s_fast.channel == ap.primary && s_fast.has_pmk == psk) {
+        return;
+    }
+
+    fast_save_t *job = calloc(1, sizeof(*job));
+    if (!job) return;
+    memcpy(job->fast.bssid, ap.bssid, 6);
+    job->fast.channel = ap.primary;
+    job->fast.has_pmk = psk;
+    if (psk && s_fast_valid && s_fast.has_pmk) {
+        /* Same credentials (NVS drops the cache when they change), same PMK */
+        memcpy(job->fast.pmk, s_fast.pmk, sizeof(job->fast.pmk));
+    } else {
+        job->derive_pmk = psk;
+    }
+
+    /* PBKDF2 takes hundreds of ms; keep it off the event loop */
+    if (xTaskCreate(fast_save_task, "wifi_fast", 4096, job, 1, NULL) != pdPASS) {
+        free(job);
+    }
+}
+#endif
 
 /* ── Event handlers ────────────────────────────────────────────── */
 
@@ -33,25 +265,48 @@ static void wifi_event_handler(void *arg, esp_event_base_t base,
     if (base == WIFI_EVENT) {
         switch (id) {
         case WIFI_EVENT_STA_START:
-            esp_wifi_connect();
+            sta_connect();
             break;
         case WIFI_EVENT_STA_DISCONNECTED: {
             wifi_event_sta_disconnected_t *dis = data;
+            bool was_connected = s_sta_connected;
             s_sta_connected = false;
-            if (s_retry_count < STA_MAX_RETRY) {
-                s_retry_count++;
-                ESP_LOGW(TAG, "STA disconnect (reason=%d), retry %d/%d",
-                         dis->reason, s_retry_count, STA_MAX_RETRY);
-                esp_wifi_connect();
+            metric_inc(&s_m_disconnects);
+            metric_set(&s_m_reason, dis->reason);
+            if (was_connected) {
+                wb_event_wifi_t ev = { .connected = false, .reason = dis->reason };
+                wb_event_post(WB_EVENT_WIFI, &ev, sizeof(ev));
+            }
+            if (s_using_fast) {
+                /* The AP may have moved channel or BSSID: scan from here on */
+                s_using_fast = false;
+                esp_wifi_set_config(WIFI_IF_STA, &s_sta_cfg);
+            }
+            if (s_fast_pending) {
+                s_fast_pending = false;
+                metric_inc(&s_m_fast_fallbacks);
+                ESP_LOGW(TAG, "Fast connect failed (reason=%d), scanning", dis->reason);
+                sta_connect();
             } else {
-                ESP_LOGE(TAG, "STA failed after %d retries (last reason=%d)",
-                         STA_MAX_RETRY, dis->reason);
+                sta_schedule_retry(dis->reason, was_connected);
             }
             break;
         }
+        case WIFI_EVENT_AP_START:
+            /* Captive DNS lives exactly as long as the AP interface */
+            if (!s_dns) {
+                dns_server_config_t dns_cfg = DNS_SERVER_CONFIG_SINGLE("*", "WIFI_AP_DEF");
+                s_dns = start_dns_server(&dns_cfg);
+            }
+            break;
+        case WIFI_EVENT_AP_STOP:
+            stop_dns_server(s_dns);
+            s_dns = NULL;
+            break;
         case WIFI_EVENT_AP_STACONNECTED: {
             wifi_event_ap_staconnected_t *e = data;
             ESP_LOGI(TAG, "AP: station " MACSTR " joined", MAC2STR(e->mac));
+            metric_inc(&s_m_ap_joins);
             break;
         }
         default:
@@ -61,17 +316,83 @@ static void wifi_event_handler(void *arg, esp_event_base_t base,
         ip_event_got_ip_t *e = data;
         ESP_LOGI(TAG, "STA got IP: " IPSTR, IP2STR(&e->ip_info.ip));
         s_sta_connected = true;
-        s_retry_count = 0;
+        s_sta_state = STA_CONNECTED;
+        s_attempt = 0;
+        metric_set(&s_m_backoff, 0);
+        metric_inc(&s_m_got_ip);
+        boot_seq_mark(BOOT_MARK_IP);
+        boot_seq_signal(BOOT_WIFI_READY);
+
+        wb_event_wifi_t ev = { .connected = true, .rssi = (int8_t)read_sta_rssi(NULL) };
+        wb_event_post(WB_EVENT_WIFI, &ev, sizeof(ev));
+        if (s_connect_start_us) {
+            uint32_t ms = (uint32_t)((esp_timer_get_time() - s_connect_start_us) / 1000);
+            metric_set(&s_m_connect_ms, ms);
+            ESP_LOGI(TAG, "Connected %lu ms after start (%s)", (unsigned long)ms,
+                     s_fast_pending ? "cached BSSID" : "scan");
+            s_connect_start_us = 0;
+        }
+        if (s_fast_pending) {
+            s_fast_pending = false;
+            metric_inc(&s_m_fast);
+        }
+#if CONFIG_WB_WIFI_FAST_CONNECT
+        fast_remember();
+#endif
     }
 }
 
 /* ── Captive portal HTTP handlers ──────────────────────────────── */
 
+static bool req_hdr_contains(httpd_req_t *req, const char *field, const char *token)
+{
+    char val[64];
+    return httpd_req_get_hdr_value_str(req, field, val, sizeof(val)) == ESP_OK &&
+           strstr(val, token) != NULL;
+}
+
+/* Served straight from flash: gzip body when the client takes it (every
+   browser does), the plain copy otherwise. The ETag is the CRC of the
+   compressed image, so it changes with the firmware's portal.html. */
 static esp_err_t portal_get_handler(httpd_req_t *req)
 {
+    static char s_etag[12];
+    if (!s_etag[0]) {
+        uint32_t crc = esp_rom_crc32_le(0, (const uint8_t *)portal_gz_start,
+                                        portal_gz_end - portal_gz_start);
+        snprintf(s_etag, sizeof(s_etag), "\"%08" PRIx32 "\"", crc);
+    }
+
+    httpd_resp_set_hdr(req, "ETag", s_etag);
+    httpd_resp_set_hdr(req, "Cache-Control", "max-age=300");
+    httpd_resp_set_hdr(req, "Vary", "Accept-Encoding");
+    if (req_hdr_contains(req, "If-None-Match", s_etag)) {
+        metric_inc(&s_m_portal_304);
+        httpd_resp_set_status(req, "304 Not Modified");
+        return httpd_resp_send(req, NULL, 0);
+    }
+
+    metric_inc(&s_m_portal);
     httpd_resp_set_type(req, "text/html");
-    httpd_resp_send(req, portal_html_start, portal_html_end - portal_html_start);
-    return ESP_OK;
+    if (req_hdr_contains(req, "Accept-Encoding", "gzip")) {
+        httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
+        return httpd_resp_send(req, portal_gz_start, portal_gz_end - portal_gz_start);
+    }
+    return httpd_resp_send(req, portal_html_start, portal_html_end - portal_html_start);
+}
+
+static esp_err_t portal_redirect(httpd_req_t *req)
+{
+    httpd_resp_set_status(req, "302 Found");
+    httpd_resp_set_hdr(req, "Location", PORTAL_URL);
+    httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+    return httpd_resp_send(req, NULL, 0);
+}
+
+static esp_err_t probe_handler(httpd_req_t *req)
+{
+    metric_inc(&s_m_probes);
+    return portal_redirect(req);
 }
 
 /* URL-decode a string in-place. Returns decoded length. */
@@ -125,11 +446,14 @@ static esp_err_t connect_post_handler(httpd_req_t *req)
     const char *ssid = NULL;
     const char *pass = NULL;
 
-    /* Try JSON first, fall back to form-encoded */
-    cJSON *json = cJSON_Parse(buf);
-    if (json) {
-        ssid = cJSON_GetStringValue(cJSON_GetObjectItem(json, "ssid"));
-        pass = cJSON_GetStringValue(cJSON_GetObjectItem(json, "password"));
+    /* JSON if the body is an object, otherwise form-encoded */
+    const char *p = buf;
+    while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') p++;
+    if (*p == '{') {
+        if (json_get_string(buf, "ssid", ssid_buf, sizeof(ssid_buf)))
+            ssid = ssid_buf;
+        if (json_get_string(buf, "password", pass_buf, sizeof(pass_buf)))
+            pass = pass_buf;
     } else {
         if (form_get(buf, "ssid", ssid_buf, sizeof(ssid_buf)))
             ssid = ssid_buf;
@@ -138,13 +462,17 @@ static esp_err_t connect_post_handler(httpd_req_t *req)
     }
 
     if (!ssid || strlen(ssid) == 0) {
-        if (json) cJSON_Delete(json);
         httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Missing SSID");
         return ESP_FAIL;
     }
 
-    nvs_store_set_wifi(ssid, pass ? pass : "");
-    if (json) cJSON_Delete(json);
+    esp_err_t err = nvs_store_set_wifi(ssid, pass ? pass : "");
+    if (err != ESP_OK) {
+        /* Rebooting would only come back up in AP mode */
+        ESP_LOGE(TAG, "Credentials not saved: %s", esp_err_to_name(err));
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to save credentials");
+        return ESP_OK;
+    }
 
     httpd_resp_set_type(req, "application/json");
     httpd_resp_sendstr(req, "{\"status\":\"ok\",\"message\":\"Rebooting...\"}");
@@ -157,10 +485,13 @@ static esp_err_t connect_post_handler(httpd_req_t *req)
 
 static esp_err_t redirect_handler(httpd_req_t *req, httpd_err_code_t err)
 {
-    httpd_resp_set_status(req, "302 Temporary Redirect");
-    httpd_resp_set_hdr(req, "Location", "/");
-    httpd_resp_send(req, "Redirect to captive portal", HTTPD_RESP_USE_STRLEN);
-    return ESP_OK;
+    /* Nothing to redirect a page's icon to */
+    if (strcmp(req->uri, "/favicon.ico") == 0) {
+        httpd_resp_set_status(req, "404 Not Found");
+        httpd_resp_set_hdr(req, "Cache-Control", "max-age=86400");
+        return httpd_resp_send(req, NULL, 0);
+    }
+    return portal_redirect(req);
 }
 
 static void start_portal_server(void)
@@ -168,6 +499,10 @@ static void start_portal_server(void)
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
     config.max_open_sockets = 7;
     config.lru_purge_enable = true;
+    config.max_uri_handlers = 2 + sizeof(s_probe_paths) / sizeof(s_probe_paths[0]);
+#if CONFIG_WB_MEM_CONSOLIDATED
+    config.max_uri_handlers += HTTP_SERVER_URI_HANDLERS;   /* http_server_start() adds its own */
+#endif
 
     if (httpd_start(&s_server, &config) != ESP_OK) {
         ESP_LOGE(TAG, "Failed to start HTTP server");
@@ -183,6 +518,12 @@ static void start_portal_server(void)
 
     httpd_register_uri_handler(s_server, &portal_get);
     httpd_register_uri_handler(s_server, &connect_post);
+    for (size_t i = 0; i < sizeof(s_probe_paths) / sizeof(s_probe_paths[0]); i++) {
+        httpd_uri_t probe = {
+            .uri = s_probe_paths[i], .method = HTTP_GET, .handler = probe_handler
+        };
+        httpd_register_uri_handler(s_server, &probe);
+    }
     httpd_register_err_handler(s_server, HTTPD_404_NOT_FOUND, redirect_handler);
 
     ESP_LOGI(TAG, "Portal HTTP server started");
@@ -200,12 +541,35 @@ static esp_err_t start_sta(const char *ssid, const char *password)
     ESP_ERROR_CHECK(esp_event_handler_register(WIFI_EVENT, ESP_EVENT_ANY_ID, wifi_event_handler, NULL));
     ESP_ERROR_CHECK(esp_event_handler_register(IP_EVENT, IP_EVENT_STA_GOT_IP, wifi_event_handler, NULL));
 
-    wifi_config_t wifi_cfg = {};
-    strncpy((char *)wifi_cfg.sta.ssid, ssid, sizeof(wifi_cfg.sta.ssid) - 1);
-    strncpy((char *)wifi_cfg.sta.password, password, sizeof(wifi_cfg.sta.password) - 1);
+    /* Credentials and the fast-connect cache live in nvs_store; don't let
+       the driver rewrite its own copy on every boot */
+    esp_wifi_set_storage(WIFI_STORAGE_RAM);
+
+    const esp_timer_create_args_t retry_args = {
+        .callback = sta_retry_timer_cb,
+        .name = "wifi_retry",
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&retry_args, &s_retry_timer));
+
+    strncpy((char *)s_sta_cfg.sta.ssid, ssid, sizeof(s_sta_cfg.sta.ssid) - 1);
+    strncpy((char *)s_sta_cfg.sta.password, password, sizeof(s_sta_cfg.sta.password) - 1);
+    s_sta_cfg.sta.listen_interval = power_profile_listen_interval();
+    wifi_config_t wifi_cfg = s_sta_cfg;
+
+#if CONFIG_WB_WIFI_FAST_CONNECT
+    if (nvs_store_get_wifi_fast(&s_fast)) {
+        s_fast_valid = true;
+        s_using_fast = true;
+        s_fast_pending = true;
+        fast_apply(&wifi_cfg, &s_fast);
+        ESP_LOGI(TAG, "Fast connect: BSSID " MACSTR " channel %d%s",
+                 MAC2STR(s_fast.bssid), s_fast.channel, s_fast.has_pmk ? " with cached PMK" : "");
+    }
+#endif
 
     ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
     ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_cfg));
+    s_connect_start_us = esp_timer_get_time();
     ESP_ERROR_CHECK(esp_wifi_start());
 
     wifi_mode_t mode;
@@ -244,17 +608,16 @@ static esp_err_t start_ap(void)
 
     ESP_LOGI(TAG, "AP started: SSID='%s' channel=1 auth=OPEN", AP_SSID);
 
-    /* Captive portal HTTP + DNS */
+    /* Captive portal HTTP; DNS starts with the AP (WIFI_EVENT_AP_START) */
     esp_log_level_set("httpd_uri", ESP_LOG_ERROR);
     esp_log_level_set("httpd_txrx", ESP_LOG_ERROR);
     esp_log_level_set("httpd_parse", ESP_LOG_ERROR);
 
     start_portal_server();
 
-    dns_server_config_t dns_cfg = DNS_SERVER_CONFIG_SINGLE("*", "WIFI_AP_DEF");
-    start_dns_server(&dns_cfg);
-
     ESP_LOGI(TAG, "AP mode: SSID='%s', portal at 192.168.4.1", AP_SSID);
+    boot_seq_mark(BOOT_MARK_AP);
+    boot_seq_signal(BOOT_WIFI_READY);
     return ESP_OK;
 }
 
@@ -265,6 +628,23 @@ esp_err_t wifi_prov_init(void)
     char ssid[33] = {0};
     char pass[65] = {0};
 
+    metrics_register(&s_m_retries);
+    metrics_register(&s_m_disconnects);
+    metrics_register(&s_m_got_ip);
+    metrics_register(&s_m_ap_joins);
+    metrics_register(&s_m_connected);
+    metrics_register(&s_m_rssi);
+    metrics_register(&s_m_fast);
+    metrics_register(&s_m_fast_fallbacks);
+    metrics_register(&s_m_connect_ms);
+    metrics_register(&s_m_auth_fails);
+    metrics_register(&s_m_backoff);
+    metrics_register(&s_m_reason);
+    metrics_register(&s_m_state);
+    metrics_register(&s_m_portal);
+    metrics_register(&s_m_portal_304);
+    metrics_register(&s_m_probes);
+
     if (nvs_store_get_wifi(ssid, sizeof(ssid), pass, sizeof(pass))) {
         ESP_LOGI(TAG, "Found stored WiFi credentials");
         return start_sta(ssid, pass);
@@ -293,3 +673,26 @@ bool wifi_prov_is_ap_mode(void)
     return s_ap_mode;
 }
 
+httpd_handle_t wifi_prov_portal_server(void)
+{
+    return s_server;
+}
+
+void wifi_prov_set_listen_interval(uint8_t interval)
+{
+    if (s_ap_mode || s_sta_cfg.sta.listen_interval == interval) return;
+    s_sta_cfg.sta.listen_interval = interval;
+
+    /* Keep whatever the running config pins (fast-connect BSSID/channel) */
+    wifi_config_t cfg;
+    if (esp_wifi_get_config(WIFI_IF_STA, &cfg) == ESP_OK) {
+        cfg.sta.listen_interval = interval;
+        esp_wifi_set_config(WIFI_IF_STA, &cfg);
+    }
+}
+
+
+int8_t wifi_prov_rssi(void)
+{
+    return (int8_t)read_sta_rssi(NULL);
+}
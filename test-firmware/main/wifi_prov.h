@@ -1,9 +1,27 @@
 #pragma once
 
 #include "esp_err.h"
+#include "esp_http_server.h"
 #include <stdbool.h>
+#include <stdint.h>
 
 esp_err_t wifi_prov_init(void);
 void      wifi_prov_reset(void);
 bool      wifi_prov_is_connected(void);
 bool      wifi_prov_is_ap_mode(void);
+
+/**
+ * @brief The captive portal's HTTP server (port 80), NULL outside AP mode
+ */
+httpd_handle_t wifi_prov_portal_server(void);
+
+/**
+ * @brief Beacon intervals between STA wake-ups under WIFI_PS_MAX_MODEM;
+ *        sent to the AP on the next association
+ */
+void      wifi_prov_set_listen_interval(uint8_t interval);
+
+/**
+ * @brief RSSI of the associated AP in dBm, 0 when not connected as STA
+ */
+int8_t    wifi_prov_rssi(void);